@@ -0,0 +1,284 @@
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Weffc++"
+#pragma GCC diagnostic ignored "-Wunused-local-typedefs"
+#pragma GCC diagnostic ignored "-Wattributes"
+#include "openpcr/openpcr.ino"
+#pragma GCC diagnostic pop
+
+#include "controlscheduler.h"
+#include "experiment.h"
+#include "simhal.h"
+#include "thermalplant.h"
+#include "timesource.h"
+
+//Runs the firmware against the simulated board in sim/ and a thermal model
+//of the block and lid, in faster than real time.
+//
+//Usage: openpcr_sim [-p program_file] [-t trace_interval_ms] [-m max_time_s] [-c event|step] [-b brownout_s]
+//       openpcr_sim -s [-x speed]
+//
+//program_file is either an experiment saved by the OpenPCR app (.pcr) or
+//a command as the host writes it to CONTROL.TXT, e.g.
+//s=ACGTC&c=start&l=110&n=test&p=(1[30|95|Melt|0])(1[0|20|Hold|0])
+//
+//The clock is event driven by default: as long as the firmware only polls
+//the hardware, time jumps to the next moment the hardware changes. With
+//'-c step' the loop runs every millisecond instead, as on the board.
+//
+//With -b the controller is reset as by a brown-out that many seconds
+//into the run, so a run can be seen to resume from the EEPROM.
+//
+//With -s the simulator is an emulated unit instead: standard input and
+//output are its serial port, the host drives it with the packets of
+//SerialControl, and the clock follows the wall clock, sped up by the
+//factor given with -x. It runs until standard input is closed.
+
+namespace {
+
+//A standard 35-cycle PCR
+const char DEFAULT_PROGRAM[] =
+  "s=ACGTC&c=start&d=1&l=110&n=Simulated PCR"
+  "&p=(1[120|95|Initial melt|0])"
+  "(35[30|95|Denaturing|0][30|55|Annealing|0][30|72|Extending|0])"
+  "(1[300|72|Final extend|0][0|4|Final Hold|0])";
+
+const unsigned long LOOP_DURATION_MS = 1; //time one loop() takes besides waiting on the ADC
+
+const char* ProgramStateString(const Thermocycler::ProgramState state)
+{
+  switch (state)
+  {
+    case Thermocycler::EStartup: return "startup";
+    case Thermocycler::EStopped: return "stopped";
+    case Thermocycler::ELidWait: return "lidwait";
+    case Thermocycler::ERunning: return "running";
+    case Thermocycler::EComplete: return "complete";
+    case Thermocycler::EError: return "error";
+    case Thermocycler::EClear: break;
+  }
+  return "unknown";
+}
+
+bool ReadProgram(const char* filename, char* buf, const int size)
+{
+  FILE* f = fopen(filename, "rb");
+  if (!f)
+    return false;
+  std::string text;
+  char chunk[512];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+    text.append(chunk, n);
+  fclose(f);
+
+  //strip the trailing newline an editor may have added
+  while (!text.empty() && (text[text.size() - 1] == '\n' || text[text.size() - 1] == '\r'))
+    text.erase(text.size() - 1);
+
+  if (text.find('{') == text.find_first_not_of(" \t\r\n"))
+    text = ExperimentToCommand(text, 1);
+
+  if (text.empty() || static_cast<int>(text.size()) >= size)
+    return false;
+  strcpy(buf, text.c_str());
+  return true;
+}
+
+void TraceState(const unsigned long time_ms)
+{
+  Thermocycler& tc = GetThermocycler();
+  const Step* const step = tc.GetCurrentStep();
+  printf("%.1f,%s,%d,%s,%.1f,%.2f,%.2f,%d,%lu,%lu\n",
+    time_ms / 1000.0,
+    ProgramStateString(tc.GetProgramState()),
+    tc.GetProgramState() == Thermocycler::ERunning ? tc.GetCurrentCycleNum() : 0,
+    step ? const_cast<Step*>(step)->GetName() : "",
+    step ? step->GetTemp() : 0.0,
+    tc.GetPlateTemp(),
+    tc.GetLidTemp(),
+    tc.GetPeltierPwm(),
+    tc.GetTimeRemainingS(),
+    tc.GetTimeRemainingMarginS());
+}
+
+double GetWallTimeMs()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+int RunSerial(SimHardware& hardware, const double speed)
+{
+  fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+  const double wall_start_ms = GetWallTimeMs();
+  for (;;)
+  {
+    uint8_t buffer[256];
+    ssize_t n;
+    while ((n = read(STDIN_FILENO, buffer, sizeof(buffer))) > 0)
+      hardware.GetSerialToDevice().insert(hardware.GetSerialToDevice().end(), buffer, buffer + n);
+    if (n == 0)
+      return 0; //the host hung up
+
+    loop();
+
+    std::deque<uint8_t>& tx = hardware.GetSerialFromDevice();
+    while (!tx.empty())
+    {
+      size_t size = 0;
+      while (size != sizeof(buffer) && !tx.empty())
+      {
+        buffer[size++] = tx.front();
+        tx.pop_front();
+      }
+      if (write(STDOUT_FILENO, buffer, size) < 0)
+        return 0;
+    }
+
+    //sleep until the hardware changes or the host sends something
+    unsigned long next_time_ms = hardware.GetTimer1OverflowTimeMs(GetControlTicksLeft());
+    if (hardware.GetNextEventTimeMs() < next_time_ms)
+      next_time_ms = hardware.GetNextEventTimeMs();
+    if (next_time_ms < hardware.GetTimeMs() + LOOP_DURATION_MS)
+      next_time_ms = hardware.GetTimeMs() + LOOP_DURATION_MS;
+    const double wait_ms = wall_start_ms + next_time_ms / speed - GetWallTimeMs();
+    if (wait_ms > 0.0)
+    {
+      pollfd input = { STDIN_FILENO, POLLIN, 0 };
+      poll(&input, 1, static_cast<int>(wait_ms) + 1);
+    }
+
+    //catch up with the wall clock, but not beyond the next change
+    const unsigned long wall_time_ms = static_cast<unsigned long>((GetWallTimeMs() - wall_start_ms) * speed);
+    hardware.AdvanceTo(wall_time_ms < next_time_ms ? wall_time_ms : next_time_ms);
+  }
+}
+
+} //~namespace
+
+int main(int argc, char* argv[])
+{
+  char program[MAX_COMMAND_SIZE + 1];
+  strcpy(program, DEFAULT_PROGRAM);
+  unsigned long trace_interval_ms = 1000;
+  unsigned long max_time_ms = 6UL * 3600UL * 1000UL;
+  unsigned long brownout_ms = 0;
+  SimHardware::ClockMode clock_mode = SimHardware::EDiscreteEvent;
+  bool is_serial = false;
+  double speed = 1.0;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+    {
+      if (!ReadProgram(argv[++i], program, sizeof(program)))
+      {
+        fprintf(stderr, "Cannot read program file '%s'\n", argv[i]);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+      trace_interval_ms = strtoul(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+      max_time_ms = strtoul(argv[++i], NULL, 10) * 1000UL;
+    else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc && strcmp(argv[i + 1], "step") == 0)
+    {
+      clock_mode = SimHardware::EFixedStep;
+      ++i;
+    }
+    else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc && strcmp(argv[i + 1], "event") == 0)
+    {
+      clock_mode = SimHardware::EDiscreteEvent;
+      ++i;
+    }
+    else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+      brownout_ms = strtoul(argv[++i], NULL, 10) * 1000UL;
+    else if (strcmp(argv[i], "-s") == 0)
+      is_serial = true;
+    else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc && strtod(argv[i + 1], NULL) > 0.0)
+      speed = strtod(argv[++i], NULL);
+    else
+    {
+      fprintf(stderr,
+        "Usage: %s [-p program_file] [-t trace_interval_ms] [-m max_time_s] [-c event|step] [-b brownout_s]\n"
+        "       %s -s [-x speed]\n", argv[0], argv[0]);
+      return 1;
+    }
+  }
+
+  const clock_t wall_start = clock();
+  SimHardware& hardware = SimHardware::Get();
+  hardware.Reset(SimPins(), ThermalPlantParameters());
+  hardware.SetClockMode(clock_mode);
+  SetTimeSource(&SimHardware::GetSimTimeMs);
+  setup();
+
+  if (is_serial)
+    return RunSerial(hardware, speed);
+
+  SCommand command;
+  if (!SUCCEEDED(CommandParser::ParseCommand(command, program, strlen(program))))
+  {
+    fprintf(stderr, "Invalid program '%s'\n", program);
+    return 1;
+  }
+  GetThermocycler().ProcessCommand(command);
+
+  if (trace_interval_ms)
+    printf("time_s,state,cycle,step,step_temp,plate_temp,lid_temp,peltier_pwm,eta_s,eta_margin_s\n");
+
+  unsigned long next_trace_ms = 0;
+  while (hardware.GetTimeMs() < max_time_ms)
+  {
+    loop();
+    if (clock_mode == SimHardware::EDiscreteEvent)
+    {
+      //nothing changes until the hardware does or the next control period begins
+      const unsigned long next_time_ms = hardware.GetTimeMs() + LOOP_DURATION_MS;
+      unsigned long event_time_ms = hardware.GetTimer1OverflowTimeMs(GetControlTicksLeft());
+      if (hardware.GetNextEventTimeMs() < event_time_ms)
+        event_time_ms = hardware.GetNextEventTimeMs();
+      hardware.AdvanceTo(event_time_ms > next_time_ms ? event_time_ms : next_time_ms);
+    }
+    else
+      hardware.Advance(LOOP_DURATION_MS);
+
+    if (brownout_ms && hardware.GetTimeMs() >= brownout_ms)
+    {
+      //a reset loses what is in RAM, so the old Thermocycler is left as is
+      fprintf(stderr, "Brown-out at %.0f simulated seconds\n", hardware.GetTimeMs() / 1000.0);
+      MCUSR = _BV(BORF);
+      setup();
+      brownout_ms = 0;
+    }
+
+    if (trace_interval_ms && hardware.GetTimeMs() >= next_trace_ms)
+    {
+      TraceState(hardware.GetTimeMs());
+      next_trace_ms = hardware.GetTimeMs() + trace_interval_ms;
+    }
+
+    const Thermocycler& tc = GetThermocycler();
+    if (tc.GetProgramState() == Thermocycler::EComplete && !GetThermocycler().Ramping())
+      break;
+  }
+
+  const double wall_s = static_cast<double>(clock() - wall_start) / CLOCKS_PER_SEC;
+  fprintf(stderr, "%s after %.0f simulated seconds, %.2f seconds wall clock\n",
+    ProgramStateString(GetThermocycler().GetProgramState()),
+    hardware.GetTimeMs() / 1000.0,
+    wall_s);
+
+  return GetThermocycler().GetProgramState() == Thermocycler::EComplete ? 0 : 2;
+}
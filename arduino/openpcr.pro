@@ -26,11 +26,17 @@ SOURCES += \
     openpcr/serialcontrol.cpp \
     openpcr/program.cpp \
     openpcr/PID_v1.cpp \
+    openpcr/PID_fixed.cpp \
     openpcr/pid.cpp \
     openpcr/display.cpp \
     openpcr/displayparameters.cpp \
     main_fake.cpp \
     openpcr/thermocyclerparameters.cpp \
+    openpcr/timesource.cpp \
+    openpcr/controlscheduler.cpp \
+    openpcr/temperaturelog.cpp \
+    openpcr/fixedformat.cpp \
+    openpcr/etaestimator.cpp \
     ../../Arduino/libraries/EEPROM/EEPROM.cpp \
     ../../Arduino/libraries/LiquidCrystal/LiquidCrystal.cpp
 
@@ -40,12 +46,18 @@ HEADERS += \
     openpcr/serialcontrol.h \
     openpcr/program.h \
     openpcr/PID_v1.h \
+    openpcr/PID_fixed.h \
     openpcr/pid.h \
     openpcr/pcr_includes.h \
     openpcr/display.h \
     openpcr/displayparameters.h \
     openpcr/openpcr.ino \
     openpcr/thermocyclerparameters.h \
+    openpcr/timesource.h \
+    openpcr/controlscheduler.h \
+    openpcr/temperaturelog.h \
+    openpcr/fixedformat.h \
+    openpcr/etaestimator.h \
     ../../Arduino/libraries/EEPROM/EEPROM.h \
     ../../Arduino/libraries/LiquidCrystal/LiquidCrystal.h \
     openpcr/arduinoassert.h \
@@ -0,0 +1,194 @@
+/**********************************************************************************************
+ * Fixed-point variant of the Arduino PID Library - Version 1
+ * by Brett Beauregard <br3ttb@gmail.com> brettbeauregard.com
+ *
+ * This Code is licensed under a Creative Commons Attribution-ShareAlike 3.0 Unported License.
+ **********************************************************************************************/
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Weffc++"
+#pragma GCC diagnostic ignored "-Wunused-local-typedefs"
+#pragma GCC diagnostic ignored "-Wattributes"
+#include <Arduino.h>
+#include "PID_fixed.h"
+#include "timesource.h"
+#pragma GCC diagnostic pop
+
+/*Constructor (...)*********************************************************
+ *    Same parameters as PID::PID. Gains must stay below 32768 after being
+ *    scaled by the sample time, the range of Q16.16.
+ ***************************************************************************/
+FixedPID::FixedPID(
+  double * const input,
+  double * const Output,
+  double * const Setpoint,
+  const double Kp,
+  const double Ki,
+  const double Kd,
+  const int ControllerDirection
+  )
+  : m_input(input),
+    m_setpoint(Setpoint)
+{
+  inAuto = false;
+  ITerm = 0;
+  myOutput = Output;
+  FixedPID::SetOutputLimits(0, 255);
+
+  SampleTime = 100;
+
+  controllerDirection = DIRECT;
+  FixedPID::SetControllerDirection(ControllerDirection);
+  FixedPID::SetTunings(Kp, Ki, Kd);
+
+  lastTime = GetTimeMs()-SampleTime;
+}
+
+/* Compute() **********************************************************************
+ *   As PID::Compute, with the terms summed in 64 bits so that large gains on
+ *   large errors saturate at the output limits instead of wrapping around.
+ **********************************************************************************/
+void FixedPID::Compute()
+{
+   if(!inAuto) return;
+   unsigned long now = GetTimeMs();
+   int timeChange = (now - lastTime);
+   if(timeChange>=SampleTime)
+   {
+      const Fix input = ToFix(*m_input);
+      const Fix error = ToFix(*m_setpoint) - input;
+      ITerm = Clamp((int64_t)ITerm + Multiply(ki, error), outMin, outMax);
+      const Fix dInput = input - lastInput;
+
+      const int64_t output = Multiply(kp, error) + ITerm - Multiply(kd, dInput);
+      *myOutput = ToDouble(Clamp(output, outMin, outMax));
+
+      lastInput = input;
+      lastTime = now;
+   }
+}
+
+/* SetTunings(...)*************************************************************
+ * The only place besides SetSampleTime where floating point math is done on
+ * the gains; both are called when a step starts, not every sample.
+ ******************************************************************************/
+void FixedPID::SetTunings(double Kp, double Ki, double Kd)
+{
+   if (Kp<0 || Ki<0 || Kd<0) return;
+
+   dispKp = Kp; dispKi = Ki; dispKd = Kd;
+
+   double SampleTimeInSec = ((double)SampleTime)/1000;
+   kp = ToFix(Kp);
+   ki = ToFix(Ki * SampleTimeInSec);
+   kd = ToFix(Kd / SampleTimeInSec);
+
+  if(controllerDirection ==REVERSE)
+   {
+      kp = (0 - kp);
+      ki = (0 - ki);
+      kd = (0 - kd);
+   }
+}
+
+/* SetSampleTime(...) *********************************************************
+ * sets the period, in Milliseconds, at which the calculation is performed
+ ******************************************************************************/
+void FixedPID::SetSampleTime(int NewSampleTime)
+{
+   if (NewSampleTime > 0)
+   {
+      SampleTime = NewSampleTime;
+      FixedPID::SetTunings(dispKp, dispKi, dispKd);
+   }
+}
+
+/* SetOutputLimits(...)****************************************************
+ *     clamps the output and the integral term to [Min, Max]
+ **************************************************************************/
+void FixedPID::SetOutputLimits(double Min, double Max)
+{
+   if(Min >= Max) return;
+   outMin = ToFix(Min);
+   outMax = ToFix(Max);
+
+   if(inAuto)
+   {
+           if(*myOutput > Max) *myOutput = Max;
+           else if(*myOutput < Min) *myOutput = Min;
+
+           ITerm = Clamp(ITerm, outMin, outMax);
+   }
+}
+
+/* SetMode(...)****************************************************************
+ * Allows the controller Mode to be set to manual (0) or Automatic (non-zero)
+ * when the transition from manual to auto occurs, the controller is
+ * automatically initialized
+ ******************************************************************************/
+void FixedPID::SetMode(int Mode)
+{
+    bool newAuto = (Mode == AUTOMATIC);
+    if(newAuto == !inAuto)
+    {  /*we just went from manual to auto*/
+        FixedPID::Initialize();
+    }
+    inAuto = newAuto;
+}
+
+/* Initialize()****************************************************************
+ *        does all the things that need to happen to ensure a bumpless transfer
+ *  from manual to automatic mode.
+ ******************************************************************************/
+void FixedPID::Initialize()
+{
+   ITerm = Clamp(ToFix(*myOutput), outMin, outMax);
+   lastInput = ToFix(*m_input);
+   lastTime = GetTimeMs() -SampleTime;
+}
+
+/* SetControllerDirection(...)*************************************************
+ * DIRECT or REVERSE, as PID::SetControllerDirection
+ ******************************************************************************/
+void FixedPID::SetControllerDirection(int Direction)
+{
+   if(inAuto && Direction !=controllerDirection)
+   {
+      kp = (0 - kp);
+      ki = (0 - ki);
+      kd = (0 - kd);
+   }
+   controllerDirection = Direction;
+}
+
+/* Fixed point helpers *********************************************************
+ * Conversions round to nearest and saturate at the Q16.16 range.
+ ******************************************************************************/
+FixedPID::Fix FixedPID::ToFix(const double value)
+{
+   const double scaled = value * 65536.0;
+   if (scaled >= 2147483647.0) return 0x7FFFFFFFL;
+   if (scaled <= -2147483648.0) return -0x7FFFFFFFL - 1;
+   return (Fix)(scaled >= 0 ? scaled + 0.5 : scaled - 0.5);
+}
+
+FixedPID::Fix FixedPID::Clamp(const int64_t value, const Fix min, const Fix max)
+{
+   if (value > max) return max;
+   if (value < min) return min;
+   return (Fix)value;
+}
+
+int64_t FixedPID::Multiply(const Fix a, const Fix b)
+{
+   return ((int64_t)a * b) >> 16;
+}
+
+/* Status Funcions*************************************************************
+ * the tunings as the user entered them, for display purposes
+ ******************************************************************************/
+double FixedPID::GetKp() const { return  dispKp; }
+double FixedPID::GetKi() const { return  dispKi;}
+double FixedPID::GetKd() const { return  dispKd;}
+int FixedPID::GetMode() const { return  inAuto ? AUTOMATIC : MANUAL;}
+int FixedPID::GetDirection() const { return controllerDirection;}
+
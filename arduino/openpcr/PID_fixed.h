@@ -0,0 +1,74 @@
+#ifndef PID_fixed_h
+#define PID_fixed_h
+
+#include <stdint.h>
+
+#include "PID_v1.h" //for AUTOMATIC, MANUAL, DIRECT and REVERSE
+
+//Drop-in replacement for PID from PID_v1 that keeps its state and gains
+//in Q16.16 fixed point, so Compute costs a handful of integer multiplies
+//instead of soft-float arithmetic. Input, output and setpoint stay doubles
+//and are converted once per computation. Select it for the plate loop by
+//defining FIXED_POINT_PID in pcr_includes.h or on the compiler command line;
+//the plate loop uses PID_v1 otherwise.
+struct FixedPID
+{
+  typedef int32_t Fix; //Q16.16
+
+  FixedPID(
+    double * const input,
+    double * const Output,
+    double * const Setpoint,
+    const double Kp,
+    const double Ki,
+    const double Kd,
+    const int ControllerDirection);
+
+  void SetMode(int Mode);
+  void Compute();
+  void SetOutputLimits(double, double);
+  void ResetI() { ITerm = 0; }
+  double GetI() const { return ToDouble(ITerm); }
+
+  void SetTunings(double, double, double);
+  void SetControllerDirection(int);
+  void SetSampleTime(int);
+
+  double GetKp() const;
+  double GetKi() const;
+  double GetKd() const;
+  int GetMode() const;
+  int GetDirection() const;
+
+  static Fix ToFix(const double value);
+  static double ToDouble(const Fix value) { return value / 65536.0; }
+
+  private:
+  void Initialize();
+  static Fix Clamp(const int64_t value, const Fix min, const Fix max);
+  static int64_t Multiply(const Fix a, const Fix b);
+
+  double dispKp; //tuning parameters in user-entered format
+  double dispKi;
+  double dispKd;
+
+  Fix kp; //gains, with the sample time and direction applied
+  Fix ki;
+  Fix kd;
+
+  int controllerDirection;
+
+  double * const m_input;
+  double * myOutput;
+  double * const m_setpoint;
+
+  unsigned long lastTime;
+  Fix ITerm;
+  Fix lastInput;
+
+  int SampleTime;
+  Fix outMin, outMax;
+  bool inAuto;
+};
+#endif
+
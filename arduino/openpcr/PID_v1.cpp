@@ -11,6 +11,7 @@
 #pragma GCC diagnostic ignored "-Wattributes"
 #include <Arduino.h>
 #include "PID_v1.h"
+#include "timesource.h"
 #pragma GCC diagnostic pop
 
 /*Constructor (...)*********************************************************
@@ -29,6 +30,8 @@ PID::PID(
   : m_input(input),
     m_setpoint(Setpoint)
 {
+  inAuto = false; //read by SetOutputLimits and SetControllerDirection
+  myOutput = Output;
   PID::SetOutputLimits(0, 255); //default output limit corresponds to
                                 //the arduino pwm limits
 
@@ -37,9 +40,7 @@ PID::PID(
   PID::SetControllerDirection(ControllerDirection);
   PID::SetTunings(Kp, Ki, Kd);
 
-  lastTime = millis()-SampleTime;
-  inAuto = false;
-  myOutput = Output;
+  lastTime = GetTimeMs()-SampleTime;
 }
  
  
@@ -51,7 +52,7 @@ PID::PID(
 void PID::Compute()
 {
    if(!inAuto) return;
-   unsigned long now = millis();
+   unsigned long now = GetTimeMs();
    int timeChange = (now - lastTime);
    if(timeChange>=SampleTime)
    {
@@ -168,7 +169,7 @@ void PID::Initialize()
 {
    ITerm = *myOutput;
    lastInput = *m_input;
-   lastTime = millis() -SampleTime;
+   lastTime = GetTimeMs() -SampleTime;
    if(ITerm > outMax) ITerm = outMax;
    else if(ITerm < outMin) ITerm = outMin;
 }
@@ -0,0 +1,51 @@
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wattributes"
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#pragma GCC diagnostic pop
+
+#include "controlscheduler.h"
+
+static volatile unsigned int sTicksPerPeriod = 0;
+static volatile unsigned int sTicksLeft = 0;
+static volatile bool sIsControlDue = false;
+
+ISR(TIMER1_OVF_vect)
+{
+  if (--sTicksLeft == 0) {
+    sTicksLeft = sTicksPerPeriod;
+    sIsControlDue = true;
+  }
+}
+
+void StartControlScheduler(const unsigned int periodMs)
+{
+  //round up, so a period never ends before periodMs have passed
+  unsigned int ticks = ((unsigned long)periodMs * 1000 + TIMER1_OVERFLOW_US - 1) / TIMER1_OVERFLOW_US;
+  if (ticks == 0)
+    ticks = 1;
+
+  cli();
+  sTicksPerPeriod = ticks;
+  sTicksLeft = ticks;
+  sIsControlDue = false;
+  TIMSK1 |= _BV(TOIE1);
+  sei();
+}
+
+bool IsControlDue()
+{
+  //a single byte, so reading and clearing needs no critical section
+  if (!sIsControlDue)
+    return false;
+  sIsControlDue = false;
+  return true;
+}
+
+unsigned int GetControlTicksLeft()
+{
+  cli();
+  const unsigned int ticksLeft = sTicksLeft;
+  sei();
+  return ticksLeft;
+}
@@ -0,0 +1,22 @@
+#ifndef CONTROLSCHEDULER_H
+#define CONTROLSCHEDULER_H
+
+//Fixed-rate scheduling of the lid and plate control loops. Timer1, set up
+//by the Thermocycler for the Peltier PWM (phase correct 10-bit, clk/8),
+//overflows once per PWM period; its interrupt counts down the control
+//period and flags the main loop when the next one is due. The control
+//work itself runs in the main loop, as it needs SPI and the PID code.
+
+//Timer1 overflow period at 16 MHz: 2 * 1023 counts of 0.5 us
+#define TIMER1_OVERFLOW_US 1023
+
+//Enable the Timer1 overflow interrupt, flagging a period every periodMs
+void StartControlScheduler(const unsigned int periodMs);
+
+//True once per period, the first time it is called after the period began
+bool IsControlDue();
+
+//Timer1 overflows until the next period begins, for the simulator
+unsigned int GetControlTicksLeft();
+
+#endif // CONTROLSCHEDULER_H
@@ -19,10 +19,12 @@
 #include "arduinoassert.h"
 #include "arduinotrace.h"
 #include "display.h"
+#include "fixedformat.h"
 #include "pcr_includes.h"
 #include "program.h"
 #include "thermistors.h"
 #include "thermocycler.h"
+#include "timesource.h"
 
 const int RESET_INTERVAL = 30000; //ms
 
@@ -42,7 +44,7 @@ Display::Display(
       parameters.m_pin_d7
     ),
     m_parameters(parameters),
-    m_prev_reset(millis()),
+    m_prev_reset(GetTimeMs()),
     m_prev_state(Thermocycler::EStartup)
 {
   Trace("Display::Display");
@@ -103,13 +105,13 @@ void Display::Update()
   Assert(state == m_prev_state);
 
   // check for reset
-  if (millis() - m_prev_reset > RESET_INTERVAL)
+  if (GetTimeMs() - m_prev_reset > RESET_INTERVAL)
   {
     m_lcd.begin(
       m_parameters.m_lcd_ncols,
       m_parameters.m_lcd_nrows
     );
-    m_prev_reset = millis();
+    m_prev_reset = GetTimeMs();
   }
   
 }
@@ -125,19 +127,18 @@ void Display::ShowAll(
   const int sz = m_parameters.m_lcd_ncols + 1; //+1 for null terminator
   Assert(sz > 16);
   char * const text = new char[sz];
-  text[ 0] = '0' + (current_temperature / 10);
-  text[ 1] = '0' + (current_temperature % 10);
+  //each field is written before the character that ends it, which
+  //overwrites the NUL FormatFixed puts behind the digits
+  FormatFixed(text, current_temperature, 0, 2);
   text[ 2] = 'o';
   text[ 3] = 'C';
   text[ 4] = is_heating ? '^' : 'v';
   text[ 5] = ' ';
-  text[ 6] = '0' + (current_step / 10);
-  text[ 7] = '0' + (current_step % 10);
+  FormatFixed(text + 6, current_step, 0, 2);
   text[ 8] = '/';
-  text[ 9] = '0' + (number_of_steps / 10);
-  text[10] = '0' + (number_of_steps % 10);
+  FormatFixed(text + 9, number_of_steps, 0, 2);
   text[11] = ' ';
-  text[12] = '0' + (minutes_left / 60);
+  FormatFixed(text + 12, minutes_left / 60, 0, 1);
   text[13] = ':';
   text[14] = '0' + ((minutes_left % 60) / 10);
   text[15] = '0' + ((minutes_left % 60) % 10);
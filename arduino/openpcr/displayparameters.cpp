@@ -26,7 +26,7 @@ DisplayParameters::DisplayParameters(
     m_pin_d7(pin_d7),
     m_pin_v0(pin_v0)
 {
-  Trace("Display::Display")
+  Trace("Display::Display");
   Assert(m_lcd_ncols > 0 && "An LCD display has at least one column");
   Assert(m_lcd_ncols >= 16 && "The LCD display used needs at least 16 columns");
   Assert(m_lcd_nrows > 0 && "An LCD display has at least one row");
@@ -37,7 +37,7 @@ DisplayParameters::DisplayParameters(
   Assert(m_pin_d6 >= 0 && "Pin D6 has at least an index of zero");
   Assert(m_pin_d7 >= 0 && "Pin D7 has at least an index of zero");
   Assert(m_pin_v0 >= 0 && "Pin V0 has at least an index of zero");
-  Trace("End of Display::Display")
+  Trace("End of Display::Display");
 }
 
 bool operator==(const DisplayParameters& lhs, const DisplayParameters& rhs)
@@ -0,0 +1,151 @@
+#include "pcr_includes.h"
+#include "etaestimator.h"
+
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+EtaEstimator::EtaEstimator()
+  : m_save_offset(sizeof(Record))
+{
+  Clear();
+}
+
+void EtaEstimator::Clear()
+{
+  if (m_save_offset < sizeof(Record))
+    m_save_offset = 0;
+  for (int i = 0; i < 2; i++) {
+    for (int j = 0; j < ETA_BANDS; j++) {
+      m_rates[i][j].sPerC = 0;
+      m_rates[i][j].variance = 0;
+      m_rates[i][j].weightDeciC = 0;
+    }
+  }
+}
+
+bool EtaEstimator::Load()
+{
+#ifdef PERSIST_ETA_MODEL
+  Record record;
+  eeprom_read_block(&record, (const void*)(uintptr_t)EEPROM_ETA_MODEL_ADDR, sizeof(record));
+  if (record.version != ETA_MODEL_VERSION || record.crc != CalcCrc(record))
+    return false;
+  for (int i = 0; i < 2; i++) {
+    for (int j = 0; j < ETA_BANDS; j++) {
+      const Rate& rate = record.rates[i][j];
+      if (!(rate.sPerC >= 0 && rate.sPerC < 1000 && rate.variance >= 0 && rate.variance < 1000) || rate.weightDeciC > ETA_MAX_WEIGHT_C * 10)
+        return false;
+    }
+  }
+  memcpy(m_rates, record.rates, sizeof(m_rates));
+  return true;
+#else
+  return false;
+#endif
+}
+
+void EtaEstimator::Save()
+{
+#ifdef PERSIST_ETA_MODEL
+  m_save_offset = 0;
+#endif
+}
+
+void EtaEstimator::Task()
+{
+  if (m_save_offset >= sizeof(Record) || !eeprom_is_ready())
+    return;
+
+  Record record;
+  record.version = ETA_MODEL_VERSION;
+  memcpy(record.rates, m_rates, sizeof(m_rates));
+  record.crc = CalcCrc(record);
+  //only a byte that changed is written
+  eeprom_update_byte((uint8_t*)(uintptr_t)EEPROM_ETA_MODEL_ADDR + m_save_offset, ((const uint8_t*)&record)[m_save_offset]);
+  m_save_offset++;
+}
+
+void EtaEstimator::AddRamp(const double fromTemp, const double toTemp, const unsigned long durationMs)
+{
+  const double degrees = fabs(toTemp - fromTemp);
+  if (degrees < 1)
+    return; //mostly settling, says little about the rate
+  const double sPerC = durationMs / 1000.0 / degrees;
+  const double low = fromTemp < toTemp ? fromTemp : toTemp;
+  const double high = fromTemp < toTemp ? toTemp : fromTemp;
+  if (m_save_offset < sizeof(Record))
+    m_save_offset = 0;
+
+  for (int band = 0; band < ETA_BANDS; band++) {
+    const double weight = GetBandOverlap(band, low, high);
+    if (weight <= 0)
+      continue;
+
+    //weighted mean and variance, updated in place
+    Rate& rate = m_rates[toTemp > fromTemp][band];
+    const double oldWeight = rate.weightDeciC / 10.0;
+    const double newWeight = oldWeight + weight;
+    const double delta = sPerC - rate.sPerC;
+    rate.sPerC += delta * weight / newWeight;
+    rate.variance = (rate.variance * oldWeight + weight * delta * (sPerC - rate.sPerC)) / newWeight;
+    rate.weightDeciC = (uint16_t)((newWeight < ETA_MAX_WEIGHT_C ? newWeight : ETA_MAX_WEIGHT_C) * 10 + 0.5);
+  }
+}
+
+void EtaEstimator::PredictRamp(const double fromTemp, const double toTemp, double& seconds, double& sdSeconds) const
+{
+  const double low = fromTemp < toTemp ? fromTemp : toTemp;
+  const double high = fromTemp < toTemp ? toTemp : fromTemp;
+  seconds = 0;
+  sdSeconds = 0;
+
+  for (int band = 0; band < ETA_BANDS; band++) {
+    const double degrees = GetBandOverlap(band, low, high);
+    if (degrees <= 0)
+      continue;
+
+    const Rate* pRate = GetRate(toTemp > fromTemp, band);
+    double sPerC = ETA_PRIOR_S_PER_C;
+    double variance = ETA_PRIOR_SD_S_PER_C * ETA_PRIOR_SD_S_PER_C;
+    if (pRate != NULL) {
+      sPerC = pRate->sPerC;
+      //a band with few ramps has not shown its spread yet
+      if (pRate == &m_rates[toTemp > fromTemp][band]) {
+        const double weight = pRate->weightDeciC / 10.0;
+        variance = (pRate->variance * weight + variance * ETA_PRIOR_WEIGHT_C) / (weight + ETA_PRIOR_WEIGHT_C);
+      }
+    }
+    seconds += degrees * sPerC;
+    //bands of one ramp are off the same way, so their spreads add up
+    sdSeconds += degrees * sqrt(variance);
+  }
+}
+
+double EtaEstimator::GetBandOverlap(const int band, const double low, const double high)
+{
+  const double bandLow = ETA_FIRST_BAND_END + (band - 1) * ETA_BAND_WIDTH;
+  const double bandHigh = ETA_FIRST_BAND_END + band * ETA_BAND_WIDTH;
+  const double overlapLow = band == 0 || low > bandLow ? low : bandLow;
+  const double overlapHigh = band == ETA_BANDS - 1 || high < bandHigh ? high : bandHigh;
+  return overlapHigh - overlapLow;
+}
+
+const EtaEstimator::Rate* EtaEstimator::GetRate(const bool heating, const int band) const
+{
+  for (int distance = 0; distance < ETA_BANDS; distance++) {
+    if (band - distance >= 0 && m_rates[heating][band - distance].weightDeciC > 0)
+      return &m_rates[heating][band - distance];
+    if (band + distance < ETA_BANDS && m_rates[heating][band + distance].weightDeciC > 0)
+      return &m_rates[heating][band + distance];
+  }
+  return NULL;
+}
+
+uint8_t EtaEstimator::CalcCrc(const Record& record)
+{
+  uint8_t crc = 0;
+  const uint8_t* p = (const uint8_t*)&record;
+  for (const uint8_t* pEnd = &record.crc; p < pEnd; p++)
+    crc = _crc_ibutton_update(crc, *p);
+  return crc;
+}
@@ -0,0 +1,68 @@
+#ifndef ETAESTIMATOR_H
+#define ETAESTIMATOR_H
+
+#include <stdint.h>
+
+//How long fast ramps take, learned from the ramps the plate makes. The
+//Peltier heats faster than it cools and both slow down away from room
+//temperature, so the model keeps the seconds per degree of heating and of
+//cooling in each band of ETA_BAND_WIDTH degrees, with how much the ramps
+//seen in it varied. A ramp that crosses bands counts in each for the
+//degrees it spent there. Ramps are weighted by their degrees, up to
+//ETA_MAX_WEIGHT_C per band, so the model keeps following the unit.
+//
+//With PERSIST_ETA_MODEL the model is saved to EEPROM at
+//EEPROM_ETA_MODEL_ADDR when a run completes and loaded at startup.
+
+#define ETA_BANDS              4
+#define ETA_FIRST_BAND_END     40 //bands: below 40, 40-60, 60-80 and from 80
+#define ETA_BAND_WIDTH         20
+#define ETA_MAX_WEIGHT_C       200
+#define ETA_PRIOR_S_PER_C      1.0 //for a direction no ramp was seen in yet
+#define ETA_PRIOR_SD_S_PER_C   0.5
+#define ETA_PRIOR_WEIGHT_C     10  //how much the prior spread counts against the spread seen
+#define ETA_MODEL_VERSION      1
+
+class EtaEstimator {
+public:
+  EtaEstimator();
+
+  //Forget all ramps
+  void Clear();
+  //The model Save stored, if there is a valid one; false if not
+  bool Load();
+  //Store the model, a byte per call of Task; one that changes before it
+  //is complete is stored from the start again
+  void Save();
+  //Write the next byte of the model if the EEPROM is ready; call on
+  //every pass of the main loop
+  void Task();
+
+  //Learn from a fast ramp that took durationMs
+  void AddRamp(const double fromTemp, const double toTemp, const unsigned long durationMs);
+  //Expected seconds of a fast ramp, and their standard deviation
+  void PredictRamp(const double fromTemp, const double toTemp, double& seconds, double& sdSeconds) const;
+
+private:
+  struct Rate {
+    float sPerC;      //weighted mean
+    float variance;   //of sPerC, weighted
+    uint16_t weightDeciC; //degrees of ramp behind it, in 0.1 C; 0 for none
+  };
+  struct Record {
+    uint8_t version;
+    Rate rates[2][ETA_BANDS];
+    uint8_t crc;
+  };
+
+  //degrees of the range low to high that lie in band
+  static double GetBandOverlap(const int band, const double low, const double high);
+  //the rate of band, or of the nearest band in the same direction that has one
+  const Rate* GetRate(const bool heating, const int band) const;
+  static uint8_t CalcCrc(const Record& record);
+
+  Rate m_rates[2][ETA_BANDS]; //cooling, heating
+  uint8_t m_save_offset; //of the next byte of the Record Save stores, sizeof(Record) once stored
+};
+
+#endif // ETAESTIMATOR_H
@@ -0,0 +1,32 @@
+#include "fixedformat.h"
+
+int16_t ToDeciC(const double temp)
+{
+  return (int16_t)(temp >= 0 ? temp * 10 + 0.5 : temp * 10 - 0.5);
+}
+
+char* FormatFixed(char* str, const long val, const uint8_t decimalDigits, const uint8_t intWidth)
+{
+  //digits come out least significant first; a long has at most 10
+  char digits[10 + 1];
+  unsigned long magnitude = val < 0 ? 0UL - (unsigned long)val : (unsigned long)val;
+  uint8_t count = 0;
+  do {
+    digits[count++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude > 0 || count <= decimalDigits); //at least one digit before the point
+
+  for (uint8_t width = count - decimalDigits + (val < 0); width < intWidth; width++)
+    *str++ = ' ';
+  if (val < 0)
+    *str++ = '-';
+  while (count > decimalDigits)
+    *str++ = digits[--count];
+  if (decimalDigits > 0) {
+    *str++ = '.';
+    while (count > 0)
+      *str++ = digits[--count];
+  }
+  *str = '\0';
+  return str;
+}
@@ -0,0 +1,19 @@
+#ifndef FIXEDFORMAT_H
+#define FIXEDFORMAT_H
+
+#include <stdint.h>
+
+//Text for fixed-point numbers, in integer arithmetic only: the status
+//packet and the display show temperatures without pulling in pow() or
+//the printf family.
+
+//Tenths of a degree, rounded half away from zero
+int16_t ToDeciC(const double temp);
+
+//Writes val / 10^decimalDigits, e.g. 953 with one decimal digit as
+//"95.3", with the part before the point, sign included, right-aligned
+//in intWidth characters. At most 9 decimal digits. Writes a terminating
+//NUL and returns a pointer to it.
+char* FormatFixed(char* str, const long val, const uint8_t decimalDigits, const uint8_t intWidth = 0);
+
+#endif // FIXEDFORMAT_H
@@ -24,6 +24,7 @@
 //#include "signal.h"
 #include "displayparameters.h"
 #include "pcr_includes.h"
+#include "serialcontrol.h"
 #include "thermocycler.h"
 
 Thermocycler* gpThermocycler = NULL;
@@ -40,7 +41,7 @@ bool InitialStart()
 
 void setup()
 {
-  Serial.begin(9600);
+  Serial.begin(BAUD_RATE);
   Trace("START");
 
   //restart detection
@@ -20,6 +20,8 @@
 #define _PCR_INCLUDES_H_
 
 //#define DEBUG_DISPLAY
+//#define FIXED_POINT_PID //plate loop in Q16.16 instead of double, see PID_fixed.h
+#define PERSIST_ETA_MODEL //keep the learned ramp rates in EEPROM across runs, see etaestimator.h
 #define OPENPCR_FIRMWARE_VERSION_STRING "1.0.5"
 #define PLATE_FAST_RAMP_THRESHOLD_MS 1000
 
@@ -40,19 +42,53 @@ inline Thermocycler& GetThermocycler() { return *gpThermocycler; }
 
 //defines
 #define STEP_NAME_LENGTH       14
-#define MAX_CYCLE_ITEMS        16
+
+//Program capacity: cycles in a program, the program itself included,
+//steps in all cycles, and steps in one cycle. Every cycle and step is
+//allocated up front, so these are set per board and can be overridden
+//with -D.
+#if defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+#define DEFAULT_MAX_CYCLES      8
+#define DEFAULT_MAX_STEPS      64
+#define DEFAULT_MAX_CYCLE_ITEMS 32
+#else
+#define DEFAULT_MAX_CYCLES      4
+#define DEFAULT_MAX_STEPS      20
+#define DEFAULT_MAX_CYCLE_ITEMS 16
+#endif
+#ifndef MAX_CYCLES
+#define MAX_CYCLES             DEFAULT_MAX_CYCLES
+#endif
+#ifndef MAX_STEPS
+#define MAX_STEPS              DEFAULT_MAX_STEPS
+#endif
+#ifndef MAX_CYCLE_ITEMS
+#define MAX_CYCLE_ITEMS        DEFAULT_MAX_CYCLE_ITEMS
+#endif
+
 #define MAX_COMMAND_SIZE      256
+#define MAX_LID_TEMP          200 //where the lid gain schedule ends
+
+//EEPROM layout; byte 0 holds the display contrast
+#define EEPROM_PROGRAM_ADDR     1   //ProgramStore's program record,
+#define EEPROM_PROGRAM_SIZE     487 //at most this many bytes
+#define EEPROM_PROGRESS_ADDR    488 //and its ring of progress records
+#define EEPROM_PROGRESS_SLOTS   30
+#define EEPROM_PROGRESS_SLOT_SIZE 13
+#define EEPROM_ETA_MODEL_ADDR   896 //the last 128 bytes of a 1 KB EEPROM
 
 enum PcrStatus {
   ESuccess = 0,
   ETooManySteps = 32,
   ENoProgram,
-  ENoPower
+  ENoPower,
+  EInvalidCommand,
+  ETooManyCycles,    //more than MAX_CYCLES
+  ETooManyCycleItems //more than MAX_CYCLE_ITEMS steps in a cycle
 };
 
 #define SUCCEEDED(status) (status == ESuccess)
 
-void sprintFloat(char* str, float val, int decimalDigits, boolean pad);
 unsigned short htons(unsigned short val);
 
 //Obtain the absolute value of a double
@@ -20,221 +20,691 @@
 #include "pcr_includes.h"
 #include "program.h"
 
-//#include <EEPROM.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
 
 #include "display.h"
+#include "fixedformat.h"
 
 // Class Step
-void Step::SetName(const char* szName) {
-  strncpy(iName, szName, sizeof(iName));
-  iName[sizeof(iName) - 1] = '\0';
+void Step::SetName(const char* szName, int length) {
+  if (length > (int)sizeof(iName) - 1)
+    length = sizeof(iName) - 1;
+  //a NUL ends the name early, as with the default length
+  const char* const pNul = (const char*)memchr(szName, '\0', length);
+  if (pNul != NULL)
+    length = pNul - szName;
+  memcpy(iName, szName, length);
+  iName[length] = '\0';
 }
 
 void Step::Reset() {
-  iStepReturned = false;
   iStepDurationS = 0;
   iRampDurationS = 0;
   iTemp = 0;
   iName[0] = '\0'; 
 }
 
-void Step::BeginIteration() {
-  iStepReturned = false;
-}
-
-Step* Step::GetNextStep() {
-  if (iStepReturned) {
-    return NULL;
-  } else {
-    iStepReturned = true;
-    return this;
-  }
-}
-
 ////////////////////////////////////////////////////////////////////
 // Class Cycle
 ProgramComponent* Cycle::GetComponent(int index) {
   return iComponents[index];
 }
 
+int Cycle::sMaxNumComponents = 0;
+
 PcrStatus Cycle::AddComponent(ProgramComponent* pComponent) {
   if (iNumComponents >= MAX_CYCLE_ITEMS)
-    return ETooManySteps;
+    return ETooManyCycleItems;
   
   iComponents[iNumComponents++] = pComponent;
+  if (iNumComponents > sMaxNumComponents)
+    sMaxNumComponents = iNumComponents;
   return ESuccess;
 }
 
 void Cycle::Reset() {
   iNumComponents = 0;
   iNumCycles = 0;
-  iCurrentCycle = 0;
-  iCurrentComponent = 0;
 }
 
-// iteration
-void Cycle::BeginIteration() {
-  iCurrentCycle = 0;
-  RestartCycle();
+////////////////////////////////////////////////////////////////////
+// Class StepSchedule
+void StepSchedule::Clear() {
+  m_num_steps = 0;
+  m_num_loops = 0;
+  m_display_loop = 0;
+  Begin();
+}
+
+PcrStatus StepSchedule::Compile(Cycle* pProgram) {
+  Clear();
+  for (int i = 0; i < pProgram->GetNumComponents(); i++) {
+    if (m_num_loops == MAX_CYCLES)
+      return ETooManyCycles;
+    ScheduleLoop& loop = m_loops[m_num_loops];
+    loop.firstStep = m_num_steps;
+
+    ProgramComponent* pComponent = pProgram->GetComponent(i);
+    if (pComponent->GetType() == ProgramComponent::EStep) {
+      if (m_num_steps == MAX_STEPS)
+        return ETooManySteps;
+      m_steps[m_num_steps++] = (Step*)pComponent;
+      loop.numCycles = 1;
+    } else {
+      Cycle* pCycle = (Cycle*)pComponent;
+      for (int j = 0; j < pCycle->GetNumComponents(); j++) {
+        if (pCycle->GetComponent(j)->GetType() != ProgramComponent::EStep)
+          return EInvalidCommand; //cycles do not nest
+        if (m_num_steps == MAX_STEPS)
+          return ETooManySteps;
+        m_steps[m_num_steps++] = (Step*)pCycle->GetComponent(j);
+      }
+      loop.numCycles = pCycle->GetNumCycles();
+    }
+    loop.numSteps = m_num_steps - loop.firstStep;
+
+    //the first loop with the most cycles; empty ones are dropped
+    if (loop.numSteps > 0 && loop.numCycles > 0) {
+      if (loop.numCycles > m_loops[m_display_loop].numCycles || m_num_loops == 0)
+        m_display_loop = m_num_loops;
+      m_num_loops++;
+    }
+  }
+  return m_num_loops > 0 ? ESuccess : ENoProgram;
 }
 
-Step* Cycle::GetNextStep() {
-  //check for next step of existing component
-  Step* pNextStep = iComponents[iCurrentComponent]->GetNextStep();
-  
-  //advance to next component if current component done
-  if (pNextStep == NULL && ++iCurrentComponent < iNumComponents)
-    pNextStep = iComponents[iCurrentComponent]->GetNextStep(); //should never be NULL
-  
-  //advance to next cycle if current cycle done
-  if (pNextStep == NULL && ++iCurrentCycle < iNumCycles) {
-    RestartCycle();
-  
-    //return first component of that cycle
-    pNextStep = iComponents[iCurrentComponent]->GetNextStep(); //should never be NULL
+void StepSchedule::Begin() {
+  m_loop = 0;
+  m_cycle = 0;
+  m_step = -1;
+}
+
+Step* StepSchedule::Seek(int step, int cycle) {
+  for (int i = 0; i < m_num_loops; i++) {
+    const ScheduleLoop& loop = m_loops[i];
+    if (step >= loop.firstStep && step < loop.firstStep + loop.numSteps) {
+      if (cycle < 0 || cycle >= loop.numCycles)
+        return NULL;
+      m_loop = i;
+      m_cycle = cycle;
+      m_step = step;
+      return m_steps[step];
+    }
   }
-      
-  return pNextStep;
+  return NULL;
 }
 
-void Cycle::RestartCycle() {
-  iCurrentComponent = 0;
-  
-  for (int i = 0; i < iNumComponents; i++)
-    iComponents[i]->BeginIteration();
+Step* StepSchedule::Advance() {
+  if (m_loop == m_num_loops)
+    return NULL;
+
+  const ScheduleLoop& loop = m_loops[m_loop];
+  if (m_step >= 0 && m_step + 1 < loop.firstStep + loop.numSteps) {
+    m_step++;
+  } else if (m_step < 0) {
+    m_step = loop.firstStep;
+  } else if (++m_cycle < loop.numCycles) {
+    m_step = loop.firstStep;
+  } else if (++m_loop < m_num_loops) {
+    m_cycle = 0;
+    m_step = m_loops[m_loop].firstStep;
+  } else {
+    return NULL;
+  }
+  return m_steps[m_step];
 }
 
-void CommandParser::ParseCommand(SCommand& command, char* pCommandBuf)
+//A command is key=value parameters separated by '&', e.g.
+//  s=ACGTC&c=start&d=7&l=110&n=Test&p=(1[300|95|Denature|0])(35[30|95|Melt|0][30|55|Anneal|0])
+//Every scan below is bounded by the end of the command or of the
+//parameter it is in, and the buffer is not written to.
+PcrStatus CommandParser::ParseCommand(SCommand& command, const char* pCommand, const int length)
 {
   Trace("CommandParser::ParseCommand");
-  char* pValue;
-  memset(&command, NULL, sizeof(command));
-  //char buf[32];
+
+  //the whole command is checked before the running program is touched;
+  //the new program is only built once it is known to fit
+  ProgramSize size = { 0, 0 };
+  PcrStatus status = ParseParams(command, pCommand, length, &size);
+  if (!SUCCEEDED(status))
+    return status;
+  if (command.command == SCommand::EStart && size.numCycles == 0)
+    return ENoProgram;
+  if (command.command != SCommand::EStart)
+    return ESuccess;
 
   gpThermocycler->Stop(); //need to stop here to reset program pools
-    
-  char* pParam = strtok(pCommandBuf, "&");
-  while (pParam) {  
-    pValue = strchr(pParam, '=');
-    *pValue++ = '\0';
-    AddComponent(&command, pParam[0], pValue);
-    pParam = strtok(NULL, "&");
+  ProgramStore::Clear(); //and a run stopped by a command does not resume
+  return ParseParams(command, pCommand, length, NULL);
+}
+
+PcrStatus CommandParser::ParseParams(SCommand& command, const char* pCommand, const int length, ProgramSize* pSize)
+{
+  memset(&command, 0, sizeof(command));
+
+  //a NUL ends the command early
+  const char* const pNul = (const char*)memchr(pCommand, '\0', length);
+  const char* const pEnd = pNul != NULL ? pNul : pCommand + length;
+
+  //the parameters after a bad one are still parsed, so a rejected
+  //command keeps its id; the first error is the one returned
+  PcrStatus result = ESuccess;
+  const char* pParam = pCommand;
+  while (pParam < pEnd) {
+    const char* pParamEnd = (const char*)memchr(pParam, '&', pEnd - pParam);
+    if (pParamEnd == NULL)
+      pParamEnd = pEnd;
+
+    //empty parameters, as in a trailing '&', are skipped
+    if (pParamEnd > pParam) {
+      PcrStatus status = EInvalidCommand;
+      if (pParamEnd - pParam >= 2 && pParam[1] == '=')
+        status = AddComponent(command, pParam[0], pParam + 2, pParamEnd, pSize);
+      if (SUCCEEDED(result))
+        result = status;
+    }
+    pParam = pParamEnd + 1;
   }
+  return result;
 }
 
-void CommandParser::AddComponent(SCommand* pCommand, char key, char* szValue) {
+PcrStatus CommandParser::AddComponent(SCommand& command, char key, const char* pValue, const char* pEnd, ProgramSize* pSize) {
+  unsigned long value;
+  const int length = pEnd - pValue;
+
   switch(key) {
-  case 'n':
-    strncpy(pCommand->name, szValue, sizeof(pCommand->name) - 1);
-    pCommand->name[sizeof(pCommand->name) - 1] = '\0';
-    break;
+  case 'n': {
+    const int nameLength = length < (int)sizeof(command.name) - 1 ? length : sizeof(command.name) - 1;
+    memcpy(command.name, pValue, nameLength);
+    command.name[nameLength] = '\0';
+    return ESuccess;
+  }
   case 'c':
-    if (strcmp(szValue, "start") == 0)
-      pCommand->command = SCommand::EStart;
-    else if (strcmp(szValue, "stop") == 0)
-      pCommand->command = SCommand::EStop;
-    else if (strcmp(szValue, "cfg") == 0)
-      pCommand->command = SCommand::EConfig;
-    break;
+    if (length == 5 && strncmp(pValue, "start", 5) == 0)
+      command.command = SCommand::EStart;
+    else if (length == 4 && strncmp(pValue, "stop", 4) == 0)
+      command.command = SCommand::EStop;
+    else if (length == 3 && strncmp(pValue, "cfg", 3) == 0)
+      command.command = SCommand::EConfig;
+    else
+      return EInvalidCommand;
+    return ESuccess;
   case 'l':
-    pCommand->lidTemp = atoi(szValue);
-    break;
+    if (!ParseNumber(pValue, pEnd, MAX_LID_TEMP, value) || pValue != pEnd)
+      return EInvalidCommand;
+    command.lidTemp = value;
+    return ESuccess;
   case 'o':
-    pCommand->contrast = atoi(szValue);
+    if (!ParseNumber(pValue, pEnd, 255, value) || pValue != pEnd)
+      return EInvalidCommand;
+    command.contrast = value;
+    return ESuccess;
   case 'd':
-    pCommand->commandId = atoi(szValue);
-    break;
+    if (!ParseNumber(pValue, pEnd, 65535, value) || pValue != pEnd)
+      return EInvalidCommand;
+    command.commandId = value;
+    return ESuccess;
+  case 'i':
+    if (!ParseNumber(pValue, pEnd, 255, value) || pValue != pEnd)
+      return EInvalidCommand;
+    command.logIntervalS = value;
+    return ESuccess;
   case 'p':
-    pCommand->pProgram = ParseProgram(szValue);
-    break;
+    return ParseProgram(command.pProgram, pValue, pEnd, pSize);
+  default:
+    //the signature and keys for other firmware versions
+    return ESuccess;
   }
 }
 
-Cycle* CommandParser::ParseProgram(char* pBuffer)
+PcrStatus CommandParser::ParseProgram(Cycle*& pProgram, const char* p, const char* pEnd, ProgramSize* pSize)
 {
-  Cycle* pProgram = gpThermocycler->GetCyclePool().AllocateComponent();
-  pProgram->SetNumCycles(1);
+  if (!AllocateCycle(pProgram, pSize))
+    return ETooManyCycles;
+  if (pProgram != NULL)
+    pProgram->SetNumCycles(1);
+
+  //one or more (cycle)
+  int numItems = 0;
+  do {
+    if (p == pEnd || *p++ != '(')
+      return EInvalidCommand;
+    Cycle* pCycle;
+    PcrStatus status = ParseCycle(pCycle, p, pEnd, pSize);
+    if (!SUCCEEDED(status))
+      return status;
+    if (p == pEnd || *p++ != ')')
+      return EInvalidCommand;
+    if (++numItems > MAX_CYCLE_ITEMS)
+      return ETooManyCycleItems;
+    if (pProgram != NULL) {
+      status = pProgram->AddComponent(pCycle);
+      if (!SUCCEEDED(status))
+        return status;
+    }
+  } while (p != pEnd);
 
-  char* pCycBuf = strtok(pBuffer, "()");
-  while (pCycBuf != NULL) {
-    pProgram->AddComponent(ParseCycle(pCycBuf));
-    pCycBuf = strtok(NULL, "()");
-  }
-  
-  return pProgram;
+  return ESuccess;
 }
 
-ProgramComponent* CommandParser::ParseCycle(char* pBuffer) {
-  char countBuf[5];
-
-  //find first step
-  char* pStep = strchr(pBuffer, '[');
+PcrStatus CommandParser::ParseCycle(Cycle*& pCycle, const char*& p, const char* pEnd, ProgramSize* pSize) {
+  //count[step][step]...
+  unsigned long count;
+  if (!ParseNumber(p, pEnd, 9999, count) || count == 0)
+    return EInvalidCommand;
+
+  if (!AllocateCycle(pCycle, pSize))
+    return ETooManyCycles;
+  if (pCycle != NULL)
+    pCycle->SetNumCycles(count);
+
+  //one or more steps
+  int numItems = 0;
+  do {
+    if (p == pEnd || *p++ != '[')
+      return EInvalidCommand;
+    Step* pStep;
+    PcrStatus status = ParseStep(pStep, p, pEnd, pSize);
+    if (!SUCCEEDED(status))
+      return status;
+    if (p == pEnd || *p++ != ']')
+      return EInvalidCommand;
+    if (++numItems > MAX_CYCLE_ITEMS)
+      return ETooManyCycleItems;
+    if (pCycle != NULL) {
+      status = pCycle->AddComponent(pStep);
+      if (!SUCCEEDED(status))
+        return status;
+    }
+  } while (p != pEnd && *p == '[');
 
-  //get cycle count
-  int countLen = pStep - pBuffer;
-  strncpy(countBuf, pBuffer, countLen);
-  countBuf[countLen] = '\0';
-  int cycCount = atoi(countBuf);
-  
-  Cycle* pCycle = gpThermocycler->GetCyclePool().AllocateComponent();
-  pCycle->SetNumCycles(cycCount);
+  return ESuccess;
+}
 
-  //add steps
-  while (pStep != NULL) {
-    *pStep++ = '\0';
-    char* pStepEnd = strchr(pStep, ']');
-    *pStepEnd++ = '\0';
+PcrStatus CommandParser::ParseStep(Step*& pStep, const char*& p, const char* pEnd, ProgramSize* pSize) {
+  //duration|temp|name or duration|temp|name|ramp duration
+  unsigned long stepDuration;
+  float temp;
+  if (!ParseNumber(p, pEnd, 65535, stepDuration) || p == pEnd || *p++ != '|'
+    || !ParseTemp(p, pEnd, temp) || p == pEnd || *p++ != '|')
+    return EInvalidCommand;
+
+  const char* const pName = p;
+  while (p != pEnd && *p != '|' && *p != ']')
+    p++;
+  const int nameLength = p - pName;
+
+  unsigned long rampDuration = 0;
+  if (p != pEnd && *p == '|') {
+    p++;
+    if (!ParseNumber(p, pEnd, MAX_RAMP_DURATION_S, rampDuration))
+      return EInvalidCommand;
+  }
 
-    Step* pNewStep = ParseStep(pStep);
-    pCycle->AddComponent(pNewStep);
-    pStep = strchr(pStepEnd, '[');
+  if (pSize != NULL) {
+    pStep = NULL;
+    return ++pSize->numSteps > StepPool::GetCapacity() ? ETooManySteps : ESuccess;
   }
+  pStep = gpThermocycler->GetStepPool().AllocateComponent();
+  if (pStep == NULL)
+    return ETooManySteps;
 
-  return pCycle;
+  pStep->SetName(pName, nameLength);
+  pStep->SetStepDurationS(stepDuration);
+  pStep->SetRampDurationS(rampDuration);
+  pStep->SetTemp(temp);
+  return ESuccess;
 }
 
-Step* CommandParser::ParseStep(char* pBuffer) {
-  //parse temp
-  char* pTemp = strchr(pBuffer, '|');
-  *pTemp++ = '\0';
-  
-  //parse name
-  char* pName = strchr(pTemp, '|');
-  *pName++ = '\0';
-  
-  //parse ramp duration if exists
-  char* pEnd;
-  char* pRampDuration = strchr(pName, '|');
-  if (pRampDuration) {
-    *pRampDuration++ = '\0';
-    pEnd = strchr(pRampDuration, ']');
-  } else {
-    pEnd = strchr(pName, '|');
+bool CommandParser::AllocateCycle(Cycle*& pCycle, ProgramSize* pSize) {
+  if (pSize != NULL) {
+    pCycle = NULL;
+    return ++pSize->numCycles <= CyclePool::GetCapacity();
+  }
+  pCycle = gpThermocycler->GetCyclePool().AllocateComponent();
+  return pCycle != NULL;
+}
+
+bool CommandParser::ParseNumber(const char*& p, const char* pEnd, unsigned long max, unsigned long& value) {
+  //decimal digits, at least one, up to max
+  if (p == pEnd || *p < '0' || *p > '9')
+    return false;
+
+  value = 0;
+  while (p != pEnd && *p >= '0' && *p <= '9') {
+    const unsigned long digit = *p++ - '0';
+    if (value > (max - digit) / 10)
+      return false;
+    value = value * 10 + digit;
   }
-  *pEnd = '\0';
+  return true;
+}
 
-  unsigned long stepDuration = atol(pBuffer);
-  unsigned long rampDuration = pRampDuration == NULL ? 0 : atol(pRampDuration);
-  float temp = atof(pTemp);
+bool CommandParser::ParseTemp(const char*& p, const char* pEnd, float& temp) {
+  //[-]digits[.digits], from MIN_PLATE_TEMP to MAX_PLATE_TEMP
+  const bool negative = p != pEnd && *p == '-';
+  if (negative)
+    p++;
+
+  unsigned long whole;
+  if (!ParseNumber(p, pEnd, MAX_PLATE_TEMP > -MIN_PLATE_TEMP ? MAX_PLATE_TEMP : -MIN_PLATE_TEMP, whole))
+    return false;
+  temp = whole;
+
+  if (p != pEnd && *p == '.') {
+    p++;
+    if (p == pEnd || *p < '0' || *p > '9')
+      return false;
+    float scale = 0.1;
+    while (p != pEnd && *p >= '0' && *p <= '9') {
+      temp += (*p++ - '0') * scale;
+      scale *= 0.1;
+    }
+  }
 
-  Step* pStep = gpThermocycler->GetStepPool().AllocateComponent();
-  
-  pStep->SetName(pName);
-  pStep->SetStepDurationS(stepDuration);
-  pStep->SetRampDurationS(rampDuration);
-  pStep->SetTemp(temp);
-  return pStep;
+  //to the 0.1 C ProgramStore keeps, so a resumed run has the same targets
+  temp = ToDeciC(negative ? -temp : temp) / 10.0;
+  return temp >= MIN_PLATE_TEMP && temp <= MAX_PLATE_TEMP;
 }
 
 
 ////////////////////////////////////////////////////////////////////
 // Class ProgramStore
 //
-// Note: Byte 0 of EEPROM is used for contrast
-//       Bytes 1 and onwards are used for stored program string
-//
+// The program record, little endian:
+//   version, run id, payload length (2), payload, CRC-16 of all before
+// with the payload
+//   lid temperature, name length, name, number of loops,
+//   per loop: cycles (2), steps,
+//   per step: temperature in 0.1 C (2), hold s (2), ramp s (4),
+//             name length, name
+// A progress record, in one of the ring's slots:
+//   sequence (2), run id, step, cycle (2), held s (2), elapsed s (4), CRC-8
+// Writes go round the ring in order, so the slots hold the latest
+// records; the run id ties them to the program they belong to.
+
+#define PROGRAM_STORE_VERSION 1
+#define PROGRAM_INVALID       0xff //version byte of an erased or cleared record
+#define PROGRAM_HEADER_SIZE   4
+
+bool ProgramStore::sHasProgram = false;
+uint8_t ProgramStore::sRunId = 0;
+bool ProgramStore::sHasRing = false;
+uint8_t ProgramStore::sNextSlot = 0;
+uint16_t ProgramStore::sSequence = 0;
+bool ProgramStore::sInvalidate = false;
+StepSchedule* ProgramStore::spSchedule = NULL;
+const char* ProgramStore::spName = NULL;
+uint8_t ProgramStore::sLidTemp = 0;
+uint16_t ProgramStore::sProgramLength = 0;
+uint16_t ProgramStore::sProgramOffset = 0;
+uint16_t ProgramStore::sProgramCrc = 0;
+uint8_t ProgramStore::sProgress[EEPROM_PROGRESS_SLOT_SIZE];
+uint8_t ProgramStore::sProgressOffset = EEPROM_PROGRESS_SLOT_SIZE;
+
+//Finds one byte of a record by laying the whole record out with Put;
+//doing that again for every byte is cheap next to writing one
+class RecordCursor {
+public:
+  RecordCursor(uint16_t offset) : iOffset(offset), iPosition(0), iValue(0) {}
+  void Put(uint32_t val, int size) {
+    for (int i = 0; i < size; i++, val >>= 8, iPosition++) {
+      if (iPosition == iOffset)
+        iValue = val & 0xff;
+    }
+  }
+  bool IsPast() const { return iPosition > iOffset; }
+  uint8_t GetValue() const { return iValue; }
+
+private:
+  uint16_t iOffset;
+  uint16_t iPosition;
+  uint8_t iValue;
+};
+
+static uint32_t ReadLittleEndian(const uint8_t*& p, int size) {
+  uint32_t val = 0;
+  for (int i = 0; i < size; i++)
+    val |= (uint32_t)eeprom_read_byte(p++) << (8 * i);
+  return val;
+}
+
+//false unless the slot holds a progress record with a valid CRC
+static bool ReadProgressSlot(int slot, uint8_t* pRecord) {
+  eeprom_read_block(pRecord, (const void*)(uintptr_t)(EEPROM_PROGRESS_ADDR + slot * EEPROM_PROGRESS_SLOT_SIZE), EEPROM_PROGRESS_SLOT_SIZE);
+  uint8_t crc = 0;
+  for (int i = 0; i < EEPROM_PROGRESS_SLOT_SIZE - 1; i++)
+    crc = _crc_ibutton_update(crc, pRecord[i]);
+  return crc == pRecord[EEPROM_PROGRESS_SLOT_SIZE - 1];
+}
+
+bool ProgramStore::RetrieveProgram(Cycle*& pProgram, char* szName, int& lidTemp) {
+  //check the whole record before building anything from it
+  const uint8_t* p = (const uint8_t*)(uintptr_t)EEPROM_PROGRAM_ADDR;
+  if (eeprom_read_byte(p) != PROGRAM_STORE_VERSION)
+    return false;
+  p += 2;
+  const uint16_t length = ReadLittleEndian(p, 2);
+  if (PROGRAM_HEADER_SIZE + length + 2 > EEPROM_PROGRAM_SIZE)
+    return false;
+  uint16_t crc = 0xffff;
+  for (p = (const uint8_t*)(uintptr_t)EEPROM_PROGRAM_ADDR; p < (const uint8_t*)(uintptr_t)EEPROM_PROGRAM_ADDR + PROGRAM_HEADER_SIZE + length; p++)
+    crc = _crc16_update(crc, eeprom_read_byte(p));
+  if (ReadLittleEndian(p, 2) != crc)
+    return false;
+
+  p = (const uint8_t*)(uintptr_t)EEPROM_PROGRAM_ADDR + PROGRAM_HEADER_SIZE;
+  const uint8_t* const pEnd = p + length;
+  if (pEnd - p < 2)
+    return false;
+  lidTemp = ReadLittleEndian(p, 1);
+  uint8_t nameLength = ReadLittleEndian(p, 1);
+  if (nameLength > 20 || pEnd - p < nameLength + 1)
+    return false;
+  eeprom_read_block(szName, p, nameLength);
+  szName[nameLength] = '\0';
+  p += nameLength;
+  const uint8_t numLoops = ReadLittleEndian(p, 1);
+
+  pProgram = gpThermocycler->GetCyclePool().AllocateComponent();
+  if (pProgram == NULL)
+    return false;
+  pProgram->SetNumCycles(1);
+  for (int i = 0; i < numLoops; i++) {
+    if (pEnd - p < 3)
+      return false;
+    const uint16_t numCycles = ReadLittleEndian(p, 2);
+    const uint8_t numSteps = ReadLittleEndian(p, 1);
+    if (numCycles == 0 || numSteps == 0)
+      return false;
+
+    //a loop of one step once was a step in the program itself
+    Cycle* pCycle = NULL;
+    if (numSteps > 1 || numCycles > 1) {
+      pCycle = gpThermocycler->GetCyclePool().AllocateComponent();
+      if (pCycle == NULL)
+        return false;
+      pCycle->SetNumCycles(numCycles);
+    }
+    for (int j = 0; j < numSteps; j++) {
+      Step* pStep = gpThermocycler->GetStepPool().AllocateComponent();
+      if (pStep == NULL || pEnd - p < 9)
+        return false;
+      pStep->SetTemp((int16_t)ReadLittleEndian(p, 2) / 10.0);
+      pStep->SetStepDurationS(ReadLittleEndian(p, 2));
+      pStep->SetRampDurationS(ReadLittleEndian(p, 4));
+      char name[STEP_NAME_LENGTH];
+      nameLength = ReadLittleEndian(p, 1);
+      if (nameLength > STEP_NAME_LENGTH - 1 || pEnd - p < nameLength)
+        return false;
+      eeprom_read_block(name, p, nameLength);
+      p += nameLength;
+      pStep->SetName(name, nameLength);
+      const PcrStatus status = pCycle != NULL ? pCycle->AddComponent(pStep) : pProgram->AddComponent(pStep);
+      if (!SUCCEEDED(status))
+        return false;
+    }
+    if (pCycle != NULL && !SUCCEEDED(pProgram->AddComponent(pCycle)))
+      return false;
+  }
+  return p == pEnd;
+}
+
+bool ProgramStore::RetrieveProgress(RunProgress& progress) {
+  if (eeprom_read_byte((const uint8_t*)(uintptr_t)EEPROM_PROGRAM_ADDR) != PROGRAM_STORE_VERSION)
+    return false;
+  uint16_t sequence;
+  const int slot = FindProgressSlot(sequence);
+  uint8_t record[EEPROM_PROGRESS_SLOT_SIZE];
+  if (slot < 0 || !ReadProgressSlot(slot, record) || record[2] != eeprom_read_byte((const uint8_t*)(uintptr_t)EEPROM_PROGRAM_ADDR + 1))
+    return false;
+
+  progress.step = record[3];
+  progress.cycle = record[4] | (record[5] << 8);
+  progress.heldS = record[6] | (record[7] << 8);
+  progress.elapsedS = record[8] | ((uint32_t)record[9] << 8) | ((uint32_t)record[10] << 16) | ((uint32_t)record[11] << 24);
+
+  //carry on after it
+  sHasProgram = true;
+  sRunId = record[2];
+  sHasRing = true;
+  sNextSlot = (slot + 1) % EEPROM_PROGRESS_SLOTS;
+  sSequence = sequence + 1;
+  return true;
+}
+
+bool ProgramStore::StoreProgram(StepSchedule& schedule, const char* szName, int lidTemp) {
+  //invalid until it is complete, so a reset halfway leaves no program
+  Clear();
+
+  const int nameLength = strlen(szName) < 20 ? strlen(szName) : 20;
+  unsigned int length = 3 + nameLength + schedule.GetNumLoops() * 3;
+  for (int i = 0; i < schedule.GetNumSteps(); i++)
+    length += 9 + strlen(schedule.GetStep(i)->GetName());
+  if (PROGRAM_HEADER_SIZE + length + 2 > EEPROM_PROGRAM_SIZE)
+    return false;
+
+  //the first time, carry on from what is in EEPROM: a new run id, and
+  //progress round the ring from the newest record
+  if (!sHasRing) {
+    sRunId = eeprom_read_byte((const uint8_t*)(uintptr_t)EEPROM_PROGRAM_ADDR + 1);
+    uint16_t sequence = 0;
+    const int slot = FindProgressSlot(sequence);
+    sNextSlot = slot < 0 ? 0 : (slot + 1) % EEPROM_PROGRESS_SLOTS;
+    sSequence = sequence + 1;
+    sHasRing = true;
+  }
+  sRunId++;
+
+  spSchedule = &schedule;
+  spName = szName;
+  sLidTemp = lidTemp;
+  sProgramLength = length;
+  sProgramOffset = 1; //the version byte goes last
+  sProgramCrc = _crc16_update(0xffff, PROGRAM_STORE_VERSION);
+  sHasProgram = true;
+  return true;
+}
 
-#define PROG_START_STR "&c=start"
-const char PROG_START_STR_P[] PROGMEM = PROG_START_STR;
+void ProgramStore::StoreProgress(const RunProgress& progress) {
+  if (!sHasProgram)
+    return;
+
+  uint8_t record[EEPROM_PROGRESS_SLOT_SIZE] = {
+    (uint8_t)sSequence, (uint8_t)(sSequence >> 8),
+    sRunId,
+    progress.step,
+    (uint8_t)progress.cycle, (uint8_t)(progress.cycle >> 8),
+    (uint8_t)progress.heldS, (uint8_t)(progress.heldS >> 8),
+    (uint8_t)progress.elapsedS, (uint8_t)(progress.elapsedS >> 8), (uint8_t)(progress.elapsedS >> 16), (uint8_t)(progress.elapsedS >> 24),
+    0
+  };
+  for (int i = 0; i < EEPROM_PROGRESS_SLOT_SIZE - 1; i++)
+    record[EEPROM_PROGRESS_SLOT_SIZE - 1] = _crc_ibutton_update(record[EEPROM_PROGRESS_SLOT_SIZE - 1], record[i]);
+
+  //a record still being written is out of date, start over in its slot
+  memcpy(sProgress, record, sizeof(sProgress));
+  sProgressOffset = 0;
+}
+
+void ProgramStore::Clear() {
+  sHasProgram = false;
+  spSchedule = NULL;
+  sInvalidate = true;
+  Task(); //at once, unless the EEPROM is busy
+}
+
+void ProgramStore::Task() {
+  if (!eeprom_is_ready())
+    return;
+
+  if (sInvalidate) {
+    eeprom_update_byte((uint8_t*)(uintptr_t)EEPROM_PROGRAM_ADDR, PROGRAM_INVALID);
+    sInvalidate = false;
+  } else if (spSchedule != NULL) {
+    const uint16_t crcOffset = PROGRAM_HEADER_SIZE + sProgramLength;
+    if (sProgramOffset < crcOffset + 2) {
+      const uint8_t value = GetProgramByte(sProgramOffset);
+      eeprom_update_byte((uint8_t*)(uintptr_t)EEPROM_PROGRAM_ADDR + sProgramOffset, value);
+      if (sProgramOffset < crcOffset)
+        sProgramCrc = _crc16_update(sProgramCrc, value);
+      sProgramOffset++;
+    } else {
+      //complete, so valid
+      eeprom_update_byte((uint8_t*)(uintptr_t)EEPROM_PROGRAM_ADDR, PROGRAM_STORE_VERSION);
+      spSchedule = NULL;
+    }
+  } else if (sProgressOffset < EEPROM_PROGRESS_SLOT_SIZE) {
+    eeprom_update_byte((uint8_t*)(uintptr_t)(EEPROM_PROGRESS_ADDR + sNextSlot * EEPROM_PROGRESS_SLOT_SIZE + sProgressOffset), sProgress[sProgressOffset]);
+    if (++sProgressOffset == EEPROM_PROGRESS_SLOT_SIZE) {
+      sNextSlot = (sNextSlot + 1) % EEPROM_PROGRESS_SLOTS;
+      sSequence++;
+    }
+  }
+}
 
+uint8_t ProgramStore::GetProgramByte(uint16_t offset) {
+  RecordCursor cursor(offset);
+  cursor.Put(PROGRAM_STORE_VERSION, 1);
+  cursor.Put(sRunId, 1);
+  cursor.Put(sProgramLength, 2);
+  cursor.Put(sLidTemp, 1);
+  const int nameLength = strlen(spName) < 20 ? strlen(spName) : 20;
+  cursor.Put(nameLength, 1);
+  for (int i = 0; i < nameLength && !cursor.IsPast(); i++)
+    cursor.Put(spName[i], 1);
+  cursor.Put(spSchedule->GetNumLoops(), 1);
+  for (int i = 0; i < spSchedule->GetNumLoops() && !cursor.IsPast(); i++) {
+    const ScheduleLoop& loop = spSchedule->GetLoop(i);
+    cursor.Put(loop.numCycles, 2);
+    cursor.Put(loop.numSteps, 1);
+    for (int j = loop.firstStep; j < loop.firstStep + loop.numSteps && !cursor.IsPast(); j++) {
+      Step* pStep = spSchedule->GetStep(j);
+      cursor.Put((uint16_t)ToDeciC(pStep->GetTemp()), 2);
+      cursor.Put(pStep->GetStepDurationS(), 2);
+      cursor.Put(pStep->GetRampDurationS(), 4);
+      const char* szStepName = pStep->GetName();
+      cursor.Put(strlen(szStepName), 1);
+      while (*szStepName != '\0')
+        cursor.Put(*szStepName++, 1);
+    }
+  }
+  cursor.Put(sProgramCrc, 2); //complete only once the bytes before it are written
+  return cursor.GetValue();
+}
 
+int ProgramStore::FindProgressSlot(uint16_t& sequence) {
+  int newest = -1;
+  for (int i = 0; i < EEPROM_PROGRESS_SLOTS; i++) {
+    uint8_t record[EEPROM_PROGRESS_SLOT_SIZE];
+    if (!ReadProgressSlot(i, record))
+      continue;
+    const uint16_t slotSequence = record[0] | (record[1] << 8);
+    if (newest < 0 || (int16_t)(slotSequence - sequence) > 0) {
+      newest = i;
+      sequence = slotSequence;
+    }
+  }
+  return newest;
+}
@@ -34,10 +34,6 @@ public:
   virtual ~ProgramComponent() {}
   virtual void Reset() = 0;
   virtual TType GetType() const = 0;
-  
-  // iteration
-  virtual void BeginIteration() = 0;
-  virtual Step* GetNextStep() = 0;
 };
 
 struct Step : public ProgramComponent
@@ -54,19 +50,14 @@ struct Step : public ProgramComponent
   void SetStepDurationS(const unsigned long stepDurationS) { iStepDurationS = stepDurationS; }
   void SetRampDurationS(const unsigned long rampDurationS) { iRampDurationS = rampDurationS; }
   void SetTemp(const float temp) { iTemp = temp; }
-  void SetName(const char* szName);
+  void SetName(const char* szName, int length = STEP_NAME_LENGTH - 1); //copies at most length characters
   
   virtual void Reset();
-  
-  // iteration
-  virtual void BeginIteration();
-  virtual Step* GetNextStep();
 
 private:
   unsigned int iStepDurationS; //in seconds
   unsigned long iRampDurationS; //in seconds, refers to ramp before the current step hold
   float iTemp; // C
-  bool iStepReturned;
   char iName[STEP_NAME_LENGTH];
 };
 
@@ -76,30 +67,23 @@ class Cycle: public ProgramComponent {
 public:
   // accessors
   virtual TType GetType() const { return ECycle; }
-  int GetCurrentCycle() const { return iCurrentCycle + 1; } //add 1 because cycles start at 0
   int GetNumCycles() const { return iNumCycles; }
   int GetNumComponents() const { return iNumComponents; }
   ProgramComponent* GetComponent(int index);
+  //most components any cycle has had since start-up
+  static int GetMaxNumComponents() { return sMaxNumComponents; }
   
   // mutators
   void SetNumCycles(int numCycles) { iNumCycles = numCycles; }
   PcrStatus AddComponent(ProgramComponent* pComponent); //takes ownership
   virtual void Reset();
-  
-  // iteration
-  virtual void BeginIteration();
-  virtual Step* GetNextStep();
-  
-private:
-  void RestartCycle();
 
 private:
   ProgramComponent* iComponents[MAX_CYCLE_ITEMS];
   int iNumComponents;
   int iNumCycles;
-  
-  int iCurrentCycle;
-  int iCurrentComponent; // -1 means no component
+
+  static int sMaxNumComponents;
 };
 
 ////////////////////////////////////////////////////////////////////
@@ -107,24 +91,92 @@ private:
 template <class T, int N>
 class ProgramComponentPool {
 public:
-  ProgramComponentPool() { iAllocatedComponents = 0; }
+  ProgramComponentPool() { iAllocatedComponents = 0; iHighWaterMark = 0; }
 
+  //NULL once all N are in use
   T* AllocateComponent() { 
     if (iAllocatedComponents == N)
       return NULL;
       
     T* pComponent = &iComponents[iAllocatedComponents++];
+    if (iAllocatedComponents > iHighWaterMark)
+      iHighWaterMark = iAllocatedComponents;
     pComponent->Reset();
     return pComponent;
   }
   
   void ResetPool() { iAllocatedComponents = 0; }
+
+  static int GetCapacity() { return N; }
+  int GetNumAllocated() const { return iAllocatedComponents; }
+  //most components in use at once since start-up
+  int GetHighWaterMark() const { return iHighWaterMark; }
   
 private:
   int iAllocatedComponents;
+  int iHighWaterMark;
   T iComponents[N];
 };
 
+typedef ProgramComponentPool<Cycle, MAX_CYCLES> CyclePool;
+typedef ProgramComponentPool<Step, MAX_STEPS> StepPool;
+
+////////////////////////////////////////////////////////////////////
+// Class StepSchedule
+//
+// A program compiled into the order its steps run in: the steps of each
+// cycle side by side in one array, and a loop for each cycle saying
+// which steps it repeats and how often. Moving to the next step is an
+// index increment, and durations over the rest of the program follow
+// from the loops without walking every repeat.
+
+struct ScheduleLoop {
+  uint8_t firstStep; //index into the schedule's steps
+  uint8_t numSteps;
+  uint16_t numCycles;
+};
+
+class StepSchedule {
+public:
+  StepSchedule() { Clear(); }
+
+  void Clear();
+  //Flattens a program as CommandParser builds it: cycles of steps, a
+  //step directly in the program running as a cycle of one. The steps
+  //stay owned by the program.
+  PcrStatus Compile(Cycle* pProgram);
+  bool IsEmpty() const { return m_num_loops == 0; }
+
+  int GetNumSteps() const { return m_num_steps; }
+  Step* GetStep(int index) { return m_steps[index]; }
+  int GetNumLoops() const { return m_num_loops; }
+  const ScheduleLoop& GetLoop(int index) const { return m_loops[index]; }
+  //the loop with the most cycles, the one the display and status count
+  int GetDisplayLoop() const { return m_display_loop; }
+
+  // iteration
+  void Begin();
+  //NULL after the last step
+  Step* Advance();
+  //continue from cycle of the loop step is in, as Advance left it when
+  //it returned step; NULL if there is no such step or cycle
+  Step* Seek(int step, int cycle);
+  int GetCurrentLoop() const { return m_loop; }  //GetNumLoops() once done
+  int GetCurrentCycle() const { return m_cycle; } //0 for the first
+  int GetCurrentStepIndex() const { return m_step; }
+
+private:
+  Step* m_steps[MAX_STEPS];
+  ScheduleLoop m_loops[MAX_CYCLES];
+  uint8_t m_num_steps;
+  uint8_t m_num_loops;
+  uint8_t m_display_loop;
+
+  uint8_t m_loop;
+  uint16_t m_cycle;
+  int m_step; //-1 before the first
+};
+
 struct SCommand {
   char name[21];
   uint16_t commandId;
@@ -136,19 +188,112 @@ struct SCommand {
   } command;
   int lidTemp;
   uint8_t contrast;
+  uint8_t logIntervalS;
   Cycle* pProgram;
 };
 
+//what a step may ask for: plate temperatures the Peltier reaches, and
+//ramps whose length in ms fits an unsigned long
+#define MIN_PLATE_TEMP      0
+#define MAX_PLATE_TEMP      100
+#define MAX_RAMP_DURATION_S (0xFFFFFFFFUL / 1000)
+
 class CommandParser
 {
 public:
-  static void ParseCommand(SCommand& command, char* pCommandBuf);
+  //Parses the command in the length bytes at pCommand, without
+  //modifying them. Returns EInvalidCommand if the command is malformed,
+  //ETooManyCycles, ETooManySteps or ETooManyCycleItems if its program
+  //does not fit and ENoProgram for a start command without one; a
+  //rejected command leaves the running program alone, and still has its
+  //commandId if its d parameter is valid. A valid start
+  //command stops the running program, which frees the pools the new one
+  //is built in; other commands do not build their program.
+  static PcrStatus ParseCommand(SCommand& command, const char* pCommand, const int length);
+
+private:
+  //what a program takes from the pools
+  struct ProgramSize {
+    int numCycles;
+    int numSteps;
+  };
+
+  //With pSize the program is only counted into it and checked against
+  //the pools' capacity, and pProgram stays NULL; without, it is built.
+  static PcrStatus ParseParams(SCommand& command, const char* pCommand, const int length, ProgramSize* pSize);
+  static PcrStatus AddComponent(SCommand& command, char key, const char* pValue, const char* pEnd, ProgramSize* pSize);
+  //these advance p past what they parse
+  static PcrStatus ParseProgram(Cycle*& pProgram, const char* p, const char* pEnd, ProgramSize* pSize);
+  static PcrStatus ParseCycle(Cycle*& pCycle, const char*& p, const char* pEnd, ProgramSize* pSize);
+  static PcrStatus ParseStep(Step*& pStep, const char*& p, const char* pEnd, ProgramSize* pSize);
+  static bool AllocateCycle(Cycle*& pCycle, ProgramSize* pSize);
+  static bool ParseNumber(const char*& p, const char* pEnd, unsigned long max, unsigned long& value);
+  static bool ParseTemp(const char*& p, const char* pEnd, float& temp);
+};
+
+////////////////////////////////////////////////////////////////////
+// Class ProgramStore
+//
+// Keeps the running program in EEPROM, so a run cut short by a reset
+// resumes where it was instead of starting over. The program is written
+// once when the run starts, in a record with a CRC-16 that is only
+// marked valid once it is complete. Where the run is changes at every
+// step, so it goes round a ring of EEPROM_PROGRESS_SLOTS small records,
+// each with a sequence number and a CRC-8; the newest valid one counts.
+// An EEPROM byte takes 3.4 ms to write, so the records are written by
+// Task a byte per pass of the main loop, never holding up control.
+
+//Where a run is
+struct RunProgress {
+  uint8_t step;      //index into the schedule
+  uint16_t cycle;    //of the step's loop, 0 for the first
+  uint16_t heldS;    //of the step's hold, 0 while ramping to it
+  uint32_t elapsedS; //since the program started
+};
+
+class ProgramStore {
+public:
+  //reading
+  //rebuilds the stored program from the pools; szName takes up to 20
+  //characters. False if there is none, or it does not fit the pools.
+  static bool RetrieveProgram(Cycle*& pProgram, char* szName, int& lidTemp);
+  static bool RetrieveProgress(RunProgress& progress);
+
+  //writing, all of it done by Task
+  //replaces the stored program; false if it does not fit, in which case
+  //there is nothing to resume. Schedule and name must stay as they are
+  //until Clear, as the record is written from them.
+  static bool StoreProgram(StepSchedule& schedule, const char* szName, int lidTemp);
+  //replaces progress not yet written
+  static void StoreProgress(const RunProgress& progress);
+  //nothing to resume
+  static void Clear();
+  //writes the next pending byte if the EEPROM is ready; call on every
+  //pass of the main loop
+  static void Task();
 
 private:
-  static void AddComponent(SCommand* pCommand, char key, char* szValue);
-  static Cycle* ParseProgram(char* pBuffer);
-  static ProgramComponent* ParseCycle(char* pBuffer);
-  static Step* ParseStep(char* pBuffer);
+  //the newest valid progress slot, of any run; -1 if there is none
+  static int FindProgressSlot(uint16_t& sequence);
+  //byte offset of the program record as StoreProgram lays it out
+  static uint8_t GetProgramByte(uint16_t offset);
+
+  static bool sHasProgram;    //progress is only stored for a stored program
+  static uint8_t sRunId;      //of the stored program, tags its progress
+  static bool sHasRing;       //sNextSlot and sSequence are known
+  static uint8_t sNextSlot;
+  static uint16_t sSequence;  //of the next progress record
+
+  //pending writes, in the order Task does them
+  static bool sInvalidate;    //the version byte, before anything else
+  static StepSchedule* spSchedule; //the program record, NULL when written
+  static const char* spName;
+  static uint8_t sLidTemp;
+  static uint16_t sProgramLength; //of its payload
+  static uint16_t sProgramOffset; //of the next byte
+  static uint16_t sProgramCrc;    //of the bytes before it
+  static uint8_t sProgress[EEPROM_PROGRESS_SLOT_SIZE]; //to sNextSlot
+  static uint8_t sProgressOffset; //EEPROM_PROGRESS_SLOT_SIZE when written
 };
   
 
@@ -25,20 +25,28 @@
 #include "program.h"
 #include "display.h"
 #include "thermistors.h"
+#include "timesource.h"
+#include "fixedformat.h"
 
 #pragma GCC diagnostic pop
 
-//const int BAUD_RATE = 4800;
-
 SerialControl::SerialControl(Display* pDisplay)
   :
     packetState(STATE_START),
     lastPacketSeq(0xff),
     m_command_id(0),
+    m_command_status(ESuccess),
     m_packet_len(0),
     m_packet_real_len(0),
     bEscapeCodeFound(false),
     iReceivedStatusRequest(false),
+    m_log_request_pending(false),
+    m_log_first(0),
+    m_log_count(0),
+    m_tx_head(0),
+    m_tx_tail(0),
+    m_tx_credit(UART_BUFFER_SIZE),
+    m_tx_credit_time_ms(GetTimeMs()),
     m_display(pDisplay)
 {  
 }
@@ -48,41 +56,116 @@ SerialControl::~SerialControl() {
 
 void SerialControl::Process() {
   while (ReadPacket()) {}
+  if (m_log_request_pending)
+    SendLog();
+  FlushTx();
 }
 
 /////////////////////////////////////////////////////////////////
 // Private
 boolean SerialControl::ReadPacket()
 {
+  //only what has arrived, so this never waits on the host
+  int availableBytes = Serial.available();
+  if (availableBytes <= 0)
+    return false;
+
+  while (availableBytes--)
+    ReadByte(Serial.read());
   return true;
 }
 
+void SerialControl::ReadByte(byte incomingByte)
+{
+  switch (packetState) {
+  case STATE_START:
+    //sync with an unescaped start code
+    if (incomingByte == START_CODE && !bEscapeCodeFound)
+      packetState = STATE_STARTCODE_FOUND;
+    bEscapeCodeFound = incomingByte == ESCAPE_CODE;
+    break;
+
+  case STATE_STARTCODE_FOUND:
+    m_packet_len = incomingByte;
+    packetState = STATE_PACKETLEN_LOW;
+    break;
+
+  case STATE_PACKETLEN_LOW:
+    m_packet_len |= (uint16_t)incomingByte << 8;
+    if (m_packet_len < PACKET_HEADER_LENGTH || m_packet_len > MAX_COMMAND_SIZE) {
+      //not a packet we can hold, look for the next one
+      packetState = STATE_START;
+      bEscapeCodeFound = false;
+      break;
+    }
+    buf[0] = START_CODE;
+    buf[1] = m_packet_len & 0xff;
+    buf[2] = (m_packet_len & 0xff00) >> 8;
+    m_packet_real_len = 3;
+    m_packet_len -= 3; //bytes left on the wire, escape codes included
+    bEscapeCodeFound = false;
+    packetState = STATE_PACKETHEADER_DONE;
+    break;
+
+  case STATE_PACKETHEADER_DONE:
+    if (bEscapeCodeFound && incomingByte == START_CODE) {
+      m_packet_real_len--; //erase the escape code
+      bEscapeCodeFound = false;
+    } else {
+      bEscapeCodeFound = incomingByte == ESCAPE_CODE;
+    }
+    buf[m_packet_real_len++] = incomingByte;
+
+    if (--m_packet_len == 0) {
+      ProcessPacket(buf, m_packet_real_len);
+
+      //reset, to find START_CODE again
+      packetState = STATE_START;
+      bEscapeCodeFound = false;
+    }
+    break;
+  }
+}
+
 void SerialControl::ProcessPacket(byte* data, int datasize)
 {
-  PCPPacket* packet = (PCPPacket*)data;
-  uint8_t packetType = packet->eType & 0xf0;
-  uint8_t packetSeq = packet->eType & 0x0f;
+  uint8_t packetType = data[3] & 0xf0;
+  uint8_t packetSeq = data[3] & 0x0f;
   //uint8_t result = false;
   char* pCommandBuf;
   
   switch(packetType){
-  case SEND_CMD:
-    data[datasize] = '\0';
+  case SEND_CMD: {
     SCommand command;
-    pCommandBuf = (char*)(data + sizeof(PCPPacket));
+    pCommandBuf = (char*)(data + PACKET_HEADER_LENGTH);
     
-    //store start commands for restart
-    //ProgramStore::StoreProgram(pCommandBuf);
-    
-    CommandParser::ParseCommand(command, pCommandBuf);
-    GetThermocycler().ProcessCommand(command);
+    //a rejected command is acknowledged too, so the host does not wait
+    //for it; the status says it was rejected and why
+    m_command_status = CommandParser::ParseCommand(command, pCommandBuf, datasize - PACKET_HEADER_LENGTH);
     m_command_id = command.commandId;
+    if (SUCCEEDED(m_command_status))
+      GetThermocycler().ProcessCommand(command);
     break;
+  }
     
   case STATUS_REQ:
     iReceivedStatusRequest = true;
     SendStatus();
     break;
+
+  case STATUS_FRAME_REQ:
+    iReceivedStatusRequest = true;
+    SendStatusFrame();
+    break;
+
+  case LOG_REQ:
+    if (datasize >= PACKET_HEADER_LENGTH + 3) {
+      m_log_first = data[4] | (data[5] << 8);
+      m_log_count = data[6];
+      m_log_request_pending = true;
+      SendLog();
+    }
+    break;
   default:
     break;
  }
@@ -97,96 +180,228 @@ void SerialControl::SendStatus() {
   const char* const szStatus = GetProgramStateString_P(state);
   const char* const szThermState = GetThermalStateString_P(GetThermocycler().GetThermalState());
       
+  //fields in order of importance: the record is STATUS_FILE_LEN bytes,
+  //and a field that does not fit in what is left is dropped. At their
+  //widest the fields of a running program do not all fit, the step name
+  //and the margin being the first to go.
   char statusBuf[STATUS_FILE_LEN];
+  const char* const statusEnd = statusBuf + sizeof(statusBuf);
   char* statusPtr = statusBuf;
   Thermocycler& tc = GetThermocycler();
     
-  statusPtr = AddParam(statusPtr, 'd', (unsigned long)m_command_id, true);
-  statusPtr = AddParam_P(statusPtr, 's', szStatus);
-  statusPtr = AddParam(statusPtr, 'l', (int)tc.GetLidTemp());
-  statusPtr = AddParam(statusPtr, 'b', tc.GetPlateTemp(), 1, false);
-  statusPtr = AddParam_P(statusPtr, 't', szThermState);
-  statusPtr = AddParam(statusPtr, 'o', GetThermocycler().GetDisplay()->GetContrast());
+  statusPtr = AddParam(statusPtr, statusEnd, 'd', (unsigned long)m_command_id, true);
+  statusPtr = AddParam_P(statusPtr, statusEnd, 's', szStatus);
+  statusPtr = AddParam(statusPtr, statusEnd, 'l', (int)tc.GetLidTemp());
+  statusPtr = AddParam(statusPtr, statusEnd, 'b', (long)ToDeciC(tc.GetPlateTemp()), 1, false);
+  statusPtr = AddParam_P(statusPtr, statusEnd, 't', szThermState);
+  statusPtr = AddParam(statusPtr, statusEnd, 'o', GetThermocycler().GetDisplay()->GetContrast());
+  if (m_command_status != ESuccess)
+    statusPtr = AddParam(statusPtr, statusEnd, 'x', (int)m_command_status);
 
   if (state == Thermocycler::ERunning || state == Thermocycler::EComplete)
   {
-    statusPtr = AddParam(statusPtr, 'e', tc.GetElapsedTimeS());
-    statusPtr = AddParam(statusPtr, 'r', tc.GetTimeRemainingS());
-    statusPtr = AddParam(statusPtr, 'u', tc.GetNumCycles());
-    statusPtr = AddParam(statusPtr, 'c', tc.GetCurrentCycleNum());
-    //statusPtr = AddParam(statusPtr, 'n', tc.GetProgName());
+    statusPtr = AddParam(statusPtr, statusEnd, 'e', tc.GetElapsedTimeS());
+    statusPtr = AddParam(statusPtr, statusEnd, 'r', tc.GetTimeRemainingS());
+    statusPtr = AddParam(statusPtr, statusEnd, 'u', tc.GetNumCycles());
+    statusPtr = AddParam(statusPtr, statusEnd, 'c', tc.GetCurrentCycleNum());
+    //statusPtr = AddParam(statusPtr, statusEnd, 'n', tc.GetProgName());
     if (tc.GetCurrentStep() != NULL)
     {
-      statusPtr = AddParam(statusPtr, 'p', tc.GetCurrentStep()->GetName());
+      statusPtr = AddParam(statusPtr, statusEnd, 'p', tc.GetCurrentStep()->GetName());
     }
+    if (state == Thermocycler::ERunning)
+      statusPtr = AddParam(statusPtr, statusEnd, 'q', tc.GetTimeRemainingMarginS());
   }
   else if (state == static_cast<int>(Thermocycler::EIdle)) //RJCB: ???
   {
-    statusPtr = AddParam(statusPtr, 'v', OPENPCR_FIRMWARE_VERSION_STRING);
+    statusPtr = AddParam(statusPtr, statusEnd, 'v', OPENPCR_FIRMWARE_VERSION_STRING);
   }
   statusPtr++; //to include null terminator
 
-  //send packet
+  //send packet, padded to a fixed length with spaces
+  SendPacket(STATUS_RESP, statusBuf, statusPtr - statusBuf, STATUS_FILE_LEN);
 }
 
-char* SerialControl::AddParam(char* pBuffer, char key, int val, boolean init) {
-  if (!init)
-    *pBuffer++ = '&';
-  *pBuffer++ = key;
-  *pBuffer++ = '=';
-  itoa(val, pBuffer, 10);
-  while (*pBuffer != '\0')
-    pBuffer++;
-    
-  return pBuffer;
+void SerialControl::SendStatusFrame() {
+  Thermocycler& tc = GetThermocycler();
+  Thermocycler::ProgramState state = tc.GetProgramState();
+
+  byte frame[STATUS_FRAME_SIZE];
+  memset(frame, 0, sizeof(frame));
+  byte* pFrame = frame;
+  *pFrame++ = STATUS_FRAME_VERSION;
+  pFrame = PutLittleEndian(pFrame, m_command_id, 2);
+  *pFrame++ = state;
+  *pFrame++ = tc.GetThermalState();
+  pFrame = PutLittleEndian(pFrame, (uint16_t)ToDeciC(tc.GetLidTemp()), 2);
+  pFrame = PutLittleEndian(pFrame, (uint16_t)ToDeciC(tc.GetPlateTemp()), 2);
+  *pFrame++ = tc.GetDisplay()->GetContrast();
+
+  const bool isRunning = state == Thermocycler::ERunning || state == Thermocycler::EComplete;
+  pFrame = PutLittleEndian(pFrame, isRunning ? tc.GetElapsedTimeS() : 0, 4);
+  pFrame = PutLittleEndian(pFrame, isRunning ? tc.GetTimeRemainingS() : 0, 4);
+  pFrame = PutLittleEndian(pFrame, isRunning ? tc.GetNumCycles() : 0, 2);
+  pFrame = PutLittleEndian(pFrame, isRunning ? tc.GetCurrentCycleNum() : 0, 2);
+  if (isRunning && tc.GetCurrentStep() != NULL)
+    strncpy((char*)pFrame, tc.GetCurrentStep()->GetName(), STEP_NAME_LENGTH);
+  pFrame += STEP_NAME_LENGTH;
+
+  *pFrame++ = m_command_status;
+  *pFrame++ = tc.GetCyclePool().GetHighWaterMark();
+  *pFrame++ = CyclePool::GetCapacity();
+  *pFrame++ = tc.GetStepPool().GetHighWaterMark();
+  *pFrame++ = StepPool::GetCapacity();
+  *pFrame++ = Cycle::GetMaxNumComponents();
+  *pFrame++ = MAX_CYCLE_ITEMS;
+
+  pFrame = PutLittleEndian(pFrame, state == Thermocycler::ERunning ? tc.GetTimeRemainingMarginS() : 0, 4);
+
+  SendPacket(STATUS_FRAME_RESP, (const char*)frame, STATUS_FRAME_SIZE, STATUS_FRAME_SIZE);
 }
 
-char* SerialControl::AddParam(char* pBuffer, char key, unsigned long val, boolean init) {
-  if (!init)
-    *pBuffer++ = '&';
-  *pBuffer++ = key;
-  *pBuffer++ = '=';
-  ultoa(val, pBuffer, 10);
-  while (*pBuffer != '\0')
-    pBuffer++;
-    
+byte* SerialControl::PutLittleEndian(byte* pBuffer, uint32_t val, int size) {
+  while (size--) {
+    *pBuffer++ = val & 0xff;
+    val >>= 8;
+  }
   return pBuffer;
 }
 
-char* SerialControl::AddParam(char* pBuffer, char key, float val, int decimalDigits, boolean pad, boolean init) {
-  if (!init)
-    *pBuffer++ = '&';
-  *pBuffer++ = key;
-  *pBuffer++ = '=';
-  sprintFloat(pBuffer, val, decimalDigits, pad);
-  while (*pBuffer != '\0')
-    pBuffer++;
-    
-  return pBuffer;
+void SerialControl::SendLog() {
+  //as many of the requested records as the transmit buffer has room for;
+  //the bridge asks again for the rest. The sequence number lets it tell
+  //whether older records were dropped since it last asked.
+  const TemperatureLog& log = GetThermocycler().GetTemperatureLog();
+  const int room = GetTxFree() - PACKET_HEADER_LENGTH;
+  byte sequence[2];
+  PutLittleEndian(sequence, (uint16_t)(log.GetFirstSequence() + m_log_first), sizeof(sequence));
+  byte encoded[LOG_RECORD_SIZE];
+  LogRecord record;
+  int length = sizeof(sequence) + CountEscapes(sequence, sizeof(sequence));
+  uint8_t count = 0;
+  while (count < m_log_count && log.GetRecord(m_log_first + count, record)) {
+    TemperatureLog::EncodeRecord(record, encoded);
+    const int size = LOG_RECORD_SIZE + CountEscapes(encoded, LOG_RECORD_SIZE);
+    if (length + size > room)
+      break;
+    length += size;
+    count++;
+  }
+  //no room for even one record yet; an empty reply means the log has ended
+  if (length > room || (count == 0 && m_log_count > 0 && log.GetRecord(m_log_first, record)))
+    return;
+
+  const uint16_t packetLength = PACKET_HEADER_LENGTH + length;
+  QueueTxByte(START_CODE);
+  QueueTxByte(packetLength & 0xff);
+  QueueTxByte((packetLength & 0xff00) >> 8);
+  QueueTxByte(LOG_RESP);
+  for (unsigned int i = 0; i < sizeof(sequence); i++)
+    QueuePayloadByte(sequence[i]);
+  for (uint8_t i = 0; i < count; i++) {
+    log.GetRecord(m_log_first + i, record);
+    TemperatureLog::EncodeRecord(record, encoded);
+    for (int j = 0; j < LOG_RECORD_SIZE; j++)
+      QueuePayloadByte(encoded[j]);
+  }
+  m_log_request_pending = false;
+}
+
+boolean SerialControl::SendPacket(PACKET_TYPE type, const char* pPayload, int payloadLength, int paddedLength) {
+  //queue whole packets only, so a full buffer never truncates one
+  const int escapes = CountEscapes((const byte*)pPayload, payloadLength < paddedLength ? payloadLength : paddedLength);
+  if (GetTxFree() < PACKET_HEADER_LENGTH + paddedLength + escapes)
+    return false;
+
+  const uint16_t length = PACKET_HEADER_LENGTH + paddedLength + escapes;
+  QueueTxByte(START_CODE);
+  QueueTxByte(length & 0xff);
+  QueueTxByte((length & 0xff00) >> 8);
+  QueueTxByte(type);
+  for (int i = 0; i < paddedLength; i++)
+    QueuePayloadByte(i < payloadLength ? pPayload[i] : 0x20);
+  return true;
+}
+
+void SerialControl::QueuePayloadByte(byte b) {
+  //a start code in the payload goes out behind an escape code, which the
+  //packet length counts
+  if (b == START_CODE)
+    QueueTxByte(ESCAPE_CODE);
+  QueueTxByte(b);
 }
 
-char* SerialControl::AddParam(char* pBuffer, char key, const char* szVal, boolean init) {
+int SerialControl::CountEscapes(const byte* pPayload, int length) {
+  int escapes = 0;
+  for (int i = 0; i < length; i++)
+    if (pPayload[i] == START_CODE)
+      escapes++;
+  return escapes;
+}
+
+void SerialControl::QueueTxByte(byte b) {
+  m_tx_buf[m_tx_head] = b;
+  m_tx_head = (m_tx_head + 1) & (TX_BUFFER_SIZE - 1);
+}
+
+void SerialControl::FlushTx() {
+  //The UART sends a byte per 10 bit times. Only hand the Arduino core as
+  //many bytes as it can have sent since the last call, so Serial.write
+  //never waits for room in its buffer.
+  const unsigned long now = GetTimeMs();
+  const unsigned long sent = (now - m_tx_credit_time_ms) * (BAUD_RATE / 10) / 1000;
+  if (sent > 0) {
+    m_tx_credit = sent + m_tx_credit > UART_BUFFER_SIZE ? UART_BUFFER_SIZE : m_tx_credit + sent;
+    m_tx_credit_time_ms = now;
+  }
+
+  while (m_tx_credit > 0 && m_tx_tail != m_tx_head) {
+    Serial.write(m_tx_buf[m_tx_tail]);
+    m_tx_tail = (m_tx_tail + 1) & (TX_BUFFER_SIZE - 1);
+    m_tx_credit--;
+  }
+}
+
+char* SerialControl::AddParam(char* pBuffer, const char* pEnd, char key, int val, boolean init) {
+  char szVal[3 * sizeof(val) + 2]; //digits, sign and terminator
+  FormatFixed(szVal, val, 0);
+  return AddParam(pBuffer, pEnd, key, szVal, init);
+}
+
+char* SerialControl::AddParam(char* pBuffer, const char* pEnd, char key, unsigned long val, boolean init) {
+  char szVal[3 * sizeof(val) + 2];
+  ultoa(val, szVal, 10);
+  return AddParam(pBuffer, pEnd, key, szVal, init);
+}
+
+char* SerialControl::AddParam(char* pBuffer, const char* pEnd, char key, long fixedVal, int decimalDigits, boolean pad, boolean init) {
+  char szVal[3 * sizeof(fixedVal) + 3]; //and the point
+  FormatFixed(szVal, fixedVal, decimalDigits, pad ? 3 : 0);
+  return AddParam(pBuffer, pEnd, key, szVal, init);
+}
+
+char* SerialControl::AddParam(char* pBuffer, const char* pEnd, char key, const char* szVal, boolean init) {
+  const int length = strlen(szVal);
+  if (pEnd - pBuffer < (init ? 0 : 1) + 2 + length + 1)
+    return pBuffer;
   if (!init)
     *pBuffer++ = '&';
   *pBuffer++ = key;
   *pBuffer++ = '=';
-  strcpy(pBuffer, szVal);
-  while (*pBuffer != '\0')
-    pBuffer++;
-    
-  return pBuffer;
+  memcpy(pBuffer, szVal, length + 1);
+  return pBuffer + length;
 }
 
-char* SerialControl::AddParam_P(char* pBuffer, char key, const char* szVal, boolean init) {
+char* SerialControl::AddParam_P(char* pBuffer, const char* pEnd, char key, const char* szVal, boolean init) {
+  const int length = strlen_P(szVal);
+  if (pEnd - pBuffer < (init ? 0 : 1) + 2 + length + 1)
+    return pBuffer;
   if (!init)
     *pBuffer++ = '&';
   *pBuffer++ = key;
   *pBuffer++ = '=';
   strcpy_P(pBuffer, szVal);
-  while (*pBuffer != '\0')
-    pBuffer++;
-    
-  return pBuffer;
+  return pBuffer + length;
 }
 
 const char STOPPED_STR[] PROGMEM = "stopped";
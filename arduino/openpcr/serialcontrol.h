@@ -24,6 +24,14 @@
 #define START_CODE    0xFF
 #define ESCAPE_CODE   0xFE
 
+//start code, length low and high byte, type: the packet header on the
+//wire, which sizeof(PCPPacket) need not match
+#define PACKET_HEADER_LENGTH 4
+
+#define BAUD_RATE         4800
+#define TX_BUFFER_SIZE    128 //power of two, holds a status response
+#define UART_BUFFER_SIZE  64  //bytes the Arduino core queues without blocking
+
 class Display;
 class ProgramComponent;
 class Cycle;
@@ -31,11 +39,45 @@ class Step;
 struct SCommand;
 
 typedef enum {
-    SEND_CMD       = 0x10,
-    STATUS_REQ     = 0x40,
-    STATUS_RESP    = 0x80
+    SEND_CMD          = 0x10,
+    LOG_REQ           = 0x20, //payload: first record (2 bytes, 0 the oldest), count
+    LOG_RESP          = 0x30, //payload: sequence number of the first record asked for (2 bytes), then records of LOG_RECORD_SIZE bytes
+    STATUS_REQ        = 0x40,
+    STATUS_FRAME_REQ  = 0x50, //answered with STATUS_FRAME_RESP instead of STATUS_RESP
+    STATUS_RESP       = 0x80,
+    STATUS_FRAME_RESP = 0x90  //payload: a status frame
 } PACKET_TYPE;
 
+//Status frame: the fields of a STATUS_RESP in a fixed binary layout,
+//little endian, for hosts that would rather not parse text.
+//  offset size
+//     0    1  STATUS_FRAME_VERSION
+//     1    2  id of the last command received
+//     3    1  program state, Thermocycler::ProgramState
+//     4    1  thermal state, Thermocycler::ThermalState
+//     5    2  lid temperature, 0.1 C
+//     7    2  plate temperature, 0.1 C
+//     9    1  display contrast
+//    10    4  elapsed s      (this and the fields below are 0
+//    14    4  remaining s     unless running or complete)
+//    18    2  cycles
+//    20    2  current cycle
+//    22   14  step name, NUL padded
+//version 2:
+//    36    1  PcrStatus of the last command, ESuccess unless it was rejected
+//    37    1  cycles, most in use since start-up
+//    38    1  MAX_CYCLES
+//    39    1  steps, most in use since start-up
+//    40    1  MAX_STEPS
+//    41    1  steps in one cycle, most since start-up
+//    42    1  MAX_CYCLE_ITEMS
+//version 3:
+//    43    4  margin of the remaining s, about two standard deviations;
+//             0 unless running
+//A new version only appends fields, so hosts read the ones they know.
+#define STATUS_FRAME_VERSION 3
+#define STATUS_FRAME_SIZE    47
+
 struct PCPPacket {
   PCPPacket(PACKET_TYPE type)
   : startCode(START_CODE)
@@ -59,20 +101,34 @@ public:
   
 private:
   boolean ReadPacket(); //returns true if bytes were read
+  void ReadByte(byte incomingByte);
   void ProcessPacket(byte* data, int datasize);
   void SendStatus();
+  void SendStatusFrame();
+  static byte* PutLittleEndian(byte* pBuffer, uint32_t val, int size);
+  void SendLog();
+  boolean SendPacket(PACKET_TYPE type, const char* pPayload, int payloadLength, int paddedLength);
+  void QueueTxByte(byte b);
+  void QueuePayloadByte(byte b);
+  static int CountEscapes(const byte* pPayload, int length);
+  void FlushTx();
+  int GetTxFree() const { return TX_BUFFER_SIZE - 1 - ((m_tx_head - m_tx_tail) & (TX_BUFFER_SIZE - 1)); }
 
-  char* AddParam(char* pBuffer, char key, int val, boolean init = false);  
-  char* AddParam(char* pBuffer, char key, unsigned long val, boolean init = false);
-  char* AddParam(char* pBuffer, char key, float val, int decimalDigits, boolean pad, boolean init = false);
-  char* AddParam(char* pBuffer, char key, const char* szVal, boolean init = false);
-  char* AddParam_P(char* pBuffer, char key, const char* szVal, boolean init = false);
+  //These append key=value, after a '&' unless init, if it fits before
+  //pEnd with the terminator; if not they write nothing. Either way they
+  //return the end of what is in the buffer.
+  char* AddParam(char* pBuffer, const char* pEnd, char key, int val, boolean init = false);
+  char* AddParam(char* pBuffer, const char* pEnd, char key, unsigned long val, boolean init = false);
+  char* AddParam(char* pBuffer, const char* pEnd, char key, long fixedVal, int decimalDigits, boolean pad, boolean init = false);
+  char* AddParam(char* pBuffer, const char* pEnd, char key, const char* szVal, boolean init = false);
+  char* AddParam_P(char* pBuffer, const char* pEnd, char key, const char* szVal, boolean init = false);
   
   const char* GetProgramStateString_P(Thermocycler::ProgramState state);
   const char* GetThermalStateString_P(Thermocycler::ThermalState state);
   
 private:
-  byte buf[MAX_COMMAND_SIZE + 1]; //read or write buffer
+  byte buf[MAX_COMMAND_SIZE + 1]; //read buffer, header included
+  byte m_tx_buf[TX_BUFFER_SIZE];   //ring buffer of bytes waiting for the UART
   
   typedef enum
   {
@@ -85,10 +141,18 @@ private:
   PACKET_STATE packetState;
   uint8_t lastPacketSeq;
   uint16_t m_command_id;
+  uint8_t m_command_status; //PcrStatus of the last command
   uint16_t m_packet_len;
   uint16_t m_packet_real_len;
   bool bEscapeCodeFound;
   bool iReceivedStatusRequest;
+  bool m_log_request_pending; //waits for room in the transmit buffer
+  uint16_t m_log_first;
+  uint8_t m_log_count;
+  uint8_t m_tx_head;
+  uint8_t m_tx_tail;
+  uint8_t m_tx_credit; //bytes the UART can take without blocking
+  unsigned long m_tx_credit_time_ms;
   
   Display* m_display;
 };
@@ -0,0 +1,136 @@
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wattributes"
+#include <Arduino.h>
+#pragma GCC diagnostic pop
+
+#include "temperaturelog.h"
+#include "fixedformat.h"
+
+TemperatureLog::TemperatureLog()
+  : m_first_block(0),
+    m_current_block(0),
+    m_first_sequence(0),
+    m_last(),
+    m_interval_s(LOG_INTERVAL_S),
+    m_start_time_ms(0),
+    m_next_sample_ms(0)
+{
+  Clear(0);
+}
+
+void TemperatureLog::Clear(const unsigned long startTimeMs)
+{
+  m_first_sequence += GetNumRecords();
+  for (int i = 0; i < LOG_BLOCKS; i++)
+    m_blocks[i].count = 0;
+  m_first_block = 0;
+  m_current_block = 0;
+  m_start_time_ms = startTimeMs;
+  m_next_sample_ms = startTimeMs;
+}
+
+void TemperatureLog::SetIntervalS(const uint8_t intervalS)
+{
+  if (intervalS > 0)
+    m_interval_s = intervalS;
+}
+
+void TemperatureLog::Update(const unsigned long timeMs, const double plateTemp, const double lidTemp, const double targetTemp, const int drivePct)
+{
+  if ((long)(timeMs - m_next_sample_ms) < 0)
+    return;
+
+  LogRecord record;
+  record.timeS = (m_next_sample_ms - m_start_time_ms) / 1000;
+  record.plateDeciC = ToDeciC(plateTemp);
+  record.lidDeciC = ToDeciC(lidTemp);
+  record.targetDeciC = ToDeciC(targetTemp);
+  record.drivePct = drivePct < -100 ? -100 : drivePct > 100 ? 100 : drivePct;
+  Add(record);
+
+  //stay on the grid, skipping samples the loop was too late for
+  do {
+    m_next_sample_ms += m_interval_s * 1000UL;
+  } while ((long)(timeMs - m_next_sample_ms) >= 0);
+}
+
+void TemperatureLog::Add(const LogRecord& record)
+{
+  Block* pBlock = &m_blocks[m_current_block];
+  const int16_t deltas[3] = {
+    (int16_t)(record.plateDeciC - m_last.plateDeciC),
+    (int16_t)(record.lidDeciC - m_last.lidDeciC),
+    (int16_t)(record.targetDeciC - m_last.targetDeciC)
+  };
+  bool fits = pBlock->count > 0 && pBlock->count < LOG_RECORDS_PER_BLOCK
+    && pBlock->intervalS == m_interval_s
+    && record.timeS == m_last.timeS + m_interval_s;
+  for (int i = 0; i < 3 && fits; i++)
+    fits = deltas[i] >= -128 && deltas[i] <= 127;
+
+  if (fits) {
+    for (int i = 0; i < 3; i++)
+      pBlock->deltas[pBlock->count - 1][i] = deltas[i];
+    pBlock->drivePct[pBlock->count - 1] = record.drivePct;
+    pBlock->count++;
+  } else {
+    //start a new block, dropping the oldest if all are in use
+    if (pBlock->count > 0) {
+      m_current_block = (m_current_block + 1) % LOG_BLOCKS;
+      pBlock = &m_blocks[m_current_block];
+      if (m_current_block == m_first_block) {
+        m_first_sequence += pBlock->count;
+        m_first_block = (m_first_block + 1) % LOG_BLOCKS;
+      }
+    }
+    pBlock->count = 1;
+    pBlock->intervalS = m_interval_s;
+    pBlock->key = record;
+  }
+  m_last = record;
+}
+
+int TemperatureLog::GetNumRecords() const
+{
+  int count = 0;
+  for (int i = 0; i < LOG_BLOCKS; i++)
+    count += m_blocks[i].count;
+  return count;
+}
+
+bool TemperatureLog::GetRecord(int index, LogRecord& record) const
+{
+  if (index < 0)
+    return false;
+
+  for (int i = 0; i < LOG_BLOCKS; i++) {
+    const Block& block = m_blocks[(m_first_block + i) % LOG_BLOCKS];
+    if (index >= block.count) {
+      index -= block.count;
+      continue;
+    }
+
+    record = block.key;
+    for (int j = 0; j < index; j++) {
+      record.timeS += block.intervalS;
+      record.plateDeciC += block.deltas[j][0];
+      record.lidDeciC += block.deltas[j][1];
+      record.targetDeciC += block.deltas[j][2];
+    }
+    if (index > 0)
+      record.drivePct = block.drivePct[index - 1];
+    return true;
+  }
+  return false;
+}
+
+void TemperatureLog::EncodeRecord(const LogRecord& record, uint8_t* pBuffer)
+{
+  //little endian, as the bridge reads it
+  const uint16_t fields[4] = { record.timeS, (uint16_t)record.plateDeciC, (uint16_t)record.lidDeciC, (uint16_t)record.targetDeciC };
+  for (int i = 0; i < 4; i++) {
+    *pBuffer++ = fields[i] & 0xff;
+    *pBuffer++ = fields[i] >> 8;
+  }
+  *pBuffer = (uint8_t)record.drivePct;
+}
@@ -0,0 +1,75 @@
+#ifndef TEMPERATURELOG_H
+#define TEMPERATURELOG_H
+
+#include <stdint.h>
+
+//Recent history of a run, sampled at a fixed interval while a program
+//runs. Records are grouped in blocks: the first record of a block is
+//stored in full, the others hold the temperatures as 8-bit differences
+//from the one before. A difference that does not fit starts a new block.
+//The Peltier drive swings too much between samples for differences to
+//help, so every record has it in whole percent. The oldest block is
+//overwritten when all are in use, so the log keeps the latest
+//LOG_BLOCKS * LOG_RECORDS_PER_BLOCK samples at most.
+
+#define LOG_BLOCKS             6
+#define LOG_RECORDS_PER_BLOCK  8
+#define LOG_INTERVAL_S         10 //default, a cfg command with i=<seconds> changes it
+
+//One sample, as sent to the USB bridge in a LOG_RESP packet
+struct LogRecord {
+  uint16_t timeS;      //since the program was started
+  int16_t plateDeciC;
+  int16_t lidDeciC;
+  int16_t targetDeciC; //plate setpoint
+  int8_t drivePct;     //Peltier drive, negative when cooling
+};
+
+#define LOG_RECORD_SIZE 9 //bytes of a LogRecord on the wire
+
+class TemperatureLog {
+public:
+  TemperatureLog();
+
+  //Forget all records; times count from startTimeMs
+  void Clear(const unsigned long startTimeMs);
+
+  //Seconds between samples, 1 to 255. Takes effect with a new block.
+  void SetIntervalS(const uint8_t intervalS);
+  uint8_t GetIntervalS() const { return m_interval_s; }
+
+  //Add a record if the next sample is due at timeMs
+  void Update(const unsigned long timeMs, const double plateTemp, const double lidTemp, const double targetTemp, const int drivePct);
+
+  int GetNumRecords() const;
+  //index 0 is the oldest; false if there is no such record
+  bool GetRecord(const int index, LogRecord& record) const;
+  //Sequence number of the oldest record. Records are numbered in the order
+  //they are added, across Clear too, so a record keeps its number while
+  //older ones are dropped.
+  uint16_t GetFirstSequence() const { return m_first_sequence; }
+
+  static void EncodeRecord(const LogRecord& record, uint8_t* pBuffer);
+
+private:
+  struct Block {
+    uint8_t count; //records, the key included; 0 for an unused block
+    uint8_t intervalS;
+    LogRecord key;
+    int8_t deltas[LOG_RECORDS_PER_BLOCK - 1][3]; //plate, lid, target
+    int8_t drivePct[LOG_RECORDS_PER_BLOCK - 1];
+  };
+
+  void Add(const LogRecord& record);
+
+  Block m_blocks[LOG_BLOCKS];
+  uint8_t m_first_block;   //oldest
+  uint8_t m_current_block; //being filled
+  uint16_t m_first_sequence;
+  LogRecord m_last;        //latest record, what the next delta is taken from
+  uint8_t m_interval_s;
+  unsigned long m_start_time_ms;
+  unsigned long m_next_sample_ms;
+};
+
+#endif // TEMPERATURELOG_H
@@ -21,7 +21,7 @@
 #include "thermistors.h"
 
 // lid resistance table, in Ohms
-const int LID_RESISTANCE_TABLE[] = {
+const unsigned int LID_RESISTANCE_TABLE[] PROGMEM = {
   32919, 31270, 29715, 28246, 26858, 25547, 24307, 23135, 22026, 20977,
   19987, 19044, 18154, 17310, 16510, 15752, 15034, 14352, 13705, 13090,
   12507, 11953, 11427, 10927, 10452, 10000, 9570, 9161, 8771, 8401,
@@ -35,9 +35,11 @@ const int LID_RESISTANCE_TABLE[] = {
   653, 635, 616, 599, 582, 565, 550, 534, 519, 505,
   491, 478, 465, 452, 440, 428, 416, 405, 395, 384,
   374, 364, 355, 345, 337 };
+const int LID_RESISTANCE_TABLE_SIZE = sizeof(LID_RESISTANCE_TABLE) / sizeof(LID_RESISTANCE_TABLE[0]);
+const int LID_RESISTANCE_TABLE_START_TEMP = 0;
 
 // plate resistance table, in 0.1 Ohms
-const int PLATE_RESISTANCE_TABLE[] =
+const unsigned long PLATE_RESISTANCE_TABLE[] PROGMEM =
 {
   3364790, 3149040, 2948480, 2761940, 2588380, 2426810, 2276320,
 2136100, 2005390, 1883490,
@@ -60,6 +62,8 @@ const int PLATE_RESISTANCE_TABLE[] =
   12550, 12150, 11770, 11400, 11040, 10700, 10370, 10050, 9738, 9441,
   9155, 8878, 8612, 8354, 8106, 7866, 7635, 7412, 7196, 6987, 6786,
   6591, 6403, 6222, 6046, 5876 };
+const int PLATE_RESISTANCE_TABLE_SIZE = sizeof(PLATE_RESISTANCE_TABLE) / sizeof(PLATE_RESISTANCE_TABLE[0]);
+const int PLATE_RESISTANCE_TABLE_START_TEMP = -40;
 
 #pragma GCC diagnostic pop
 
@@ -70,60 +74,52 @@ const int PLATE_RESISTANCE_TABLE[] =
 //const int SPICLOCK  = 13; //sck, NEVER USED
 #define SLAVESELECT 10//ss
 
-double TableLookup(
-  const int lookupTable[],
-  const int sz,
-  const int startValue,
-  const int searchValue)
-{
-  //simple linear search for now
-  int i = 0;
-  for (i = 0; i != sz; ++i)
-  {
-    //if (searchValue >= pgm_read_dword_near(lookupTable + i))
-    if (searchValue >= lookupTable[i])
-      break;
-  }
+static unsigned long ReadTableEntry(const unsigned int lookupTable[], const int i) {
+  return pgm_read_word_near(lookupTable + i);
+}
 
-  const int high_val = lookupTable[i ==  0 ? i : i - 1];
-  const int low_val  = lookupTable[i  < sz ? i : i - 1];
-  const double temperature
-    = static_cast<double>(i + startValue)
-    - (static_cast<double>(searchValue - low_val) /
-static_cast<double>(high_val - low_val));
-  return temperature;
+static unsigned long ReadTableEntry(const unsigned long lookupTable[], const int i) {
+  return pgm_read_dword_near(lookupTable + i);
 }
 
-/*
-float TableLookup(
-  const unsigned int lookupTable[],
-  unsigned int tableSize,
-  int startValue,
-  unsigned long searchValue)
+//Converts a resistance to a temperature in 0.01 C. The table holds one
+//descending resistance per degree, starting at startValue; between two
+//entries the temperature is interpolated linearly.
+template <class T>
+int TableLookup(
+  const T lookupTable[],
+  const int sz,
+  const int startValue,
+  const unsigned long searchValue)
 {
-  //simple linear search for now
-  int i = 0;
-  for (i = 0; i != tableSize; ++i)
-  {
-    if (searchValue >= lookupTable[i]) break;
-    //if (searchValue >= pgm_read_word_near(lookupTable + i))
+  //clamp to the ends of the table
+  if (searchValue >= ReadTableEntry(lookupTable, 0))
+    return startValue * 100;
+  if (searchValue <= ReadTableEntry(lookupTable, sz - 1))
+    return (startValue + sz - 1) * 100;
+
+  //binary search for the first entry at or below searchValue
+  int low = 1;
+  int high = sz - 1;
+  while (low < high) {
+    const int mid = (low + high) / 2;
+    if (ReadTableEntry(lookupTable, mid) <= searchValue)
+      high = mid;
+    else
+      low = mid + 1;
   }
 
-  if (i > 0) {
-    unsigned long high_val = pgm_read_word_near(lookupTable + i - 1);
-    unsigned long low_val = pgm_read_word_near(lookupTable + i);
-    return i + startValue - (float)(searchValue - low_val) /
-(float)(high_val - low_val);
-  } else {
-    return startValue;
-  }
+  const unsigned long high_val = ReadTableEntry(lookupTable, low - 1);
+  const unsigned long low_val = ReadTableEntry(lookupTable, low);
+  return (low + startValue) * 100
+    - (int)((searchValue - low_val) * 100 / (high_val - low_val));
 }
-*/
 
 ////////////////////////////////////////////////////////////////////
 // Class CLidThermistor
 CLidThermistor::CLidThermistor(const int pin_lid_thermistor)
   : iTemp(0.0),
+    iTempCentiC(0),
     m_pin_lid_thermistor(pin_lid_thermistor)
 {
   Assert(m_pin_lid_thermistor >= 0 && "An Arduino pin number is zero at least");
@@ -131,18 +127,20 @@ CLidThermistor::CLidThermistor(const int pin_lid_thermistor)
 }
 //------------------------------------------------------------------------------
 void CLidThermistor::ReadTemp() {
-  unsigned long voltage_mv = (unsigned
-long)analogRead(m_pin_lid_thermistor) * 5000 / 1024;
-  unsigned long resistance = voltage_mv * 2200 / (5000 - voltage_mv);
-  iTemp = TableLookup(LID_RESISTANCE_TABLE,
-sizeof(LID_RESISTANCE_TABLE) / sizeof(LID_RESISTANCE_TABLE[0]), 0,
-resistance);
+  //2.2k over the thermistor, 10-bit ADC
+  const unsigned long adc = analogRead(m_pin_lid_thermistor);
+  const unsigned long resistance = adc * 2200 / (1024 - adc);
+  iTempCentiC = TableLookup(LID_RESISTANCE_TABLE, LID_RESISTANCE_TABLE_SIZE,
+    LID_RESISTANCE_TABLE_START_TEMP, resistance);
+  iTemp = iTempCentiC * 0.01;
 }
 
 ////////////////////////////////////////////////////////////////////
 // Class CPlateThermistor
 CPlateThermistor::CPlateThermistor(const int pin_plate_thermistor)
-  : iTemp(0.0),
+  : iAcquisitionState(ESelectAdc),
+    iTemp(0.0),
+    iTempCentiC(0),
     m_pin_plate_thermistor(pin_plate_thermistor)
 {
 
@@ -154,16 +152,28 @@ CPlateThermistor::CPlateThermistor(const int pin_plate_thermistor)
   digitalWrite(SLAVESELECT,HIGH); //disable device
 }
 //------------------------------------------------------------------------------
-void CPlateThermistor::ReadTemp() {
-  digitalWrite(SLAVESELECT, LOW);
-
-  //read data
-  while(digitalRead(m_pin_plate_thermistor)) {}
-
+bool CPlateThermistor::Poll() {
+  switch (iAcquisitionState) {
+  case ESelectAdc:
+    //the ready line is only driven while the ADC is selected
+    digitalWrite(SLAVESELECT, LOW);
+    iAcquisitionState = EWaitForConversion;
+    return false;
+
+  case EWaitForConversion:
+    if (digitalRead(m_pin_plate_thermistor))
+      return false; //conversion still in progress
+    ReadConversion();
+    iAcquisitionState = ESelectAdc;
+    return true;
+  }
+  return false;
+}
+//------------------------------------------------------------------------------
+void CPlateThermistor::ReadConversion() {
   uint8_t spiBuf[4];
   memset(spiBuf, 0, sizeof(spiBuf));
 
-  digitalWrite(SLAVESELECT, LOW);
   for(int i = 0; i < 4; i++)
     spiBuf[i] = SPITransfer(0xFF);
 
@@ -172,19 +182,16 @@ void CPlateThermistor::ReadTemp() {
     + (((unsigned long)spiBuf[0] & 0x1F) << 17);
   //((spiBuf[0] & 0x1F) << 16) + (spiBuf[1] << 8) + spiBuf[2];
 
-  unsigned long adcDivisor = 0x1FFFFF;
-  float voltage = (float)conv * 5.0 / adcDivisor;
-
-  //unsigned int convHigh = (conv >> 16);
-
   digitalWrite(SLAVESELECT, HIGH);
 
-  unsigned long voltage_mv = voltage * 1000;
-  unsigned long resistance = voltage_mv * 22000 / (5000 - voltage_mv);
-  // in hecto ohms
+  //2.2k over the thermistor, resistance in 0.1 Ohm. The top 16 bits of the
+  //conversion keep the product within 32 bits at ~0.002 C resolution.
+  const unsigned long conv16 = conv >> 5;
+  const unsigned long resistance = conv16 < 0xFFFF ? 22000 * conv16 / (0xFFFF - conv16) : 0xFFFFFFFFUL;
 
-  iTemp = TableLookup(PLATE_RESISTANCE_TABLE,
-  sizeof(PLATE_RESISTANCE_TABLE) / sizeof(PLATE_RESISTANCE_TABLE[0]),-40, resistance);
+  iTempCentiC = TableLookup(PLATE_RESISTANCE_TABLE, PLATE_RESISTANCE_TABLE_SIZE,
+    PLATE_RESISTANCE_TABLE_START_TEMP, resistance);
+  iTemp = iTempCentiC * 0.01;
 }
 //------------------------------------------------------------------------------
 char CPlateThermistor::SPITransfer(volatile char data) {
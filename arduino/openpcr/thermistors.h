@@ -19,14 +19,18 @@
 #ifndef _LID_THERMISTOR_H_
 #define _LID_THERMISTOR_H_
 
+#include <avr/pgmspace.h>
+
 class CLidThermistor {
 public:
   CLidThermistor(const int pin_lid_thermistor);
   double& GetTemp() { return iTemp; }
+  int GetTempCentiC() const { return iTempCentiC; } //in 0.01 C
   void ReadTemp();
   
 private:
   double iTemp;
+  int iTempCentiC;
 
   //static const int ms_pin_lid_thermistor;
   const int m_pin_lid_thermistor;
@@ -36,15 +40,37 @@ class CPlateThermistor {
 public:
   CPlateThermistor(const int pin_plate_thermistor);
   double& GetTemp() { return iTemp; }
-  void ReadTemp();
+  int GetTempCentiC() const { return iTempCentiC; } //in 0.01 C
+
+  //Non-blocking read, to be called every loop: selects the ADC, checks its
+  //conversion-ready line and reads the result out once it is low. Returns
+  //true when a new temperature is available.
+  bool Poll();
 private:
    char SPITransfer(volatile char data);
+   void ReadConversion();
    
 private:
+  enum AcquisitionState {
+    ESelectAdc,
+    EWaitForConversion
+  };
+
+  AcquisitionState iAcquisitionState;
   double iTemp;
+  int iTempCentiC;
   const int m_pin_plate_thermistor;
 };
 
 double TermistorValueToTemperature(const int value);
 
+//resistance tables in program memory, one entry per degree C starting at
+//the start temperature
+extern const unsigned int LID_RESISTANCE_TABLE[] PROGMEM;
+extern const int LID_RESISTANCE_TABLE_SIZE;
+extern const int LID_RESISTANCE_TABLE_START_TEMP;
+extern const unsigned long PLATE_RESISTANCE_TABLE[] PROGMEM;
+extern const int PLATE_RESISTANCE_TABLE_SIZE;
+extern const int PLATE_RESISTANCE_TABLE_START_TEMP;
+
 #endif
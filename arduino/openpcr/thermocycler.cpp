@@ -25,11 +25,11 @@
 
 #include "arduinotrace.h"
 #include "arduinoassert.h"
+#include "controlscheduler.h"
 #include "display.h"
 #include "displayparameters.h"
 #include "program.h"
 #include "serialcontrol.h"
-#include "../Wire/Wire.h"
 
 
 //constants
@@ -42,6 +42,8 @@
 
 #define CYCLE_START_TOLERANCE 0.2
 #define LID_START_TOLERANCE 1.0
+#define ETA_UPDATE_INTERVAL_MS 1000
+#define PROGRESS_STORE_INTERVAL_MS 60000 //during a hold
 
 #define PLATE_PID_INC_NORM_P 1000
 #define PLATE_PID_INC_NORM_I 250
@@ -76,13 +78,16 @@
 
 #define STARTUP_DELAY 4000
 
+//a little longer than a plate ADC conversion, so each period has a new reading
+#define CONTROL_PERIOD_MS 150
+
 //const int Thermocycler::m_pin_block_thermistor = A4;
 //const int Thermocycler::m_pin_heater_lid = 3;
 //const int Thermocycler::m_pin_peltier_a = 2;
 //const int Thermocycler::m_pin_peltier_b = 4;
 //pid parameters
 const SPIDTuning LID_PID_GAIN_SCHEDULE[] = {
-  //maxTemp, kP, kI, kD
+  //maxTemp, kP, kI, kD; the last maxTemp is MAX_LID_TEMP, which commands cannot exceed
   { 70, 40, 0.15, 60 },
   { 200, 80, 1.1, 10 }
 };
@@ -101,9 +106,11 @@ Thermocycler::Thermocycler(
     m_current_step(NULL),
     m_cycle_start_time(0),
     m_display(Display::GetInstance(display_parameters)),
-    m_display_cycle(NULL),
+    m_estimated_time_remaining_sec(0),
+    m_eta_margin_sec(0),
     m_is_ramping(true),
     m_is_restarted(is_restarted),
+    m_is_resuming(false),
     m_lid_pid(LID_PID_GAIN_SCHEDULE, MIN_LID_PWM, MAX_LID_PWM),
     m_lid_thermistor(pin_lid_thermistor),
     m_peltier_pwm(0.0),
@@ -114,14 +121,16 @@ Thermocycler::Thermocycler(
     m_plate_pid(NULL),
     m_plate_thermistor(pin_plate_thermistor),
     m_previous_step(NULL),
-    m_program(NULL),
     m_program_state(EStartup),
     m_serial_control(NULL),
     m_target_lid_temp(0),
-    m_thermal_direction(OFF)
+    m_thermal_direction(OFF),
+    m_next_eta_update_ms(0),
+    m_next_progress_store_ms(0),
+    m_resumed_hold_ms(0)
 {
   Trace("Thermocycler::Thermocycler");
-  m_plate_pid = new PID(
+  m_plate_pid = new PlatePID(
     &m_plate_thermistor.GetTemp(),
     &m_peltier_pwm,
     &m_target_plate_temp,
@@ -145,26 +154,29 @@ Thermocycler::Thermocycler(
   // Peltier PWM
   TCCR1A |= (1<<WGM11) | (1<<WGM10);
   TCCR1B = _BV(CS21);
+  StartControlScheduler(CONTROL_PERIOD_MS);
   
   // Lid PWM
   TCCR2A = _BV(COM2A1) | _BV(COM2B1) | _BV(WGM21) | _BV(WGM20);
   TCCR2B = _BV(CS22);
 
   m_program_name[0] = '\0';
+  m_eta.Load();
 
   Step * const step = new Step;
+  step->Reset();
   step->SetName("StapEen");
   step->SetTemp(950.0);
   step->SetRampDurationS(10);
   step->SetStepDurationS(20);
   Cycle * const program = new Cycle;
+  program->Reset();
   program->AddComponent(step);
   program->SetNumCycles(100);
-  Cycle * const display_cycle = new Cycle;
-  display_cycle->SetNumCycles(100);
   const char * const program_name = "BurnBurnBurn!";
   const int lid_temperature = 950;
-  this->SetProgram(program,display_cycle,program_name,lid_temperature);
+  this->SetProgram(program,program_name,lid_temperature);
+  m_program_state = EStartup; //SetProgram stops, as for any program
 
 }
 
@@ -177,12 +189,19 @@ Thermocycler::~Thermocycler()
 // accessors
 int Thermocycler::GetNumCycles()
 {
-  return m_display_cycle->GetNumCycles();
+  if (m_schedule.IsEmpty())
+    return 0;
+  return m_schedule.GetLoop(m_schedule.GetDisplayLoop()).numCycles;
 }
 
 int Thermocycler::GetCurrentCycleNum() {
-  int numCycles = GetNumCycles();
-  return m_display_cycle->GetCurrentCycle() > numCycles ? numCycles : m_display_cycle->GetCurrentCycle();
+  //1 until the display loop starts, all of them once it is done
+  const int displayLoop = m_schedule.GetDisplayLoop();
+  if (m_schedule.GetCurrentLoop() < displayLoop)
+    return 1;
+  else if (m_schedule.GetCurrentLoop() > displayLoop)
+    return GetNumCycles();
+  return m_schedule.GetCurrentCycle() + 1;
 }
 
 Thermocycler::ThermalState Thermocycler::GetThermalState() {
@@ -200,59 +219,75 @@ Thermocycler::ThermalState Thermocycler::GetThermalState() {
   }
 }
  
-void Thermocycler::SetProgram(
+PcrStatus Thermocycler::SetProgram(
   Cycle* pProgram,
-  Cycle* pDisplayCycle,
   const char* szProgName,
   int lidTemp)
 {
   Stop();
 
-  m_program = pProgram;
-  m_display_cycle = pDisplayCycle;
-
   strcpy(m_program_name, szProgName);
   m_target_lid_temp = lidTemp;
+
+  const PcrStatus status = m_schedule.Compile(pProgram);
+  if (!SUCCEEDED(status))
+    m_schedule.Clear();
+  return status;
 }
 
 void Thermocycler::Stop() {
   m_program_state = EStopped;
   
-  m_program = NULL;
+  m_schedule.Clear();
   m_previous_step = NULL;
   m_current_step = NULL;
   
   m_step_pool.ResetPool();
   m_cycle_pool.ResetPool();
+  m_is_resuming = false;
+  m_resumed_hold_ms = 0;
   
   m_display->Clear();
 }
 
 PcrStatus Thermocycler::Start() {
-  if (m_program == NULL)
+  if (m_schedule.IsEmpty())
     return ENoProgram;
   
   //advance to lid wait state
   m_program_state = ELidWait;
+  m_temperature_log.Clear(GetTimeMs());
   
   return ESuccess;
 }
     
 void Thermocycler::Loop()
 {
+  //lid and plate control run at a fixed rate, the rest in the time left
+  if (IsControlDue()) {
+    //lid
+    m_lid_thermistor.ReadTemp();
+    ControlLid();
+
+    //plate, on the latest conversion
+    CalcPlateTarget();
+    ControlPeltier();
+  }
+
+  m_plate_thermistor.Poll();
+
   switch (m_program_state)
   {
     case EStartup:
-    if (millis() > STARTUP_DELAY) {
+    if (GetTimeMs() > STARTUP_DELAY) {
       m_program_state = EStopped;
       
-      //if (!m_is_restarted && !m_serial_control->CommandReceived())
-      {
-        //check for stored program
-        //SCommand command;
-        //if (ProgramStore::RetrieveProgram(command, (char*)m_serial_control->GetBuffer()))
-        //  ProcessCommand(command);
-      }
+      //a reset other than at power-on, as by a brown-out, resumes the run
+      //it cut short; after power-on it is unknown how long the unit was off
+      if (m_is_restarted)
+        Resume();
+      else
+        ProgramStore::Clear();
     }
     break;
 
@@ -263,11 +298,20 @@ void Thermocycler::Loop()
       m_peltier_pwm = 0;
       PreprocessProgram();
       m_program_state = ERunning;
+      m_program_start_time_ms = GetTimeMs();
       
-      m_program->BeginIteration();
-      AdvanceToNextStep();
-      
-      m_program_start_time_ms = millis();
+      if (m_is_resuming) {
+        //back to the step it was in, ramping to it as the plate will have drifted
+        m_is_resuming = false;
+        m_program_start_time_ms -= m_resume_progress.elapsedS * 1000;
+        m_resumed_hold_ms = m_resume_progress.heldS * 1000UL;
+        m_previous_step = NULL;
+        m_current_step = m_schedule.Seek(m_resume_progress.step, m_resume_progress.cycle);
+        BeginStep();
+      } else {
+        m_schedule.Begin();
+        AdvanceToNextStep();
+      }
     }
     break;
   
@@ -277,25 +321,30 @@ void Thermocycler::Loop()
       if (m_is_ramping && abs(m_current_step->GetTemp() - GetPlateTemp()) <= CYCLE_START_TOLERANCE && GetRampElapsedTimeMs() > m_current_step->GetRampDurationS() * 1000) {
         //begin step hold
         
-        //eta updates
-        if (m_current_step->GetRampDurationS() == 0) {
-          //fast ramp
-          m_elapsed_fast_ramp_degrees += fabs(GetPlateTemp() - m_ramp_start_temp);
-          m_total_elapsed_fast_ramp_duration_ms += millis() - m_ramp_start_time;
-        }
+        //learn how fast the plate ramps
+        if (m_current_step->GetRampDurationS() == 0)
+          m_eta.AddRamp(m_ramp_start_temp, GetPlateTemp(), GetRampElapsedTimeMs());
         
-        if (m_ramp_start_temp > GetPlateTemp())
-          m_has_cooled = true;
         m_is_ramping = false;
-        m_cycle_start_time = millis();
+        m_cycle_start_time = GetTimeMs() - m_resumed_hold_ms;
+        m_resumed_hold_ms = 0;
+        m_next_progress_store_ms = GetTimeMs() + PROGRESS_STORE_INTERVAL_MS;
         
-      } else if (!m_is_ramping && !m_current_step->IsFinal() && millis() - m_cycle_start_time > (unsigned long)m_current_step->GetStepDurationS() * 1000) {
+      } else if (!m_is_ramping && !m_current_step->IsFinal() && GetTimeMs() - m_cycle_start_time > (unsigned long)m_current_step->GetStepDurationS() * 1000) {
         //begin next step
         AdvanceToNextStep();
           
         //check for program completion
-        if (m_current_step == NULL || m_current_step->IsFinal())
+        if (m_current_step == NULL || m_current_step->IsFinal()) {
           m_program_state = EComplete;
+          m_estimated_time_remaining_sec = 0;
+          m_eta_margin_sec = 0;
+          m_eta.Save();
+          ProgramStore::Clear();
+        }
+      } else if (!m_is_ramping && (long)(GetTimeMs() - m_next_progress_store_ms) >= 0) {
+        //so a reset does not repeat much of a long hold
+        StoreProgress();
       }
     }
     break;
@@ -310,39 +359,73 @@ void Thermocycler::Loop()
     break;
   }
   
-  //lid 
-  m_lid_thermistor.ReadTemp();
-  ControlLid();
-  
-  //plate  
-  m_plate_thermistor.ReadTemp();
-  CalcPlateTarget();
-  ControlPeltier();
-  
+  if (m_program_state == ELidWait || m_program_state == ERunning)
+    m_temperature_log.Update(GetTimeMs(), GetPlateTemp(), GetLidTemp(), m_target_plate_temp, (int)(m_peltier_pwm * 100 / MAX_PELTIER_PWM));
+
   //program
   UpdateEta();
   m_display->Update();
   m_serial_control->Process();
+  ProgramStore::Task();
+  m_eta.Task();
 }
 
 //private
 void Thermocycler::AdvanceToNextStep() {
   m_previous_step = m_current_step;
-  m_current_step = m_program->GetNextStep();
-  if (m_current_step == NULL)
-    return;
-  
+  m_current_step = m_schedule.Advance();
+  if (m_current_step != NULL)
+    BeginStep();
+}
+
+void Thermocycler::BeginStep() {
   //update eta calc params
   if (m_previous_step == NULL || m_previous_step->GetTemp() != m_current_step->GetTemp()) {
     m_is_ramping = true;
-    m_ramp_start_time = millis();
+    m_ramp_start_time = GetTimeMs();
     m_ramp_start_temp = GetPlateTemp();
   } else {
-    m_cycle_start_time = millis(); //next step starts immediately
+    m_cycle_start_time = GetTimeMs(); //next step starts immediately
   }
   
   CalcPlateTarget();
   SetPlateControlStrategy();
+  if (!m_current_step->IsFinal())
+    StoreProgress();
+}
+
+void Thermocycler::StoreProgress() {
+  RunProgress progress;
+  progress.step = m_schedule.GetCurrentStepIndex();
+  progress.cycle = m_schedule.GetCurrentCycle();
+  progress.heldS = m_is_ramping ? 0 : (GetTimeMs() - m_cycle_start_time) / 1000;
+  progress.elapsedS = GetElapsedTimeS();
+  ProgramStore::StoreProgress(progress);
+  m_next_progress_store_ms = GetTimeMs() + PROGRESS_STORE_INTERVAL_MS;
+}
+
+//Resume takes up the run in ProgramStore, if there is one: the program
+//waits for the lid again, then goes on from the step it was in.
+void Thermocycler::Resume() {
+  RunProgress progress;
+  if (!ProgramStore::RetrieveProgress(progress))
+    return;
+
+  Stop(); //frees the pools the program is rebuilt in
+  Cycle* pProgram;
+  char szName[sizeof(m_program_name)];
+  int lidTemp;
+  if (!ProgramStore::RetrieveProgram(pProgram, szName, lidTemp) || !SUCCEEDED(SetProgram(pProgram, szName, lidTemp))
+      || m_schedule.Seek(progress.step, progress.cycle) == NULL) {
+    Stop();
+    ProgramStore::Clear();
+    return;
+  }
+
+  m_schedule.Begin();
+  Start();
+  m_is_resuming = true;
+  m_resume_progress = progress;
 }
 
 void Thermocycler::SetPlateControlStrategy() {
@@ -438,57 +521,133 @@ void Thermocycler::ControlLid() {
   analogWrite(m_pin_heater_lid, drive);
 }
 
-//PreprocessProgram initializes ETA parameters and validates/modifies ramp conditions
+//PreprocessProgram validates/modifies ramp conditions. It works per loop
+//of the schedule: a step runs after the step before it, or for the first
+//step of a loop after the last step of the loop before and, if the loop
+//repeats, after the loop's own last step. The run ends at the first final
+//step.
 void Thermocycler::PreprocessProgram() {
-  Step* pCurrentStep;
-  Step* pPreviousStep = NULL;
-  
-  m_program_hold_duration_sec = 0;
   m_estimated_time_remaining_sec = 0;
-  m_has_cooled = false;
-  
-  m_program_controlled_ramp_duration_sec = 0;
-  m_program_fast_ramp_degrees = 0;
-  m_elapsed_fast_ramp_degrees = 0;
-  m_total_elapsed_fast_ramp_duration_ms = 0;
-  
-  m_program->BeginIteration();
-  while ((pCurrentStep = m_program->GetNextStep()) && !pCurrentStep->IsFinal()) {
-    //validate ramp
-    if (pPreviousStep != NULL && pCurrentStep->GetRampDurationS() * 1000 < fabs(pCurrentStep->GetTemp() - pPreviousStep->GetTemp()) * PLATE_FAST_RAMP_THRESHOLD_MS) {
-      //cannot ramp that fast, ignored set ramp
-      pCurrentStep->SetRampDurationS(0);
+  m_eta_margin_sec = 0;
+  m_next_eta_update_ms = GetTimeMs();
+
+  int endStep = 0;
+  while (endStep < m_schedule.GetNumSteps() && !m_schedule.GetStep(endStep)->IsFinal())
+    endStep++;
+
+  //validate ramps against every step that can come before them
+  Step* pPreviousStep = NULL; //last of the loop before
+  for (int i = 0; i < m_schedule.GetNumLoops() && m_schedule.GetLoop(i).firstStep < endStep; i++) {
+    const ScheduleLoop& loop = m_schedule.GetLoop(i);
+    const int loopEnd = loop.firstStep + loop.numSteps;
+    const bool repeats = loopEnd <= endStep && loop.numCycles > 1;
+    for (int j = loop.firstStep; j < loopEnd && j < endStep; j++) {
+      Step* pStep = m_schedule.GetStep(j);
+      if (j > loop.firstStep) {
+        ValidateRamp(pStep, m_schedule.GetStep(j - 1));
+      } else {
+        ValidateRamp(pStep, pPreviousStep);
+        if (repeats)
+          ValidateRamp(pStep, m_schedule.GetStep(loopEnd - 1));
+      }
+      pPreviousStep = pStep;
     }
-    
-    //update eta hold
-    m_program_hold_duration_sec += pCurrentStep->GetStepDurationS();
- 
-    //update eta ramp
-    if (pCurrentStep->GetRampDurationS() > 0) {
-      //controlled ramp
-      m_program_controlled_ramp_duration_sec += pCurrentStep->GetRampDurationS();
+  }
+}
+
+void Thermocycler::ValidateRamp(Step* pStep, const Step* pPreviousStep) {
+  if (pPreviousStep != NULL && pStep->GetRampDurationS() * 1000 < fabs(pStep->GetTemp() - pPreviousStep->GetTemp()) * PLATE_FAST_RAMP_THRESHOLD_MS) {
+    //cannot ramp that fast, ignored set ramp
+    pStep->SetRampDurationS(0);
+  }
+}
+
+//UpdateEta walks the schedule from the current step: holds and
+//controlled ramps take the time they are set to, fast ramps what the
+//estimator expects of them. A loop's remaining repeats are all alike, so
+//one is worked out and multiplied.
+void Thermocycler::UpdateEta() {
+  if (m_program_state != ERunning || m_current_step == NULL || (long)(GetTimeMs() - m_next_eta_update_ms) < 0)
+    return;
+  m_next_eta_update_ms = GetTimeMs() + ETA_UPDATE_INTERVAL_MS;
+
+  //the current step
+  double seconds = 0;
+  double sdSeconds = 0;
+  const unsigned long holdMs = (unsigned long)m_current_step->GetStepDurationS() * 1000;
+  if (m_is_ramping) {
+    if (InControlledRamp()) {
+      const unsigned long rampMs = (unsigned long)m_current_step->GetRampDurationS() * 1000;
+      if (GetRampElapsedTimeMs() < rampMs)
+        seconds += (rampMs - GetRampElapsedTimeMs()) / 1000.0;
     } else {
-      //fast ramp
-      double previousTemp = pPreviousStep ? pPreviousStep->GetTemp() : GetPlateTemp();
-      m_program_fast_ramp_degrees += fabs(previousTemp - pCurrentStep->GetTemp()) - CYCLE_START_TOLERANCE;
+      AddFastRampEta(GetPlateTemp(), m_current_step->GetTemp(), seconds, sdSeconds);
     }
-    
-    pPreviousStep = pCurrentStep;
+    seconds += (holdMs > m_resumed_hold_ms ? holdMs - m_resumed_hold_ms : 0) / 1000.0;
+  } else if (GetTimeMs() - m_cycle_start_time < holdMs) {
+    seconds += (holdMs - (GetTimeMs() - m_cycle_start_time)) / 1000.0;
   }
+
+  //the rest of the program
+  int loopIndex = m_schedule.GetCurrentLoop();
+  const ScheduleLoop* pLoop = &m_schedule.GetLoop(loopIndex);
+  int loopEnd = pLoop->firstStep + pLoop->numSteps;
+  unsigned int repeats = pLoop->numCycles - m_schedule.GetCurrentCycle() - 1;
+  bool isRunning = AddStepsEta(m_schedule.GetCurrentStepIndex() + 1, loopEnd, m_current_step->GetTemp(), seconds, sdSeconds);
+  while (isRunning) {
+    if (repeats > 0) {
+      double repeatSeconds = 0;
+      double repeatSdSeconds = 0;
+      isRunning = AddStepsEta(pLoop->firstStep, loopEnd, m_schedule.GetStep(loopEnd - 1)->GetTemp(), repeatSeconds, repeatSdSeconds);
+      if (!isRunning)
+        repeats = 1; //ends in the first repeat
+      seconds += repeatSeconds * repeats;
+      sdSeconds += repeatSdSeconds * repeats;
+    }
+    if (!isRunning || ++loopIndex == m_schedule.GetNumLoops())
+      break;
+
+    const double previousTemp = m_schedule.GetStep(loopEnd - 1)->GetTemp();
+    pLoop = &m_schedule.GetLoop(loopIndex);
+    loopEnd = pLoop->firstStep + pLoop->numSteps;
+    repeats = pLoop->numCycles - 1;
+    isRunning = AddStepsEta(pLoop->firstStep, loopEnd, previousTemp, seconds, sdSeconds);
+  }
+
+  m_estimated_time_remaining_sec = (unsigned long)(seconds + 0.5);
+  m_eta_margin_sec = (unsigned long)(2 * sdSeconds + 0.5);
 }
 
-void Thermocycler::UpdateEta() {
-  if (m_program_state == ERunning) {
-    double fastSecondPerDegree;
-    if (m_elapsed_fast_ramp_degrees == 0 || !m_has_cooled)
-      fastSecondPerDegree = 1.0;
-    else
-      fastSecondPerDegree = m_total_elapsed_fast_ramp_duration_ms / 1000 / m_elapsed_fast_ramp_degrees;
-      
-    unsigned long estimatedDurationS = m_program_hold_duration_sec + m_program_controlled_ramp_duration_sec + m_program_fast_ramp_degrees * fastSecondPerDegree;
-    unsigned long elapsedTimeS = GetElapsedTimeS();
-    m_estimated_time_remaining_sec = estimatedDurationS > elapsedTimeS ? estimatedDurationS - elapsedTimeS : 0;
+//Adds what steps firstStep to endStep - 1 take, run after a step at
+//fromTemp. False if the run ends at one of them.
+bool Thermocycler::AddStepsEta(int firstStep, int endStep, double fromTemp, double& seconds, double& sdSeconds) {
+  for (int i = firstStep; i < endStep; i++) {
+    Step* pStep = m_schedule.GetStep(i);
+    if (pStep->IsFinal())
+      return false;
+
+    if (pStep->GetTemp() != fromTemp) {
+      if (pStep->GetRampDurationS() > 0)
+        seconds += pStep->GetRampDurationS();
+      else
+        AddFastRampEta(fromTemp, pStep->GetTemp(), seconds, sdSeconds);
+    }
+    seconds += pStep->GetStepDurationS();
+    fromTemp = pStep->GetTemp();
   }
+  return true;
+}
+
+void Thermocycler::AddFastRampEta(double fromTemp, double toTemp, double& seconds, double& sdSeconds) {
+  //a ramp ends within CYCLE_START_TOLERANCE of its target
+  if (fabs(toTemp - fromTemp) <= CYCLE_START_TOLERANCE)
+    return;
+  const double endTemp = toTemp > fromTemp ? toTemp - CYCLE_START_TOLERANCE : toTemp + CYCLE_START_TOLERANCE;
+  double rampSeconds;
+  double rampSdSeconds;
+  m_eta.PredictRamp(fromTemp, endTemp, rampSeconds, rampSdSeconds);
+  seconds += rampSeconds;
+  sdSeconds += rampSdSeconds;
 }
 
 void Thermocycler::SetPeltier(ThermalDirection dir, int pwm) {
@@ -513,31 +672,23 @@ void Thermocycler::SetPeltier(ThermalDirection dir, int pwm) {
 
 void Thermocycler::ProcessCommand(SCommand& command) {
   if (command.command == SCommand::EStart) {
-    //find display cycle
-    Cycle* pProgram = command.pProgram;
-    Cycle* pDisplayCycle = pProgram;
-    int largestCycleCount = 0;
-    
-    for (int i = 0; i < pProgram->GetNumComponents(); i++) {
-      ProgramComponent* pComp = pProgram->GetComponent(i);
-      if (pComp->GetType() == ProgramComponent::ECycle) {
-        Cycle* pCycle = (Cycle*)pComp;
-        if (pCycle->GetNumCycles() > largestCycleCount) {
-          largestCycleCount = pCycle->GetNumCycles();
-          pDisplayCycle = pCycle;
-        }
-      }
+    if (SUCCEEDED(GetThermocycler().SetProgram(command.pProgram, command.name, command.lidTemp))
+        && SUCCEEDED(GetThermocycler().Start())) {
+      //from here a reset resumes the run, from the lid wait on
+      const RunProgress start = { 0, 0, 0, 0 };
+      if (ProgramStore::StoreProgram(m_schedule, m_program_name, m_target_lid_temp))
+        ProgramStore::StoreProgress(start);
     }
     
-    GetThermocycler().SetProgram(pProgram, pDisplayCycle, command.name, command.lidTemp);
-    GetThermocycler().Start();
-    
   } else if (command.command == SCommand::EStop) {
-    GetThermocycler().Stop(); //redundant as we already stopped during parsing
+    GetThermocycler().Stop();
+    ProgramStore::Clear(); //a run stopped by a command does not resume
   
   } else if (command.command == SCommand::EConfig) {
     //update displayed
     m_display->SetContrast(command.contrast);
+    if (command.logIntervalS > 0)
+      m_temperature_log.SetIntervalS(command.logIntervalS);
     
     //update stored contrast
     //ProgramStore::StoreContrast(command.contrast);
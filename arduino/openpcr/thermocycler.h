@@ -19,10 +19,20 @@
 #ifndef _THERMOCYCLER_H_
 #define _THERMOCYCLER_H_
 
+#include "pcr_includes.h"
+#ifdef FIXED_POINT_PID
+#include "PID_fixed.h"
+typedef FixedPID PlatePID;
+#else
 #include "PID_v1.h"
+typedef PID PlatePID;
+#endif
+#include "etaestimator.h"
 #include "pid.h"
 #include "program.h"
+#include "temperaturelog.h"
 #include "thermistors.h"
+#include "timesource.h"
 
 class Display;
 class DisplayParameters;
@@ -75,25 +85,28 @@ public:
   ProgramState GetProgramState() const { return m_program_state; }
   ThermalState GetThermalState();
   Step* GetCurrentStep() { return m_current_step; }
-  Cycle* GetDisplayCycle() { return m_display_cycle; }
+  //cycles of the loop with the most, and which of them is running
   int GetNumCycles();
   int GetCurrentCycleNum();
   const char* GetProgName() { return m_program_name; }
   Display* GetDisplay() const { return m_display; }
-  ProgramComponentPool<Cycle, 4>& GetCyclePool() { return m_cycle_pool; }
-  ProgramComponentPool<Step, 20>& GetStepPool() { return m_step_pool; }
+  CyclePool& GetCyclePool() { return m_cycle_pool; }
+  StepPool& GetStepPool() { return m_step_pool; }
+  const TemperatureLog& GetTemperatureLog() const { return m_temperature_log; }
   
   boolean Ramping() { return m_is_ramping; }
   int GetPeltierPwm() { return m_peltier_pwm; }
   double GetLidTemp() { return m_lid_thermistor.GetTemp(); }
   double GetPlateTemp() { return m_plate_thermistor.GetTemp(); }
   unsigned long GetTimeRemainingS() { return m_estimated_time_remaining_sec; }
-  unsigned long GetElapsedTimeS() { return (millis() - m_program_start_time_ms) / 1000; }
-  unsigned long GetRampElapsedTimeMs() { return millis() - m_ramp_start_time; }
+  //the remaining time is within this of the estimate about 95% of the time
+  unsigned long GetTimeRemainingMarginS() { return m_eta_margin_sec; }
+  unsigned long GetElapsedTimeS() { return (GetTimeMs() - m_program_start_time_ms) / 1000; }
+  unsigned long GetRampElapsedTimeMs() { return GetTimeMs() - m_ramp_start_time; }
   boolean InControlledRamp() { return m_is_ramping && m_current_step->GetRampDurationS() > 0 && m_previous_step != NULL; }
   
   // control
-  void SetProgram(Cycle* pProgram, Cycle* pDisplayCycle, const char* szProgName, int lidTemp); //takes ownership of cycles
+  PcrStatus SetProgram(Cycle* pProgram, const char* szProgName, int lidTemp); //takes ownership of cycles
   void Stop();
   PcrStatus Start();
   void ProcessCommand(SCommand& command);
@@ -109,26 +122,32 @@ private:
   void ControlPeltier();
   void ControlLid();
   void PreprocessProgram();
+  void ValidateRamp(Step* pStep, const Step* pPreviousStep);
   void UpdateEta();
+  void Resume();
+  void StoreProgress();
+  bool AddStepsEta(int firstStep, int endStep, double fromTemp, double& seconds, double& sdSeconds);
+  void AddFastRampEta(double fromTemp, double toTemp, double& seconds, double& sdSeconds);
  
   //util functions
   void AdvanceToNextStep();
+  void BeginStep();
   void SetPlateControlStrategy();
   void SetPeltier(ThermalDirection dir, int pwm);
   
 private:
 
   Step* m_current_step;
-  ProgramComponentPool<Cycle, 4> m_cycle_pool;
+  CyclePool m_cycle_pool;
   unsigned long m_cycle_start_time;
   Display* const m_display;
-  Cycle* m_display_cycle;
-  double m_elapsed_fast_ramp_degrees;
   unsigned long m_estimated_time_remaining_sec;
-  bool m_has_cooled;
+  EtaEstimator m_eta;
+  unsigned long m_eta_margin_sec;
   bool m_is_decreasing;
   bool m_is_ramping;
   bool m_is_restarted;
+  bool m_is_resuming; //lid wait of a run cut short by a reset
   CPIDController m_lid_pid;
   CLidThermistor m_lid_thermistor;
   double m_peltier_pwm;
@@ -136,25 +155,26 @@ private:
   const int m_pin_heater_lid;
   const int m_pin_peltier_a;
   const int m_pin_peltier_b;
-  PID * m_plate_pid;
+  PlatePID * m_plate_pid;
   ControlMode m_plate_control_mode;
   CPlateThermistor m_plate_thermistor;
   Step* m_previous_step;
-  Cycle* m_program;
-  unsigned long m_program_controlled_ramp_duration_sec;
-  double m_program_fast_ramp_degrees;
-  unsigned long m_program_hold_duration_sec;
   char m_program_name[21];
   unsigned long m_program_start_time_ms;
   ProgramState m_program_state;
+  StepSchedule m_schedule; //the program, in the order it runs
   double m_ramp_start_temp;
   unsigned long m_ramp_start_time;
   SerialControl* m_serial_control;
-  ProgramComponentPool<Step, 20> m_step_pool;
+  StepPool m_step_pool;
   double m_target_lid_temp;
   double m_target_plate_temp;
+  TemperatureLog m_temperature_log;
   ThermalDirection m_thermal_direction; //holds actual real-time state
-  unsigned long m_total_elapsed_fast_ramp_duration_ms;
+  unsigned long m_next_eta_update_ms;
+  unsigned long m_next_progress_store_ms;
+  unsigned long m_resumed_hold_ms; //of the step a resumed run goes back to
+  RunProgress m_resume_progress;
 
 
 
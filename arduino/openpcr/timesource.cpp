@@ -0,0 +1,18 @@
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wattributes"
+#include <Arduino.h>
+#pragma GCC diagnostic pop
+
+#include "timesource.h"
+
+TimeSource gTimeSource = NULL;
+
+void SetTimeSource(TimeSource pSource)
+{
+  gTimeSource = pSource;
+}
+
+unsigned long GetTimeMs()
+{
+  return gTimeSource ? gTimeSource() : millis();
+}
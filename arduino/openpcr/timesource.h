@@ -0,0 +1,18 @@
+#ifndef TIMESOURCE_H
+#define TIMESOURCE_H
+
+//Milliseconds since start-up, as used by the thermocycler, the PID
+//controllers and the display. On the board this is millis(); an
+//off-target build can install its own source, e.g. a virtual clock
+//that runs a whole program in a fraction of a second.
+
+typedef unsigned long (*TimeSource)();
+
+extern TimeSource gTimeSource;
+
+//Use pSource for all firmware timing, or NULL to go back to millis()
+void SetTimeSource(TimeSource pSource);
+
+unsigned long GetTimeMs();
+
+#endif // TIMESOURCE_H
@@ -23,32 +23,8 @@
 #include "thermocycler.h"
 #include "display.h"
 
-const char FLOAT_PAD_FORM_STR[] PROGMEM = "%3d.%d";
-const char FLOAT_FORM_STR[] PROGMEM = "%d.%d";
 #pragma GCC diagnostic pop
 
-void sprintFloat(char* str, float val, int decimalDigits, boolean pad) {
-  long factor = pow(10, decimalDigits);
-  long intVal;
-
-  if (val > 0)
-    intVal = val * factor + 0.5;
-  else
-    intVal = val * factor - 0.5;
-    
-  int decimal = intVal % factor;
-  int number  = intVal / factor;
-
-  if (pad)
-  {
-    sprintf_P(str, FLOAT_PAD_FORM_STR, number, abs(decimal));
-  }
-  else
-  {
-    sprintf_P(str, FLOAT_FORM_STR, number, abs(decimal));
-  }
-}
-
 /*
 void* operator new(size_t size) {
   void* pMem = malloc(size);
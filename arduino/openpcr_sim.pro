@@ -0,0 +1,80 @@
+#Builds the firmware for a workstation, linked against the simulated
+#board in sim/ instead of the Arduino core. The result runs a whole
+#PCR program against a thermal model in faster than real time:
+#
+#  ./openpcr_sim [-p program_file] [-t trace_interval_ms] [-m max_time_s] [-c event|step]
+#
+#With -s it emulates a unit on its standard input and output instead, as
+#used by the host client library in ncc/client.
+#
+#This builds the plate loop with PID_v1, as the firmware is by default;
+#openpcr_sim_fixed.pro builds the same with FixedPID.
+
+QT -= core gui
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle qt
+
+TARGET = openpcr_sim
+
+DEFINES += __AVR_ATmega328__
+DEFINES += NTRACE
+
+QMAKE_CXXFLAGS += -Wall -Wextra
+
+INCLUDEPATH += \
+  sim \
+  openpcr
+
+SOURCES += \
+    main_sim.cpp \
+    openpcr/util.cpp \
+    openpcr/thermocycler.cpp \
+    openpcr/thermistors.cpp \
+    openpcr/serialcontrol.cpp \
+    openpcr/program.cpp \
+    openpcr/PID_v1.cpp \
+    openpcr/PID_fixed.cpp \
+    openpcr/pid.cpp \
+    openpcr/display.cpp \
+    openpcr/displayparameters.cpp \
+    openpcr/thermocyclerparameters.cpp \
+    openpcr/timesource.cpp \
+    openpcr/controlscheduler.cpp \
+    openpcr/temperaturelog.cpp \
+    openpcr/fixedformat.cpp \
+    openpcr/etaestimator.cpp \
+    sim/experiment.cpp \
+    sim/simhal.cpp \
+    sim/thermalplant.cpp
+
+HEADERS += \
+    openpcr/thermocycler.h \
+    openpcr/thermistors.h \
+    openpcr/serialcontrol.h \
+    openpcr/program.h \
+    openpcr/PID_v1.h \
+    openpcr/PID_fixed.h \
+    openpcr/pid.h \
+    openpcr/pcr_includes.h \
+    openpcr/display.h \
+    openpcr/displayparameters.h \
+    openpcr/openpcr.ino \
+    openpcr/thermocyclerparameters.h \
+    openpcr/arduinoassert.h \
+    openpcr/arduinotrace.h \
+    openpcr/timesource.h \
+    openpcr/controlscheduler.h \
+    openpcr/temperaturelog.h \
+    openpcr/fixedformat.h \
+    openpcr/etaestimator.h \
+    sim/Arduino.h \
+    sim/LiquidCrystal.h \
+    sim/avr/eeprom.h \
+    sim/avr/interrupt.h \
+    sim/avr/io.h \
+    sim/avr/pgmspace.h \
+    sim/util/crc16.h \
+    sim/experiment.h \
+    sim/simhal.h \
+    sim/thermalplant.h
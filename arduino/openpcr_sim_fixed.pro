@@ -0,0 +1,11 @@
+#The simulator of openpcr_sim.pro with the plate loop in Q16.16 fixed
+#point (FixedPID, see openpcr/PID_fixed.h), to run programs against both
+#controllers:
+#
+#  ./openpcr_sim_fixed [options of openpcr_sim]
+
+include(openpcr_sim.pro)
+
+TARGET = openpcr_sim_fixed
+
+DEFINES += FIXED_POINT_PID
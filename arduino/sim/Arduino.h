@@ -0,0 +1,61 @@
+#ifndef _SIM_ARDUINO_H_
+#define _SIM_ARDUINO_H_
+
+///Replacement for the Arduino core when the firmware is built for a
+///workstation: pins, timers, SPI and the serial port are routed to the
+///simulated hardware in simhal.cpp instead of to the ATmega registers.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT  0x0
+#define OUTPUT 0x1
+
+//Like the Arduino core, abs works on any arithmetic type
+#ifdef abs
+#undef abs
+#endif
+#define abs(x) ((x)>0?(x):-(x))
+
+unsigned long millis();
+void delay(unsigned long ms);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+
+char* itoa(int value, char* str, int radix);
+char* ultoa(unsigned long value, char* str, int radix);
+
+///The serial port of the simulated controller. Bytes written by the
+///firmware are collected for the host side, bytes queued by the host
+///side are handed to the firmware through available() and read().
+class HardwareSerial
+{
+public:
+  void begin(unsigned long baud);
+  int available();
+  int read();
+  size_t write(uint8_t c);
+  size_t write(const uint8_t* buffer, size_t size);
+  size_t print(const char* str);
+  size_t print(int value);
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef _SIM_LIQUIDCRYSTAL_H_
+#define _SIM_LIQUIDCRYSTAL_H_
+
+#include <stdint.h>
+
+///Stand-in for the Arduino LiquidCrystal library. The simulation has no
+///panel, so the last printed text is only kept for inspection.
+class LiquidCrystal
+{
+public:
+  LiquidCrystal(
+    uint8_t rs,
+    uint8_t enable,
+    uint8_t d0,
+    uint8_t d1,
+    uint8_t d2,
+    uint8_t d3)
+  {
+    (void)rs; (void)enable; (void)d0; (void)d1; (void)d2; (void)d3;
+    m_text[0] = '\0';
+  }
+
+  void begin(uint8_t cols, uint8_t rows) { (void)cols; (void)rows; }
+  void clear() { m_text[0] = '\0'; }
+  void setCursor(uint8_t col, uint8_t row) { (void)col; (void)row; }
+  void print(const char* text);
+  void print(int value);
+
+  const char* GetText() const { return m_text; }
+
+private:
+  char m_text[41];
+};
+
+#endif
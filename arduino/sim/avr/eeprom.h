@@ -0,0 +1,19 @@
+#ifndef _SIM_AVR_EEPROM_H_
+#define _SIM_AVR_EEPROM_H_
+
+///The ATmega328's 1 KB EEPROM, held in memory. It starts erased (all
+///0xFF) and, as on the chip, SimHardware::Reset leaves it as it is.
+///A byte that changes keeps it busy for SimHardware::m_eeprom_write_ms.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define E2END 0x3FF
+
+bool eeprom_is_ready();
+uint8_t eeprom_read_byte(const uint8_t* addr);
+void eeprom_update_byte(uint8_t* addr, uint8_t value);
+void eeprom_read_block(void* dst, const void* src, size_t n);
+void eeprom_update_block(const void* src, void* dst, size_t n);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef _SIM_AVR_INTERRUPT_H_
+#define _SIM_AVR_INTERRUPT_H_
+
+///Interrupt handlers become ordinary functions, which the simulated
+///board calls when the corresponding event happens. There is nothing to
+///interrupt, so enabling and disabling interrupts does nothing.
+
+#define ISR(vector) void vector()
+
+#define cli()
+#define sei()
+
+///Timer/counter 1 overflow, called by SimHardware::Advance
+void TIMER1_OVF_vect();
+
+#endif
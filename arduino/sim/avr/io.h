@@ -0,0 +1,68 @@
+#ifndef _SIM_AVR_IO_H_
+#define _SIM_AVR_IO_H_
+
+///The ATmega328 registers the firmware touches. Plain registers are
+///ordinary bytes; SPDR and SPSR are backed by the simulated plate ADC.
+
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+
+//SPI
+#define SPIE 7
+#define SPE  6
+#define DORD 5
+#define MSTR 4
+#define CPOL 3
+#define CPHA 2
+#define SPR1 1
+#define SPR0 0
+#define SPIF 7
+
+//Timer/counter 1
+#define WGM10 0
+#define WGM11 1
+#define WGM12 3
+#define WGM13 4
+#define CS10  0
+#define CS11  1
+#define CS12  2
+#define TOIE1 0
+
+//Timer/counter 2
+#define WGM20  0
+#define WGM21  1
+#define WGM22  3
+#define COM2B0 4
+#define COM2B1 5
+#define COM2A0 6
+#define COM2A1 7
+#define CS20   0
+#define CS21   1
+#define CS22   2
+
+///SPI data register: a write clocks one byte out to the plate ADC,
+///a read returns the byte clocked in during that transfer
+struct SimSpiDataRegister
+{
+  SimSpiDataRegister& operator=(const uint8_t data);
+  operator uint8_t() const;
+};
+
+extern volatile uint8_t SPCR;
+extern volatile uint8_t SPSR;
+extern SimSpiDataRegister SPDR;
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint8_t TIMSK1;
+extern volatile uint8_t TCCR2A;
+extern volatile uint8_t TCCR2B;
+extern volatile uint8_t MCUSR;
+
+//MCUSR, what caused the last reset
+#define PORF  0 //power-on
+#define EXTRF 1 //reset pin
+#define BORF  2 //brown-out
+#define WDRF  3 //watchdog
+
+#endif
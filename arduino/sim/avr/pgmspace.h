@@ -0,0 +1,29 @@
+#ifndef _SIM_AVR_PGMSPACE_H_
+#define _SIM_AVR_PGMSPACE_H_
+
+///On the workstation flash and RAM share one address space, so the
+///program memory accessors are plain reads
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+
+#define pgm_read_byte(addr)       (*(const uint8_t*)(addr))
+#define pgm_read_word(addr)       (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr)      (*(const uint32_t*)(addr))
+#define pgm_read_byte_near(addr)  pgm_read_byte(addr)
+#define pgm_read_word_near(addr)  pgm_read_word(addr)
+#define pgm_read_dword_near(addr) pgm_read_dword(addr)
+
+#define strcpy_P  strcpy
+#define strncpy_P strncpy
+#define strcmp_P  strcmp
+#define strncmp_P strncmp
+#define strlen_P  strlen
+#define memcpy_P  memcpy
+#define sprintf_P sprintf
+
+#endif
@@ -0,0 +1,152 @@
+#include <cctype>
+#include <cstring>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include "experiment.h"
+
+namespace {
+
+///Just enough JSON for .pcr files: objects, arrays, strings and numbers
+struct JsonValue
+{
+  JsonValue() : m_is_array(false), m_is_object(false), m_text(), m_items(), m_members() {}
+
+  const JsonValue& operator[](const std::string& key) const
+  {
+    static const JsonValue none;
+    std::map<std::string, JsonValue>::const_iterator i = m_members.find(key);
+    return i == m_members.end() ? none : i->second;
+  }
+
+  bool m_is_array;
+  bool m_is_object;
+  std::string m_text; //strings and numbers, as written
+  std::vector<JsonValue> m_items;
+  std::map<std::string, JsonValue> m_members;
+};
+
+class JsonParser
+{
+public:
+  JsonParser(const std::string& text) : m_text(text), m_pos(0) {}
+
+  bool Parse(JsonValue& value)
+  {
+    SkipSpace();
+    if (m_pos >= m_text.size())
+      return false;
+
+    const char c = m_text[m_pos];
+    if (c == '{')
+    {
+      value.m_is_object = true;
+      ++m_pos;
+      SkipSpace();
+      if (Peek() == '}') { ++m_pos; return true; }
+      while (true)
+      {
+        JsonValue key;
+        SkipSpace();
+        if (Peek() != '"' || !Parse(key)) return false;
+        SkipSpace();
+        if (Peek() != ':') return false;
+        ++m_pos;
+        if (!Parse(value.m_members[key.m_text])) return false;
+        SkipSpace();
+        if (Peek() == ',') { ++m_pos; continue; }
+        if (Peek() == '}') { ++m_pos; return true; }
+        return false;
+      }
+    }
+    if (c == '[')
+    {
+      value.m_is_array = true;
+      ++m_pos;
+      SkipSpace();
+      if (Peek() == ']') { ++m_pos; return true; }
+      while (true)
+      {
+        value.m_items.push_back(JsonValue());
+        if (!Parse(value.m_items.back())) return false;
+        SkipSpace();
+        if (Peek() == ',') { ++m_pos; continue; }
+        if (Peek() == ']') { ++m_pos; return true; }
+        return false;
+      }
+    }
+    if (c == '"')
+    {
+      for (++m_pos; m_pos < m_text.size() && m_text[m_pos] != '"'; ++m_pos)
+      {
+        if (m_text[m_pos] == '\\' && m_pos + 1 < m_text.size())
+          ++m_pos;
+        value.m_text += m_text[m_pos];
+      }
+      return m_pos++ < m_text.size();
+    }
+
+    //number, true, false or null
+    while (m_pos < m_text.size() && (isalnum(m_text[m_pos]) || strchr("+-.", m_text[m_pos])))
+      value.m_text += m_text[m_pos++];
+    return !value.m_text.empty();
+  }
+
+private:
+  char Peek() const { return m_pos < m_text.size() ? m_text[m_pos] : '\0'; }
+  void SkipSpace() { while (m_pos < m_text.size() && isspace(m_text[m_pos])) ++m_pos; }
+
+  const std::string& m_text;
+  std::string::size_type m_pos;
+};
+
+std::string StepToString(const JsonValue& step)
+{
+  return "[" + step["time"].m_text + "|" + step["temp"].m_text + "|"
+    + step["name"].m_text.substr(0, 13) + "|" + step["rampDuration"].m_text + "]";
+}
+
+} //~namespace
+
+std::string ExperimentToCommand(const std::string& json, const int command_id)
+{
+  JsonValue experiment;
+  JsonParser parser(json);
+  if (!parser.Parse(experiment) || !experiment.m_is_object)
+    return std::string();
+
+  const std::vector<JsonValue>& steps = experiment["steps"].m_items;
+  if (steps.empty())
+    return std::string();
+
+  std::ostringstream s;
+  s << "s=ACGTC&c=start&d=" << command_id
+    << "&l=" << static_cast<long>(floor(atof(experiment["lidtemp"].m_text.c_str()) + 0.5))
+    << "&n=" << experiment["name"].m_text
+    << "&p=";
+
+  //consecutive top-level steps go into a single cycle of one
+  for (std::vector<JsonValue>::size_type i = 0; i != steps.size(); ++i)
+  {
+    if (steps[i]["type"].m_text == "cycle")
+    {
+      s << "(" << steps[i]["count"].m_text;
+      const std::vector<JsonValue>& cycle_steps = steps[i]["steps"].m_items;
+      for (std::vector<JsonValue>::size_type j = 0; j != cycle_steps.size(); ++j)
+        s << StepToString(cycle_steps[j]);
+      s << ")";
+    }
+    else
+    {
+      if (i == 0 || steps[i - 1]["type"].m_text == "cycle")
+        s << "(1";
+      s << StepToString(steps[i]);
+      if (i + 1 == steps.size() || steps[i + 1]["type"].m_text != "step")
+        s << ")";
+    }
+  }
+  return s.str();
+}
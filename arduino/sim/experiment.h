@@ -0,0 +1,12 @@
+#ifndef _SIM_EXPERIMENT_H_
+#define _SIM_EXPERIMENT_H_
+
+#include <string>
+
+///Convert an experiment as saved by the OpenPCR app (a .pcr file, JSON)
+///into the command string the app writes to CONTROL.TXT to start it,
+///following startPCR and stepToString in air/js/openpcr.js.
+///Returns an empty string if the experiment cannot be read.
+std::string ExperimentToCommand(const std::string& json, const int command_id);
+
+#endif
@@ -0,0 +1,345 @@
+#include <Arduino.h>
+#include <LiquidCrystal.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+
+#include "simhal.h"
+#include "thermistors.h"
+
+////////////////////////////////////////////////////////////////////
+// Thermistor model: the inverse of the firmware's resistance tables
+
+namespace {
+
+template <class T>
+double TableResistance(
+  const T table[],
+  const int size,
+  const int start_temp,
+  const double temp)
+{
+  const double index = temp - start_temp;
+  if (index <= 0.0)
+    return table[0];
+  if (index >= size - 1)
+    return table[size - 1];
+  const int i = static_cast<int>(index);
+  return table[i] + (static_cast<double>(table[i + 1]) - table[i]) * (index - i);
+}
+
+} //~namespace
+
+////////////////////////////////////////////////////////////////////
+// Struct SimPins
+SimPins::SimPins()
+  :
+    m_pin_heater_lid(2),
+    m_pin_lid_thermistor(3),
+    m_pin_peltier_a(4),
+    m_pin_peltier_b(5),
+    m_pin_peltier_pwm(1),
+    m_pin_plate_thermistor(6),
+    m_pin_slave_select(10)
+{
+}
+
+////////////////////////////////////////////////////////////////////
+// Class SimHardware
+SimHardware::SimHardware()
+  :
+    m_adc_ready_time_ms(m_adc_conversion_ms),
+    m_clock_mode(EDiscreteEvent),
+    m_eeprom_ready_time_ms(0),
+    m_adc_word(0),
+    m_adc_byte_index(0),
+    m_pins(),
+    m_plant(ThermalPlantParameters()),
+    m_serial_rx(),
+    m_serial_tx(),
+    m_spi_received(0),
+    m_time_ms(0),
+    m_timer1_us(0)
+{
+  memset(m_analog_out, 0, sizeof(m_analog_out));
+  memset(m_digital, 0, sizeof(m_digital));
+}
+
+SimHardware& SimHardware::Get()
+{
+  static SimHardware hardware;
+  return hardware;
+}
+
+void SimHardware::Reset(const SimPins& pins, const ThermalPlantParameters& parameters)
+{
+  memset(m_analog_out, 0, sizeof(m_analog_out));
+  memset(m_digital, 0, sizeof(m_digital));
+  m_adc_ready_time_ms = m_adc_conversion_ms;
+  m_eeprom_ready_time_ms = 0;
+  m_adc_word = 0;
+  m_adc_byte_index = 0;
+  m_pins = pins;
+  m_plant = ThermalPlant(parameters);
+  m_serial_rx.clear();
+  m_serial_tx.clear();
+  m_spi_received = 0;
+  m_time_ms = 0;
+  m_timer1_us = 0;
+  TIMSK1 = 0;
+  MCUSR = _BV(PORF);
+}
+
+void SimHardware::Advance(const unsigned long ms)
+{
+  ApplyDrives();
+  m_plant.Advance(static_cast<double>(ms) / 1000.0);
+  m_time_ms += ms;
+
+  m_timer1_us += ms * 1000;
+  while (m_timer1_us >= m_timer1_overflow_us)
+  {
+    m_timer1_us -= m_timer1_overflow_us;
+    if (TIMSK1 & _BV(TOIE1))
+      TIMER1_OVF_vect();
+  }
+}
+
+void SimHardware::AdvanceTo(const unsigned long time_ms)
+{
+  if (time_ms > m_time_ms)
+    Advance(time_ms - m_time_ms);
+}
+
+unsigned long SimHardware::GetNextEventTimeMs() const
+{
+  if (!IsEepromReady() && m_eeprom_ready_time_ms < m_adc_ready_time_ms)
+    return m_eeprom_ready_time_ms;
+  return m_adc_ready_time_ms;
+}
+
+unsigned long SimHardware::GetTimer1OverflowTimeMs(const unsigned int n) const
+{
+  const unsigned long us = n * m_timer1_overflow_us - m_timer1_us;
+  return m_time_ms + (us + 999) / 1000;
+}
+
+void SimHardware::ApplyDrives()
+{
+  const double peltier_duty = m_analog_out[m_pins.m_pin_peltier_pwm] / 1023.0;
+  const bool is_cooling = m_digital[m_pins.m_pin_peltier_a] == HIGH && m_digital[m_pins.m_pin_peltier_b] == LOW;
+  const bool is_heating = m_digital[m_pins.m_pin_peltier_a] == LOW && m_digital[m_pins.m_pin_peltier_b] == HIGH;
+  m_plant.SetPeltierDrive(is_heating ? peltier_duty : (is_cooling ? -peltier_duty : 0.0));
+  m_plant.SetLidDrive(m_analog_out[m_pins.m_pin_heater_lid] / 255.0);
+}
+
+int SimHardware::AnalogRead(const int pin) const
+{
+  if (pin != m_pins.m_pin_lid_thermistor)
+    return 0;
+
+  //2.2k over the thermistor, 10-bit ADC referenced to 5V
+  const double resistance = TableResistance(LID_RESISTANCE_TABLE,
+    LID_RESISTANCE_TABLE_SIZE, LID_RESISTANCE_TABLE_START_TEMP, m_plant.GetLidTemp());
+  const double voltage = 5.0 * resistance / (resistance + 2200.0);
+  const int value = static_cast<int>(voltage * 1024.0 / 5.0 + 0.5);
+  return value > 1023 ? 1023 : value;
+}
+
+void SimHardware::AnalogWrite(const int pin, const int value)
+{
+  if (pin >= 0 && pin < m_n_pins)
+    m_analog_out[pin] = value;
+}
+
+int SimHardware::DigitalRead(const int pin) const
+{
+  if (pin == m_pins.m_pin_plate_thermistor)
+  {
+    //the ready line stays high while a conversion is in progress
+    return m_time_ms < m_adc_ready_time_ms ? HIGH : LOW;
+  }
+  return pin >= 0 && pin < m_n_pins ? m_digital[pin] : LOW;
+}
+
+void SimHardware::DigitalWrite(const int pin, const int value)
+{
+  if (pin < 0 || pin >= m_n_pins)
+    return;
+  if (pin == m_pins.m_pin_slave_select && value == HIGH)
+    m_adc_byte_index = 0;
+  m_digital[pin] = value;
+}
+
+unsigned long SimHardware::LatchPlateConversion() const
+{
+  //2.2k over the thermistor (table in 0.1 Ohm), 21-bit result over 5V
+  const double resistance = TableResistance(PLATE_RESISTANCE_TABLE,
+    PLATE_RESISTANCE_TABLE_SIZE, PLATE_RESISTANCE_TABLE_START_TEMP, m_plant.GetPlateTemp());
+  const double voltage = 5.0 * resistance / (resistance + 22000.0);
+  return static_cast<unsigned long>(voltage / 5.0 * 0x1FFFFF + 0.5);
+}
+
+void SimHardware::SpiTransfer(const uint8_t)
+{
+  if (m_adc_byte_index == 0)
+    m_adc_word = LatchPlateConversion();
+
+  //the firmware reassembles bits 21..0 from the 32 clocked-in bits
+  switch (m_adc_byte_index)
+  {
+    case 0: m_spi_received = (m_adc_word >> 17) & 0x1F; break;
+    case 1: m_spi_received = (m_adc_word >> 9) & 0xFF; break;
+    case 2: m_spi_received = (m_adc_word >> 1) & 0xFF; break;
+    default: m_spi_received = (m_adc_word & 0x01) << 7; break;
+  }
+
+  if (++m_adc_byte_index == 4)
+  {
+    //reading out the result starts the next conversion
+    m_adc_byte_index = 0;
+    m_adc_ready_time_ms = m_time_ms + m_adc_conversion_ms;
+  }
+}
+
+////////////////////////////////////////////////////////////////////
+// Arduino core
+volatile uint8_t SPCR = 0;
+volatile uint8_t SPSR = 1 << SPIF; //transfers complete instantly
+SimSpiDataRegister SPDR;
+volatile uint8_t TCCR1A = 0;
+volatile uint8_t TCCR1B = 0;
+volatile uint8_t TIMSK1 = 0;
+volatile uint8_t TCCR2A = 0;
+volatile uint8_t TCCR2B = 0;
+volatile uint8_t MCUSR = 0;
+
+SimSpiDataRegister& SimSpiDataRegister::operator=(const uint8_t data)
+{
+  SimHardware::Get().SpiTransfer(data);
+  return *this;
+}
+
+SimSpiDataRegister::operator uint8_t() const
+{
+  return SimHardware::Get().GetSpiReceived();
+}
+
+HardwareSerial Serial;
+
+//avr-libc malloc internals, patched by fix28135_malloc_bug in util.cpp
+struct __freelist* __flp = NULL;
+uint8_t* __brkval = NULL;
+
+//stored inverted, so the zero-initialised array reads as erased
+uint8_t SimEeprom[E2END + 1];
+
+bool eeprom_is_ready() { return SimHardware::Get().IsEepromReady(); }
+uint8_t eeprom_read_byte(const uint8_t* addr) { return ~SimEeprom[(size_t)addr & E2END]; }
+void eeprom_update_byte(uint8_t* addr, uint8_t value)
+{
+  //only a byte that changes is written
+  if (eeprom_read_byte(addr) == value)
+    return;
+  SimEeprom[(size_t)addr & E2END] = ~value;
+  SimHardware::Get().StartEepromWrite();
+}
+void eeprom_read_block(void* dst, const void* src, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    ((uint8_t*)dst)[i] = eeprom_read_byte((const uint8_t*)src + i);
+}
+void eeprom_update_block(const void* src, void* dst, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    eeprom_update_byte((uint8_t*)dst + i, ((const uint8_t*)src)[i]);
+}
+
+unsigned long millis() { return SimHardware::Get().GetTimeMs(); }
+void delay(unsigned long ms) { SimHardware::Get().Advance(ms); }
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t pin, uint8_t value) { SimHardware::Get().DigitalWrite(pin, value); }
+int digitalRead(uint8_t pin) { return SimHardware::Get().DigitalRead(pin); }
+int analogRead(uint8_t pin) { return SimHardware::Get().AnalogRead(pin); }
+void analogWrite(uint8_t pin, int value) { SimHardware::Get().AnalogWrite(pin, value); }
+
+char* ultoa(unsigned long value, char* str, int radix)
+{
+  char digits[33];
+  int n = 0;
+  do
+  {
+    const int digit = value % radix;
+    digits[n++] = digit < 10 ? '0' + digit : 'a' + digit - 10;
+    value /= radix;
+  } while (value);
+
+  char* p = str;
+  while (n)
+    *p++ = digits[--n];
+  *p = '\0';
+  return str;
+}
+
+char* itoa(int value, char* str, int radix)
+{
+  if (value < 0 && radix == 10)
+  {
+    str[0] = '-';
+    ultoa(-static_cast<long>(value), str + 1, radix);
+    return str;
+  }
+  return ultoa(static_cast<unsigned int>(value), str, radix);
+}
+
+void HardwareSerial::begin(unsigned long) {}
+
+int HardwareSerial::available()
+{
+  return SimHardware::Get().GetSerialToDevice().size();
+}
+
+int HardwareSerial::read()
+{
+  std::deque<uint8_t>& rx = SimHardware::Get().GetSerialToDevice();
+  if (rx.empty())
+    return -1;
+  const int c = rx.front();
+  rx.pop_front();
+  return c;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  SimHardware::Get().GetSerialFromDevice().push_back(c);
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size)
+{
+  for (size_t i = 0; i != size; ++i)
+    write(buffer[i]);
+  return size;
+}
+
+size_t HardwareSerial::print(const char* str)
+{
+  return write(reinterpret_cast<const uint8_t*>(str), strlen(str));
+}
+
+size_t HardwareSerial::print(int value)
+{
+  char buf[12];
+  return print(itoa(value, buf, 10));
+}
+
+void LiquidCrystal::print(const char* text)
+{
+  strncpy(m_text, text, sizeof(m_text) - 1);
+  m_text[sizeof(m_text) - 1] = '\0';
+}
+
+void LiquidCrystal::print(int value)
+{
+  itoa(value, m_text, 10);
+}
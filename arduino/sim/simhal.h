@@ -0,0 +1,108 @@
+#ifndef _SIM_SIMHAL_H_
+#define _SIM_SIMHAL_H_
+
+#include <deque>
+#include <stdint.h>
+
+#include "thermalplant.h"
+
+///Arduino pins the simulated board wires to the plant,
+///must match the pins passed to Thermocycler in openpcr.ino
+struct SimPins
+{
+  SimPins();
+
+  int m_pin_heater_lid;       //lid heater PWM, 0-255
+  int m_pin_lid_thermistor;   //analog input of the lid thermistor divider
+  int m_pin_peltier_a;        //Peltier H-bridge, HIGH when cooling
+  int m_pin_peltier_b;        //Peltier H-bridge, HIGH when heating
+  int m_pin_peltier_pwm;      //Peltier PWM, 0-1023
+  int m_pin_plate_thermistor; //conversion ready line of the plate ADC
+  int m_pin_slave_select;     //SPI slave select of the plate ADC
+};
+
+///The simulated OpenPCR board: a virtual clock, the pin states and the
+///plate ADC, coupled to a ThermalPlant. The Arduino core replacement in
+///Arduino.h forwards to the one instance of this class.
+class SimHardware
+{
+public:
+  enum ClockMode
+  {
+    EFixedStep,    //the main loop runs every millisecond, as on the board
+    EDiscreteEvent //idle stretches jump straight to the next hardware event
+  };
+
+  static SimHardware& Get();
+
+  ///The virtual clock, to be installed with SetTimeSource
+  static unsigned long GetSimTimeMs() { return Get().GetTimeMs(); }
+
+  ///Set up a new board, resetting the clock to zero
+  void Reset(const SimPins& pins, const ThermalPlantParameters& parameters);
+
+  unsigned long GetTimeMs() const { return m_time_ms; }
+  const ThermalPlant& GetPlant() const { return m_plant; }
+  ThermalPlant& GetPlant() { return m_plant; }
+  const SimPins& GetPins() const { return m_pins; }
+
+  ///Let time pass, with the actuators as the firmware last set them
+  void Advance(const unsigned long ms);
+  void AdvanceTo(const unsigned long time_ms);
+
+  ///The next moment the hardware changes state by itself
+  unsigned long GetNextEventTimeMs() const;
+  ///The moment of the n-th next Timer1 overflow, n > 0
+  unsigned long GetTimer1OverflowTimeMs(const unsigned int n) const;
+  ClockMode GetClockMode() const { return m_clock_mode; }
+  void SetClockMode(const ClockMode mode) { m_clock_mode = mode; }
+
+  //serial port, as seen from the host
+  std::deque<uint8_t>& GetSerialToDevice() { return m_serial_rx; }
+  std::deque<uint8_t>& GetSerialFromDevice() { return m_serial_tx; }
+
+  //pins, as seen from the firmware
+  int AnalogRead(const int pin) const;
+  void AnalogWrite(const int pin, const int value);
+  int DigitalRead(const int pin) const;
+  void DigitalWrite(const int pin, const int value);
+
+  //EEPROM, as seen from the firmware
+  bool IsEepromReady() const { return m_time_ms >= m_eeprom_ready_time_ms; }
+  void StartEepromWrite() { m_eeprom_ready_time_ms = m_time_ms + m_eeprom_write_ms; }
+
+  //SPI, as seen from the firmware
+  void SpiTransfer(const uint8_t data);
+  uint8_t GetSpiReceived() const { return m_spi_received; }
+
+  ///Conversion time of the plate ADC
+  static const unsigned long m_adc_conversion_ms = 133;
+  ///Time an EEPROM byte takes to write, 3.4 ms on the chip
+  static const unsigned long m_eeprom_write_ms = 4;
+  ///Timer1 period in the Peltier PWM mode the firmware sets up
+  static const unsigned long m_timer1_overflow_us = 1023;
+
+private:
+  SimHardware();
+  void ApplyDrives();
+  unsigned long LatchPlateConversion() const;
+
+private:
+  enum { m_n_pins = 32 };
+  int m_analog_out[m_n_pins];
+  int m_digital[m_n_pins];
+  unsigned long m_adc_ready_time_ms;
+  ClockMode m_clock_mode;
+  unsigned long m_eeprom_ready_time_ms;
+  unsigned long m_adc_word;
+  int m_adc_byte_index;
+  SimPins m_pins;
+  ThermalPlant m_plant;
+  std::deque<uint8_t> m_serial_rx;
+  std::deque<uint8_t> m_serial_tx;
+  uint8_t m_spi_received;
+  unsigned long m_time_ms;
+  unsigned long m_timer1_us; //time since the last Timer1 overflow
+};
+
+#endif
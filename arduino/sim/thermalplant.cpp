@@ -0,0 +1,78 @@
+#include <math.h>
+
+#include "thermalplant.h"
+
+ThermalPlantParameters::ThermalPlantParameters()
+  :
+    m_ambient_temp(25.0),
+    m_plate_capacity(30.0),
+    m_plate_resistance(5.0),
+    m_peltier_heat_power(60.0),
+    m_peltier_cool_power(15.0),
+    m_peltier_cool_min_temp(-10.0),
+    m_lid_capacity(15.0),
+    m_lid_resistance(8.0),
+    m_lid_heater_power(12.0)
+{
+}
+
+ThermalPlant::ThermalPlant(const ThermalPlantParameters& parameters)
+  :
+    m_lid_drive(0.0),
+    m_lid_temp(parameters.m_ambient_temp),
+    m_parameters(parameters),
+    m_peltier_drive(0.0),
+    m_plate_temp(parameters.m_ambient_temp)
+{
+}
+
+void ThermalPlant::SetPeltierDrive(const double drive)
+{
+  m_peltier_drive = drive > 1.0 ? 1.0 : (drive < -1.0 ? -1.0 : drive);
+}
+
+void ThermalPlant::SetLidDrive(const double drive)
+{
+  m_lid_drive = drive > 1.0 ? 1.0 : (drive < 0.0 ? 0.0 : drive);
+}
+
+void ThermalPlant::Advance(const double seconds)
+{
+  if (seconds <= 0.0)
+    return;
+
+  const ThermalPlantParameters& p = m_parameters;
+
+  //plate: C dT/dt = source - conductance * T
+  double plate_source = p.m_ambient_temp / p.m_plate_resistance;
+  double plate_conductance = 1.0 / p.m_plate_resistance;
+  if (m_peltier_drive >= 0.0)
+  {
+    plate_source += m_peltier_drive * p.m_peltier_heat_power;
+  }
+  else
+  {
+    //pumped heat falls linearly with block temperature until it stalls
+    const double k = -m_peltier_drive * p.m_peltier_cool_power
+      / (p.m_ambient_temp - p.m_peltier_cool_min_temp);
+    plate_source += k * p.m_peltier_cool_min_temp;
+    plate_conductance += k;
+  }
+  m_plate_temp = Integrate(m_plate_temp, p.m_plate_capacity, plate_source, plate_conductance, seconds);
+
+  //lid
+  const double lid_source = p.m_ambient_temp / p.m_lid_resistance + m_lid_drive * p.m_lid_heater_power;
+  const double lid_conductance = 1.0 / p.m_lid_resistance;
+  m_lid_temp = Integrate(m_lid_temp, p.m_lid_capacity, lid_source, lid_conductance, seconds);
+}
+
+double ThermalPlant::Integrate(
+  const double temp,
+  const double capacity,
+  const double source,
+  const double conductance,
+  const double seconds)
+{
+  const double steady_temp = source / conductance;
+  return steady_temp + (temp - steady_temp) * exp(-seconds * conductance / capacity);
+}
@@ -0,0 +1,60 @@
+#ifndef _SIM_THERMALPLANT_H_
+#define _SIM_THERMALPLANT_H_
+
+///Physical constants of the lumped-capacitance model of an OpenPCR.
+///The defaults are ballpark figures for the aluminium sample block on
+///its Peltier element and the resistively heated lid.
+struct ThermalPlantParameters
+{
+  ThermalPlantParameters();
+
+  double m_ambient_temp;          //C
+  double m_plate_capacity;        //J/K, block plus samples
+  double m_plate_resistance;      //K/W, block to ambient
+  double m_peltier_heat_power;    //W, at full drive
+  double m_peltier_cool_power;    //W, at full drive with the block at ambient
+  double m_peltier_cool_min_temp; //C, temperature at which cooling stalls
+  double m_lid_capacity;          //J/K
+  double m_lid_resistance;        //K/W, lid to ambient
+  double m_lid_heater_power;      //W, at full drive
+};
+
+///Lumped-capacitance model of plate and lid: each is a single heat
+///capacity exchanging heat with ambient through a thermal resistance and
+///driven by its actuator. Within one Advance the drives are constant, so
+///the linear ODE is integrated exactly and any time step is stable.
+class ThermalPlant
+{
+public:
+  ThermalPlant(const ThermalPlantParameters& parameters);
+
+  double GetLidTemp() const { return m_lid_temp; }
+  double GetPlateTemp() const { return m_plate_temp; }
+  const ThermalPlantParameters& GetParameters() const { return m_parameters; }
+
+  ///drive in [-1,1], positive heats the block, negative cools it
+  void SetPeltierDrive(const double drive);
+  ///drive in [0,1]
+  void SetLidDrive(const double drive);
+  void SetLidTemp(const double temp) { m_lid_temp = temp; }
+  void SetPlateTemp(const double temp) { m_plate_temp = temp; }
+
+  void Advance(const double seconds);
+
+private:
+  static double Integrate(
+    const double temp,
+    const double capacity,
+    const double source,
+    const double conductance,
+    const double seconds);
+
+private:
+  double m_lid_drive;
+  double m_lid_temp;
+  ThermalPlantParameters m_parameters;
+  double m_peltier_drive;
+  double m_plate_temp;
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef _SIM_UTIL_CRC16_H_
+#define _SIM_UTIL_CRC16_H_
+
+///The CRC helpers of avr-libc, in the plain C the avr-libc manual gives
+///as their equivalents
+
+#include <stdint.h>
+
+///CRC-16, polynomial 0xA001 (x^16 + x^15 + x^2 + 1), usually started at 0xFFFF
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t a)
+{
+  crc ^= a;
+  for (int i = 0; i < 8; ++i)
+    crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+  return crc;
+}
+
+///Dallas/Maxim CRC-8, polynomial 0x8C (x^8 + x^5 + x^4 + 1), started at 0
+static inline uint8_t _crc_ibutton_update(uint8_t crc, uint8_t data)
+{
+  crc ^= data;
+  for (int i = 0; i < 8; ++i)
+    crc = (crc & 0x01) ? (crc >> 1) ^ 0x8C : (crc >> 1);
+  return crc;
+}
+
+#endif
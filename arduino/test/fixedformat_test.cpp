@@ -0,0 +1,98 @@
+//Checks that FormatFixed writes what sprintFloat, which it replaced, did:
+//every 0.01 C from -40 to 150 C, padded and unpadded, and integers as
+//itoa and the display wrote them. Values between -1 and 0 keep their
+//minus sign on purpose, where sprintFloat dropped it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fixedformat.h"
+
+static long sMismatches = 0;
+
+//sprintFloat as it was, with sprintf for sprintf_P. float and double are
+//the same on the AVR; here both are double, as ToDeciC takes, or values
+//at .x5 round differently on the host than on the board.
+static void SprintFloat(char* str, double val, int decimalDigits, bool pad)
+{
+  long factor = 1;
+  for (int i = 0; i < decimalDigits; i++)
+    factor *= 10;
+  long intVal;
+
+  if (val > 0)
+    intVal = val * factor + 0.5;
+  else
+    intVal = val * factor - 0.5;
+
+  int decimal = intVal % factor;
+  int number  = intVal / factor;
+
+  if (pad)
+    sprintf(str, "%3d.%d", number, abs(decimal));
+  else
+    sprintf(str, "%d.%d", number, abs(decimal));
+}
+
+static void Check(const char* actual, const char* expected, const char* what)
+{
+  if (strcmp(actual, expected) != 0) {
+    if (sMismatches < 10)
+      printf("%s: '%s', expected '%s'\n", what, actual, expected);
+    sMismatches++;
+  }
+}
+
+int main()
+{
+  long checked = 0;
+  char expected[32], actual[32];
+  for (long i = -4000; i <= 15000; i++) {
+    const double temp = i / 100.0;
+    for (int pad = 0; pad <= 1; pad++) {
+      SprintFloat(expected, temp, 1, pad);
+      const int16_t deciC = ToDeciC(temp);
+      if (deciC < 0 && deciC > -10) {
+        //"0.5" or "  0.5" becomes "-0.5" or " -0.5"
+        char* zero = strchr(expected, '0');
+        if (pad)
+          zero[-1] = '-';
+        else {
+          memmove(expected + 1, expected, strlen(expected) + 1);
+          expected[0] = '-';
+        }
+      }
+      char* end = FormatFixed(actual, deciC, 1, pad ? 3 : 0);
+      Check(actual, expected, pad ? "padded" : "unpadded");
+      if (*end != '\0' || end != actual + strlen(actual))
+        Check("end", "NUL", "returned pointer");
+      checked++;
+    }
+  }
+
+  //AddParam used itoa, the display two digits
+  for (long val = -40000; val <= 40000; val++) {
+    sprintf(expected, "%ld", val);
+    FormatFixed(actual, val, 0);
+    Check(actual, expected, "integer");
+    sprintf(expected, "%2ld", val);
+    FormatFixed(actual, val, 0, 2);
+    Check(actual, expected, "integer, width 2");
+    checked += 2;
+  }
+  const long extremes[] = { 2147483647L, -2147483647L - 1 };
+  for (unsigned int i = 0; i < sizeof(extremes) / sizeof(extremes[0]); i++) {
+    sprintf(expected, "%ld", extremes[i]);
+    FormatFixed(actual, extremes[i], 0);
+    Check(actual, expected, "extreme");
+    checked++;
+  }
+
+  printf("%ld values checked, %ld mismatches\n", checked, sMismatches);
+  if (sMismatches > 0) {
+    printf("FAILED\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,27 @@
+#Host test: FormatFixed against the sprintFloat it replaced. Exits with 1
+#if any value is written differently.
+#
+#  ./fixedformat_test
+
+QT -= core gui
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle qt
+
+TARGET = fixedformat_test
+
+DEFINES += __AVR_ATmega328__
+DEFINES += NTRACE
+
+QMAKE_CXXFLAGS += -Wall -Wextra
+
+INCLUDEPATH += \
+  ../sim \
+  ../openpcr
+
+SOURCES += \
+    fixedformat_test.cpp \
+    ../openpcr/fixedformat.cpp
+
+HEADERS += \
+    ../openpcr/fixedformat.h
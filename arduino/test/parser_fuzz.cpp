@@ -0,0 +1,248 @@
+//Feeds CommandParser mutations of valid commands while a program runs on
+//the simulated board. Every command must parse to a status without
+//reading past its end, and a rejected one must leave the running program
+//as it was: same state, same step, same pool use. Accepted commands are
+//run for a while, as the unit would. After each command the status the
+//unit reports must fit its STATUS_FILE_LEN byte record; so must the
+//status of a program with every field at its widest. Steps at the plate
+//temperature and ramp limits must parse, and steps past them must not.
+//Build with -fsanitize=address to catch reads past the end of a command,
+//and ASAN_OPTIONS=detect_leaks=0, as the firmware never frees what
+//setup() allocates.
+//
+//  ./parser_fuzz [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <string>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-local-typedefs"
+#pragma GCC diagnostic ignored "-Wattributes"
+#include "openpcr/openpcr.ino"
+#pragma GCC diagnostic pop
+
+#include "simhal.h"
+#include "thermalplant.h"
+#include "timesource.h"
+
+#define DEFAULT_ITERATIONS 200000
+#define LOOPS_PER_COMMAND  50
+#define STATUS_FILE_LEN    100 //as SendStatus pads the status to
+
+static const char* const sSeeds[] = {
+  "s=ACGTC&c=start&d=1&l=110&n=Simulated PCR&p=(1[120|95|Initial melt|0])(35[30|95|Denaturing|0][30|55|Annealing|0][30|72|Extending|0])(1[0|4|Final Hold|0])",
+  "s=ACGTC&c=cfg&o=80&d=3&i=5",
+  "s=ACGTC&c=stop&d=4",
+  "c=start&p=(1[30|95.5|Melt|10])(2[1|4.25|Cold])",
+};
+#define NUM_SEEDS (int)(sizeof(sSeeds) / sizeof(sSeeds[0]))
+
+//steps at the limits CommandParser holds them to
+static const struct {
+  const char* szCommand;
+  bool isValid;
+} sLimits[] = {
+  {"c=start&p=(1[30|0|Cold])", true},
+  {"c=start&p=(1[30|-0.0|Cold])", true},
+  {"c=start&p=(1[30|100|Hot])", true},
+  {"c=start&p=(1[30|100.04|Hot])", true}, //rounds to 100.0
+  {"c=start&p=(1[30|-0.1|Cold])", false},
+  {"c=start&p=(1[30|100.1|Hot])", false},
+  {"c=start&p=(1[30|999|Hot])", false},
+  {"c=start&p=(1[30|-999|Cold])", false},
+  {"c=start&p=(1[30|95|Slow|4294967])", true},
+  {"c=start&p=(1[30|95|Slow|4294968])", false},
+  {"c=start&p=(1[30|95|Slow|4294967295])", false},
+};
+#define NUM_LIMITS (int)(sizeof(sLimits) / sizeof(sLimits[0]))
+static const char sAlphabet[] = "()[]|&=.-0123456789sclnopdi\0x";
+
+static void RunFor(int loops)
+{
+  SimHardware& hardware = SimHardware::Get();
+  for (int i = 0; i < loops; i++) {
+    loop();
+    hardware.AdvanceTo(hardware.GetTimeMs() + 1000);
+  }
+}
+
+//queues a packet on the unit's serial port, as the USB bridge sends it
+static void SendPacket(uint8_t type, const std::string& payload)
+{
+  std::deque<uint8_t>& toDevice = SimHardware::Get().GetSerialToDevice();
+  size_t length = 4 + payload.size();
+  for (size_t i = 0; i < payload.size(); i++)
+    length += (uint8_t)payload[i] == 0xff;
+  toDevice.push_back(0xff);
+  toDevice.push_back(length & 0xff);
+  toDevice.push_back(length >> 8);
+  toDevice.push_back(type);
+  for (size_t i = 0; i < payload.size(); i++) {
+    if ((uint8_t)payload[i] == 0xff)
+      toDevice.push_back(0xfe);
+    toDevice.push_back(payload[i]);
+  }
+}
+
+//The status text the unit answers a STATUS_REQ with; empty if the answer
+//is not one padded STATUS_FILE_LEN byte record with a terminator
+static std::string RequestStatus()
+{
+  SimHardware& hardware = SimHardware::Get();
+  std::deque<uint8_t>& fromDevice = hardware.GetSerialFromDevice();
+  fromDevice.clear();
+  SendPacket(0x40, std::string()); //STATUS_REQ
+
+  //start code, length of the packet on the wire, type, escaped payload
+  const size_t headerLength = 4;
+  size_t packetLength = headerLength;
+  for (int i = 0; i < 100 && fromDevice.size() < packetLength; i++) {
+    loop();
+    hardware.AdvanceTo(hardware.GetTimeMs() + 10);
+    if (fromDevice.size() >= 3)
+      packetLength = fromDevice[1] | (fromDevice[2] << 8);
+  }
+  if (fromDevice.size() != packetLength || packetLength < headerLength
+      || fromDevice[0] != 0xff || fromDevice[3] != 0x80)
+    return std::string();
+  std::string payload;
+  for (size_t i = headerLength; i < packetLength; i++) {
+    if (fromDevice[i] == 0xfe && i + 1 < packetLength && fromDevice[i + 1] == 0xff)
+      i++;
+    payload += (char)fromDevice[i];
+  }
+  const size_t nul = payload.find('\0');
+  if (payload.size() != STATUS_FILE_LEN || nul == std::string::npos)
+    return std::string();
+  return payload.substr(0, nul);
+}
+
+static PcrStatus Parse(const std::string& text, SCommand& command)
+{
+  //an exact-size heap copy, so a read past the end is caught
+  char* pBuf = (char*)malloc(text.size() > 0 ? text.size() : 1);
+  memcpy(pBuf, text.data(), text.size());
+  const PcrStatus status = CommandParser::ParseCommand(command, pBuf, text.size());
+  free(pBuf);
+  return status;
+}
+
+static std::string Mutate(std::string text)
+{
+  const int mutations = 1 + rand() % 8;
+  for (int i = 0; i < mutations; i++) {
+    const size_t pos = text.empty() ? 0 : rand() % (text.size() + 1);
+    const char c = sAlphabet[rand() % (sizeof(sAlphabet) - 1)];
+    switch (rand() % 5) {
+    case 0:
+      if (pos < text.size())
+        text[pos] = c;
+      break;
+    case 1:
+      text.insert(pos, 1, c);
+      break;
+    case 2:
+      if (pos < text.size())
+        text.erase(pos, 1 + rand() % 4);
+      break;
+    case 3: //repeat a span, for programs that do not fit
+      text.insert(pos, text.substr(rand() % (text.size() + 1), rand() % 40));
+      break;
+    case 4:
+      if (pos < text.size())
+        text[pos] = rand() % 256;
+      break;
+    }
+  }
+  if (text.size() > MAX_COMMAND_SIZE)
+    text.resize(MAX_COMMAND_SIZE);
+  return text;
+}
+
+int main(int argc, char** argv)
+{
+  const long iterations = argc > 1 ? atol(argv[1]) : DEFAULT_ITERATIONS;
+  SimHardware& hardware = SimHardware::Get();
+  hardware.Reset(SimPins(), ThermalPlantParameters());
+  SetTimeSource(&SimHardware::GetSimTimeMs);
+  setup();
+  Thermocycler& tc = GetThermocycler();
+
+  SCommand command;
+  for (int i = 0; i < NUM_LIMITS; i++) {
+    if (SUCCEEDED(Parse(sLimits[i].szCommand, command)) != sLimits[i].isValid) {
+      printf("FAILED: '%s' is %s\n", sLimits[i].szCommand, sLimits[i].isValid ? "rejected" : "accepted");
+      return 1;
+    }
+  }
+
+  //the widest status: a rejected command's status next to a running
+  //program with a 5 digit id and cycle count, a 13 character step name
+  //and weeks of time elapsed and remaining
+  if (!SUCCEEDED(Parse("s=ACGTC&c=start&l=0&p=(9999[65535|95|Thirteen char|3600000][65535|4|Thirteen char|3600000])", command))) {
+    printf("FAILED: the widest program does not parse\n");
+    return 1;
+  }
+  tc.ProcessCommand(command);
+  RunFor(LOOPS_PER_COMMAND);
+  hardware.AdvanceTo(hardware.GetTimeMs() + 1000000000UL); //a 7 digit elapsed time
+  RunFor(1);
+  SendPacket(0x10, "c=start&d=65535&p=(1["); //SEND_CMD, rejected
+  const std::string widest = RequestStatus();
+  if (tc.GetProgramState() != Thermocycler::ERunning || widest.find("d=65535&s=running") != 0
+      || widest.find("&x=") == std::string::npos || widest.find("&u=9999&") == std::string::npos) {
+    printf("FAILED: status of the widest program: '%s'\n", widest.c_str());
+    return 1;
+  }
+
+  srand(1);
+  long accepted = 0, rejected = 0, failures = 0;
+  for (long i = 0; i < iterations; i++) {
+    //reject commands against a running program
+    if (tc.GetProgramState() != Thermocycler::ELidWait && tc.GetProgramState() != Thermocycler::ERunning) {
+      if (!SUCCEEDED(Parse(sSeeds[0], command))) {
+        printf("FAILED: the seed program does not parse\n");
+        return 1;
+      }
+      tc.ProcessCommand(command);
+      RunFor(1);
+    }
+
+    const Thermocycler::ProgramState state = tc.GetProgramState();
+    const Step* const pStep = tc.GetCurrentStep();
+    const int numCycles = tc.GetCyclePool().GetNumAllocated();
+    const int numSteps = tc.GetStepPool().GetNumAllocated();
+
+    const std::string text = Mutate(sSeeds[rand() % NUM_SEEDS]);
+    const PcrStatus status = Parse(text, command);
+    if (SUCCEEDED(status)) {
+      accepted++;
+      tc.ProcessCommand(command);
+      RunFor(LOOPS_PER_COMMAND);
+    } else {
+      rejected++;
+      if (tc.GetProgramState() != state || tc.GetCurrentStep() != pStep
+          || tc.GetCyclePool().GetNumAllocated() != numCycles || tc.GetStepPool().GetNumAllocated() != numSteps) {
+        if (failures < 10)
+          printf("rejected command changed the running program: '%s'\n", text.c_str());
+        failures++;
+      }
+    }
+    const std::string statusText = RequestStatus();
+    if (statusText.empty()) {
+      if (failures < 10)
+        printf("no status after command: '%s'\n", text.c_str());
+      failures++;
+    }
+  }
+
+  printf("%ld commands accepted, %ld rejected\n", accepted, rejected);
+  if (failures > 0) {
+    printf("FAILED: %ld commands changed the running program or broke the status\n", failures);
+    return 1;
+  }
+  return 0;
+}
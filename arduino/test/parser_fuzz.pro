@@ -0,0 +1,73 @@
+#Host test: CommandParser against mutated commands while a program runs
+#on the simulated board. Exits with 1 if a rejected command changes the
+#running program, or a status does not fit its record.
+#
+#  ./parser_fuzz [iterations]
+
+QT -= core gui
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle qt
+
+TARGET = parser_fuzz
+
+DEFINES += __AVR_ATmega328__
+DEFINES += NTRACE
+
+QMAKE_CXXFLAGS += -Wall -Wextra
+
+INCLUDEPATH += \
+  .. \
+  ../sim \
+  ../openpcr
+
+SOURCES += \
+    parser_fuzz.cpp \
+    ../openpcr/util.cpp \
+    ../openpcr/thermocycler.cpp \
+    ../openpcr/thermistors.cpp \
+    ../openpcr/serialcontrol.cpp \
+    ../openpcr/program.cpp \
+    ../openpcr/PID_v1.cpp \
+    ../openpcr/PID_fixed.cpp \
+    ../openpcr/pid.cpp \
+    ../openpcr/display.cpp \
+    ../openpcr/displayparameters.cpp \
+    ../openpcr/thermocyclerparameters.cpp \
+    ../openpcr/timesource.cpp \
+    ../openpcr/controlscheduler.cpp \
+    ../openpcr/temperaturelog.cpp \
+    ../openpcr/fixedformat.cpp \
+    ../openpcr/etaestimator.cpp \
+    ../sim/simhal.cpp \
+    ../sim/thermalplant.cpp
+
+HEADERS += \
+    ../openpcr/thermocycler.h \
+    ../openpcr/thermistors.h \
+    ../openpcr/serialcontrol.h \
+    ../openpcr/program.h \
+    ../openpcr/PID_v1.h \
+    ../openpcr/PID_fixed.h \
+    ../openpcr/pid.h \
+    ../openpcr/pcr_includes.h \
+    ../openpcr/display.h \
+    ../openpcr/displayparameters.h \
+    ../openpcr/openpcr.ino \
+    ../openpcr/thermocyclerparameters.h \
+    ../openpcr/arduinoassert.h \
+    ../openpcr/arduinotrace.h \
+    ../openpcr/timesource.h \
+    ../openpcr/controlscheduler.h \
+    ../openpcr/temperaturelog.h \
+    ../openpcr/fixedformat.h \
+    ../openpcr/etaestimator.h \
+    ../sim/Arduino.h \
+    ../sim/LiquidCrystal.h \
+    ../sim/avr/eeprom.h \
+    ../sim/avr/interrupt.h \
+    ../sim/avr/io.h \
+    ../sim/avr/pgmspace.h \
+    ../sim/util/crc16.h \
+    ../sim/simhal.h \
+    ../sim/thermalplant.h
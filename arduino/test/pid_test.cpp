@@ -0,0 +1,67 @@
+//Checks that FixedPID follows PID_v1: both are driven with the same
+//random plate temperatures, setpoints, tunings and integrator resets,
+//and their outputs must stay within MAX_OUTPUT_DIFFERENCE PWM counts.
+
+#include <Arduino.h>
+
+#include "PID_fixed.h"
+#include "PID_v1.h"
+
+#define ITERATIONS            200000
+#define SAMPLE_INTERVAL_MS    100
+#define MAX_OUTPUT_DIFFERENCE 0.5
+
+static unsigned long sTimeMs = 0;
+
+//the controllers' clock, in place of the simulated board's
+unsigned long millis()
+{
+  return sTimeMs;
+}
+
+int main()
+{
+  double input = 25, floatOutput = 0, fixedOutput = 0, setpoint = 95;
+  PID floatPid(&input, &floatOutput, &setpoint, 1000, 250, 250, DIRECT);
+  FixedPID fixedPid(&input, &fixedOutput, &setpoint, 1000, 250, 250, DIRECT);
+  floatPid.SetOutputLimits(-1023, 1023);
+  fixedPid.SetOutputLimits(-1023, 1023);
+  floatPid.SetMode(AUTOMATIC);
+  fixedPid.SetMode(AUTOMATIC);
+
+  srand(1);
+  double maxDifference = 0;
+  for (long i = 0; i < ITERATIONS; i++) {
+    sTimeMs += SAMPLE_INTERVAL_MS;
+    //a noisy plate that follows the setpoint
+    input += (rand() % 2001 - 1000) / 100000.0;
+    if (input < setpoint - 2)
+      input += 0.05;
+    else if (input > setpoint + 2)
+      input -= 0.05;
+
+    if (i % 5000 == 0) {
+      setpoint = 20 + rand() % 80;
+      const double kp = 100 + rand() % 2000, ki = rand() % 800, kd = rand() % 500;
+      floatPid.SetTunings(kp, ki, kd);
+      fixedPid.SetTunings(kp, ki, kd);
+    }
+    if (i % 777 == 0) {
+      floatPid.ResetI();
+      fixedPid.ResetI();
+    }
+
+    floatPid.Compute();
+    fixedPid.Compute();
+    const double difference = fabs(floatOutput - fixedOutput);
+    if (difference > maxDifference)
+      maxDifference = difference;
+  }
+
+  printf("largest output difference %.4f PWM counts\n", maxDifference);
+  if (maxDifference > MAX_OUTPUT_DIFFERENCE) {
+    printf("FAILED: more than %.2f\n", MAX_OUTPUT_DIFFERENCE);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,32 @@
+#Host test: FixedPID against PID_v1 on the same inputs. Exits with 1 if
+#their outputs drift apart.
+#
+#  ./pid_test
+
+QT -= core gui
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle qt
+
+TARGET = pid_test
+
+DEFINES += __AVR_ATmega328__
+DEFINES += NTRACE
+
+QMAKE_CXXFLAGS += -Wall -Wextra
+
+INCLUDEPATH += \
+  ../sim \
+  ../openpcr
+
+SOURCES += \
+    pid_test.cpp \
+    ../openpcr/PID_v1.cpp \
+    ../openpcr/PID_fixed.cpp \
+    ../openpcr/timesource.cpp
+
+HEADERS += \
+    ../openpcr/PID_v1.h \
+    ../openpcr/PID_fixed.h \
+    ../openpcr/timesource.h \
+    ../sim/Arduino.h
@@ -0,0 +1,58 @@
+#include <cerrno>
+#include <csignal>
+#include <string>
+#include <system_error>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "emulatortransport.h"
+
+namespace openpcr {
+
+std::unique_ptr<EmulatorTransport> EmulatorTransport::Start(
+  EventLoop& loop,
+  const std::string& simulator_path,
+  const double speed)
+{
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+    throw std::system_error(errno, std::generic_category(), "socketpair");
+
+  const std::string speed_arg = std::to_string(speed);
+  const pid_t pid = fork();
+  if (pid < 0)
+  {
+    const int error = errno;
+    close(fds[0]);
+    close(fds[1]);
+    throw std::system_error(error, std::generic_category(), "fork");
+  }
+  if (pid == 0)
+  {
+    //the simulator's standard input and output are the serial port
+    dup2(fds[1], STDIN_FILENO);
+    dup2(fds[1], STDOUT_FILENO);
+    execl(simulator_path.c_str(), simulator_path.c_str(), "-s", "-x", speed_arg.c_str(), static_cast<char*>(nullptr));
+    _exit(127);
+  }
+  close(fds[1]);
+  return std::unique_ptr<EmulatorTransport>(new EmulatorTransport(loop, fds[0], pid));
+}
+
+EmulatorTransport::EmulatorTransport(EventLoop& loop, const int fd, const pid_t pid)
+  : SerialTransport(loop, fd),
+    m_pid(pid)
+{
+}
+
+EmulatorTransport::~EmulatorTransport()
+{
+  //closing the socket ends the simulator; do not wait for it to notice
+  shutdown(GetFd(), SHUT_RDWR);
+  kill(m_pid, SIGTERM);
+  waitpid(m_pid, nullptr, 0);
+}
+
+} //~namespace openpcr
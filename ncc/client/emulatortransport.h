@@ -0,0 +1,35 @@
+#ifndef OPENPCR_EMULATORTRANSPORT_H
+#define OPENPCR_EMULATORTRANSPORT_H
+
+#include <memory>
+#include <string>
+
+#include <sys/types.h>
+
+#include "serialtransport.h"
+
+namespace openpcr {
+
+///A simulated unit: runs the firmware simulator (arduino/openpcr_sim) in
+///serial mode as a child process and talks to it over a socket pair, with
+///the same packets as SerialTransport.
+class EmulatorTransport : public SerialTransport
+{
+public:
+  ///simulator_path is the openpcr_sim executable; speed is how many times
+  ///faster than real time the simulated clock runs
+  static std::unique_ptr<EmulatorTransport> Start(
+    EventLoop& loop,
+    const std::string& simulator_path,
+    const double speed = 1.0);
+  ~EmulatorTransport();
+
+private:
+  EmulatorTransport(EventLoop& loop, const int fd, const pid_t pid);
+
+  const pid_t m_pid;
+};
+
+} //~namespace openpcr
+
+#endif // OPENPCR_EMULATORTRANSPORT_H
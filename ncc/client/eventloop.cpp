@@ -0,0 +1,225 @@
+#include <cerrno>
+#include <ctime>
+#include <stdexcept>
+#include <system_error>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "eventloop.h"
+
+namespace openpcr {
+
+///A coroutine that starts right away and frees itself when done
+struct EventLoop::Detached
+{
+  struct promise_type
+  {
+    Detached get_return_object() const noexcept { return {}; }
+    std::suspend_never initial_suspend() const noexcept { return {}; }
+    std::suspend_never final_suspend() const noexcept { return {}; }
+    void return_void() const noexcept {}
+    void unhandled_exception() const noexcept { std::terminate(); }
+  };
+};
+
+EventLoop::EventLoop()
+  : m_epoll_fd(epoll_create1(EPOLL_CLOEXEC)),
+    m_timers(),
+    m_watches(),
+    m_n_tasks(0),
+    m_error()
+{
+  if (m_epoll_fd < 0)
+    throw std::system_error(errno, std::generic_category(), "epoll_create1");
+}
+
+EventLoop::~EventLoop()
+{
+  close(m_epoll_fd);
+}
+
+uint64_t EventLoop::GetTimeMs()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
+
+void EventLoop::Spawn(Task<> task)
+{
+  ++m_n_tasks;
+  RunDetached(*this, std::move(task));
+}
+
+EventLoop::Detached EventLoop::RunDetached(EventLoop& loop, Task<> task)
+{
+  std::exception_ptr error;
+  try
+  {
+    co_await task;
+  }
+  catch (...)
+  {
+    error = std::current_exception();
+  }
+  if (error && !loop.m_error)
+    loop.m_error = error;
+  --loop.m_n_tasks;
+}
+
+void EventLoop::Run()
+{
+  epoll_event events[32];
+  while (m_n_tasks > 0 && !m_error)
+  {
+    if (m_timers.empty() && m_watches.empty())
+      throw std::logic_error("EventLoop::Run: tasks are waiting on nothing");
+
+    int timeout_ms = -1;
+    if (!m_timers.empty())
+    {
+      const uint64_t now = GetTimeMs();
+      const uint64_t first = m_timers.begin()->first;
+      timeout_ms = first <= now ? 0 : static_cast<int>(first - now > 60000 ? 60000 : first - now);
+    }
+
+    const int n = epoll_wait(m_epoll_fd, events, sizeof(events) / sizeof(events[0]), timeout_ms);
+    if (n < 0 && errno != EINTR)
+      throw std::system_error(errno, std::generic_category(), "epoll_wait");
+
+    for (int i = 0; i < n; ++i)
+    {
+      //look the waiters up again after each resume, which may add or remove some
+      const int fd = events[i].data.fd;
+      const uint32_t ready = events[i].events;
+      std::map<int, Watch>::iterator watch = m_watches.find(fd);
+      if (watch != m_watches.end() && watch->second.m_reader && (ready & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+        Resume(*watch->second.m_reader, true);
+      watch = m_watches.find(fd);
+      if (watch != m_watches.end() && watch->second.m_writer && (ready & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+        Resume(*watch->second.m_writer, true);
+    }
+
+    const uint64_t now = GetTimeMs();
+    while (!m_timers.empty() && m_timers.begin()->first <= now)
+      Resume(*m_timers.begin()->second, false);
+  }
+
+  if (m_error)
+  {
+    const std::exception_ptr error = m_error;
+    m_error = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+EventLoop::Awaiter EventLoop::Readable(const int fd, const uint64_t deadline_ms)
+{
+  return Awaiter(*this, fd, EPOLLIN, deadline_ms);
+}
+
+EventLoop::Awaiter EventLoop::Writable(const int fd, const uint64_t deadline_ms)
+{
+  return Awaiter(*this, fd, EPOLLOUT, deadline_ms);
+}
+
+EventLoop::Awaiter EventLoop::SleepUntil(const uint64_t time_ms)
+{
+  return Awaiter(*this, -1, 0, time_ms);
+}
+
+void EventLoop::Add(Waiter& waiter)
+{
+  if (waiter.m_fd >= 0)
+  {
+    Watch& watch = m_watches[waiter.m_fd];
+    Waiter*& slot = waiter.m_events == EPOLLIN ? watch.m_reader : watch.m_writer;
+    if (slot)
+      throw std::logic_error("EventLoop: two coroutines wait on the same descriptor");
+    slot = &waiter;
+    UpdateRegistration(waiter.m_fd);
+  }
+  if (waiter.m_deadline_ms != UINT64_MAX)
+    waiter.m_timer = m_timers.insert(std::make_pair(waiter.m_deadline_ms, &waiter));
+  waiter.m_is_waiting = true;
+}
+
+void EventLoop::Remove(Waiter& waiter)
+{
+  if (!waiter.m_is_waiting)
+    return;
+  waiter.m_is_waiting = false;
+  if (waiter.m_deadline_ms != UINT64_MAX)
+    m_timers.erase(waiter.m_timer);
+  if (waiter.m_fd >= 0)
+  {
+    Watch& watch = m_watches[waiter.m_fd];
+    (waiter.m_events == EPOLLIN ? watch.m_reader : watch.m_writer) = nullptr;
+    UpdateRegistration(waiter.m_fd);
+  }
+}
+
+void EventLoop::Resume(Waiter& waiter, const bool is_ready)
+{
+  Remove(waiter);
+  waiter.m_is_ready = is_ready;
+  waiter.m_handle.resume();
+}
+
+void EventLoop::UpdateRegistration(const int fd)
+{
+  Watch& watch = m_watches[fd];
+  const uint32_t wanted
+    = (watch.m_reader ? static_cast<uint32_t>(EPOLLIN) : 0)
+    | (watch.m_writer ? static_cast<uint32_t>(EPOLLOUT) : 0);
+  if (wanted == watch.m_registered)
+  {
+    if (!wanted)
+      m_watches.erase(fd);
+    return;
+  }
+
+  epoll_event event = {};
+  event.events = wanted;
+  event.data.fd = fd;
+  const int op = !wanted ? EPOLL_CTL_DEL : (watch.m_registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD);
+  if (epoll_ctl(m_epoll_fd, op, fd, &event) < 0 && op != EPOLL_CTL_DEL)
+  {
+    const int error = errno;
+    watch.m_reader = watch.m_writer = nullptr;
+    if (!watch.m_registered)
+      m_watches.erase(fd);
+    throw std::system_error(error, std::generic_category(), "epoll_ctl");
+  }
+  watch.m_registered = wanted;
+  if (!wanted)
+    m_watches.erase(fd);
+}
+
+////////////////////////////////////////////////////////////////////
+// Class EventLoop::Awaiter
+EventLoop::Awaiter::Awaiter(EventLoop& loop, const int fd, const uint32_t events, const uint64_t deadline_ms)
+  : m_loop(loop),
+    m_waiter()
+{
+  m_waiter.m_fd = fd;
+  m_waiter.m_events = events;
+  m_waiter.m_deadline_ms = deadline_ms;
+  m_waiter.m_is_waiting = false;
+  m_waiter.m_is_ready = false;
+}
+
+EventLoop::Awaiter::~Awaiter()
+{
+  //the awaiting coroutine was destroyed while suspended
+  m_loop.Remove(m_waiter);
+}
+
+void EventLoop::Awaiter::await_suspend(std::coroutine_handle<> handle)
+{
+  m_waiter.m_handle = handle;
+  m_loop.Add(m_waiter);
+}
+
+} //~namespace openpcr
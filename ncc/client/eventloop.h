@@ -0,0 +1,95 @@
+#ifndef OPENPCR_EVENTLOOP_H
+#define OPENPCR_EVENTLOOP_H
+
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <map>
+
+#include "task.h"
+
+namespace openpcr {
+
+///Single-threaded event loop on epoll. Coroutines suspend on it until a
+///file descriptor is ready or a deadline passes; Run resumes them as that
+///happens, so any number of devices are driven from the calling thread.
+class EventLoop
+{
+  struct Waiter
+  {
+    std::coroutine_handle<> m_handle;
+    int m_fd;          //-1 for a plain sleep
+    uint32_t m_events; //EPOLLIN or EPOLLOUT
+    uint64_t m_deadline_ms;
+    std::multimap<uint64_t, Waiter*>::iterator m_timer;
+    bool m_is_waiting;
+    bool m_is_ready;
+  };
+
+public:
+  EventLoop();
+  ~EventLoop();
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+
+  ///Start a task that runs alongside the others. Run returns once all
+  ///started tasks have finished; the first exception one of them throws
+  ///is rethrown from Run.
+  void Spawn(Task<> task);
+  void Run();
+
+  ///Milliseconds on the monotonic clock
+  static uint64_t GetTimeMs();
+
+  class Awaiter
+  {
+  public:
+    Awaiter(const Awaiter&) = delete;
+    Awaiter& operator=(const Awaiter&) = delete;
+    ~Awaiter();
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle);
+    ///false if the deadline passed before the descriptor was ready
+    bool await_resume() const noexcept { return m_waiter.m_is_ready; }
+
+  private:
+    friend class EventLoop;
+    Awaiter(EventLoop& loop, const int fd, const uint32_t events, const uint64_t deadline_ms);
+
+    EventLoop& m_loop;
+    Waiter m_waiter;
+  };
+
+  ///Suspend until fd is readable or writable, or deadline_ms passes
+  Awaiter Readable(const int fd, const uint64_t deadline_ms = UINT64_MAX);
+  Awaiter Writable(const int fd, const uint64_t deadline_ms = UINT64_MAX);
+  ///Suspend for ms milliseconds, or until time_ms on the monotonic clock
+  Awaiter Sleep(const uint64_t ms) { return SleepUntil(GetTimeMs() + ms); }
+  Awaiter SleepUntil(const uint64_t time_ms);
+
+private:
+  struct Watch
+  {
+    Waiter* m_reader = nullptr;
+    Waiter* m_writer = nullptr;
+    uint32_t m_registered = 0;
+  };
+
+  void Add(Waiter& waiter);
+  void Remove(Waiter& waiter);
+  void Resume(Waiter& waiter, const bool is_ready);
+  void UpdateRegistration(const int fd);
+  struct Detached;
+  static Detached RunDetached(EventLoop& loop, Task<> task);
+
+  int m_epoll_fd;
+  std::multimap<uint64_t, Waiter*> m_timers;
+  std::map<int, Watch> m_watches;
+  int m_n_tasks;
+  std::exception_ptr m_error;
+};
+
+} //~namespace openpcr
+
+#endif // OPENPCR_EVENTLOOP_H
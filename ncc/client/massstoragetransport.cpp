@@ -0,0 +1,156 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "massstoragetransport.h"
+
+namespace openpcr {
+
+namespace {
+
+//glibc has no wrappers for the native AIO system calls
+int IoSetup(const unsigned n, aio_context_t* context) { return syscall(SYS_io_setup, n, context); }
+int IoDestroy(const aio_context_t context) { return syscall(SYS_io_destroy, context); }
+int IoSubmit(const aio_context_t context, const long n, iocb** iocbs) { return syscall(SYS_io_submit, context, n, iocbs); }
+int IoGetEvents(const aio_context_t context, const long min_n, const long n, io_event* events, timespec* timeout)
+{
+  return syscall(SYS_io_getevents, context, min_n, n, events, timeout);
+}
+
+///Closes a descriptor when it goes out of scope
+class FileCloser
+{
+public:
+  explicit FileCloser(const int fd) : m_fd(fd) {}
+  ~FileCloser() { close(m_fd); }
+  FileCloser(const FileCloser&) = delete;
+  FileCloser& operator=(const FileCloser&) = delete;
+private:
+  const int m_fd;
+};
+
+} //~namespace
+
+std::unique_ptr<MassStorageTransport> MassStorageTransport::Open(EventLoop& loop, const std::string& mount_path)
+{
+  return std::unique_ptr<MassStorageTransport>(new MassStorageTransport(loop, mount_path));
+}
+
+MassStorageTransport::MassStorageTransport(EventLoop& loop, const std::string& mount_path)
+  : m_loop(loop),
+    m_mount_path(mount_path),
+    m_context(0),
+    m_event_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+    m_status_fd(-1),
+    m_buffer(nullptr)
+{
+  if (m_event_fd < 0)
+    throw std::system_error(errno, std::generic_category(), "eventfd");
+  void* buffer = nullptr;
+  const int error = posix_memalign(&buffer, 4096, m_block_size);
+  if (error || IoSetup(1, &m_context) < 0)
+  {
+    const int setup_error = error ? error : errno;
+    free(buffer);
+    close(m_event_fd);
+    throw std::system_error(setup_error, std::generic_category(), error ? "posix_memalign" : "io_setup");
+  }
+  m_buffer = static_cast<char*>(buffer);
+}
+
+MassStorageTransport::~MassStorageTransport()
+{
+  IoDestroy(m_context);
+  CloseStatus();
+  close(m_event_fd);
+  free(m_buffer);
+}
+
+int MassStorageTransport::OpenDirect(const std::string& path, const int flags)
+{
+  const int fd = open(path.c_str(), flags | O_DIRECT | O_CLOEXEC, 0644);
+  //through the page cache a read could return a status the unit has
+  //since replaced, so there is no buffered fallback
+  if (fd < 0 && errno == EINVAL)
+    throw std::system_error(errno, std::generic_category(), "open " + path + ": file system does not support O_DIRECT");
+  if (fd < 0)
+    throw std::system_error(errno, std::generic_category(), "open " + path);
+  return fd;
+}
+
+void MassStorageTransport::CloseStatus()
+{
+  if (m_status_fd >= 0)
+    close(m_status_fd);
+  m_status_fd = -1;
+}
+
+Task<std::string> MassStorageTransport::ReadStatus()
+{
+  if (m_status_fd < 0)
+    m_status_fd = OpenDirect(m_mount_path + "/STATUS.TXT", O_RDONLY);
+  long n = 0;
+  try
+  {
+    n = co_await Submit(m_status_fd, IOCB_CMD_PREAD, 0);
+  }
+  catch (const std::system_error&)
+  {
+    CloseStatus();
+    throw;
+  }
+  co_return std::string(m_buffer, m_buffer + n);
+}
+
+Task<> MassStorageTransport::SendCommand(const std::string& command)
+{
+  if (command.size() > static_cast<std::string::size_type>(m_block_size))
+    throw std::length_error("openpcr::MassStorageTransport: command exceeds one block");
+
+  //a whole block, zero padded, as O_DIRECT needs
+  std::memset(m_buffer, 0, m_block_size);
+  std::memcpy(m_buffer, command.data(), command.size());
+  const int fd = OpenDirect(m_mount_path + "/CONTROL.TXT", O_WRONLY | O_CREAT | O_TRUNC);
+  const FileCloser closer(fd);
+  co_await Submit(fd, IOCB_CMD_PWRITE, 0);
+}
+
+Task<long> MassStorageTransport::Submit(const int fd, const int opcode, const long offset)
+{
+  iocb request;
+  std::memset(&request, 0, sizeof(request));
+  request.aio_fildes = fd;
+  request.aio_lio_opcode = opcode;
+  request.aio_buf = reinterpret_cast<uintptr_t>(m_buffer);
+  request.aio_nbytes = m_block_size;
+  request.aio_offset = offset;
+  request.aio_flags = IOCB_FLAG_RESFD;
+  request.aio_resfd = m_event_fd;
+
+  iocb* requests[1] = { &request };
+  if (IoSubmit(m_context, 1, requests) != 1)
+    throw std::system_error(errno, std::generic_category(), "io_submit");
+
+  io_event event;
+  for (;;)
+  {
+    co_await m_loop.Readable(m_event_fd);
+    uint64_t n_completed;
+    if (read(m_event_fd, &n_completed, sizeof(n_completed)) < 0 && errno != EAGAIN)
+      throw std::system_error(errno, std::generic_category(), "read eventfd");
+    timespec no_wait = { 0, 0 };
+    if (IoGetEvents(m_context, 1, 1, &event, &no_wait) == 1)
+      break;
+  }
+  if (event.res < 0)
+    throw std::system_error(static_cast<int>(-event.res), std::generic_category(), "AIO");
+  co_return static_cast<long>(event.res);
+}
+
+} //~namespace openpcr
@@ -0,0 +1,51 @@
+#ifndef OPENPCR_MASSSTORAGETRANSPORT_H
+#define OPENPCR_MASSSTORAGETRANSPORT_H
+
+#include <memory>
+#include <string>
+
+#include <linux/aio_abi.h>
+
+#include "eventloop.h"
+#include "openpcrclient.h"
+
+namespace openpcr {
+
+///A unit mounted as a USB drive. Reading STATUS.TXT and writing
+///CONTROL.TXT bypass the page cache with O_DIRECT, so each one reaches
+///the unit; they are submitted as Linux native AIO with completion
+///signalled on an eventfd, so the event loop never blocks on the drive.
+///A file system that does not support O_DIRECT is an error rather than
+///a silent fallback to cached reads.
+///STATUS.TXT stays open between reads, so polling it costs one read each;
+///it is opened again after a read fails, e.g. when the unit was replugged.
+class MassStorageTransport : public Transport
+{
+public:
+  ///mount_path is the directory the unit is mounted on
+  static std::unique_ptr<MassStorageTransport> Open(EventLoop& loop, const std::string& mount_path);
+  ~MassStorageTransport();
+
+  Task<std::string> ReadStatus() override;
+  Task<> SendCommand(const std::string& command) override;
+
+  ///Sector size of the unit's virtual drive, and the O_DIRECT transfer size
+  static constexpr int m_block_size = 512;
+
+private:
+  MassStorageTransport(EventLoop& loop, const std::string& mount_path);
+  Task<long> Submit(const int fd, const int opcode, const long offset);
+  static int OpenDirect(const std::string& path, const int flags);
+  void CloseStatus();
+
+  EventLoop& m_loop;
+  const std::string m_mount_path;
+  aio_context_t m_context;
+  int m_event_fd;
+  int m_status_fd; //-1 until the first read
+  char* m_buffer; //m_block_size bytes, aligned for O_DIRECT
+};
+
+} //~namespace openpcr
+
+#endif // OPENPCR_MASSSTORAGETRANSPORT_H
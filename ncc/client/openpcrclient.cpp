@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+#include <stdexcept>
+
+#include "openpcrclient.h"
+
+namespace openpcr {
+
+////////////////////////////////////////////////////////////////////
+// Struct Status
+Status::Status()
+  : m_command_id(0),
+    m_state(),
+    m_lid_temp(0),
+    m_block_temp(0.0),
+    m_thermal_state(),
+    m_contrast(0),
+    m_elapsed_s(0),
+    m_remaining_s(0),
+    m_remaining_margin_s(0),
+    m_num_cycles(0),
+    m_cycle(0),
+    m_step_name(),
+    m_version(),
+    m_command_status(0),
+    m_cycles_used(0),
+    m_max_cycles(0),
+    m_steps_used(0),
+    m_max_steps(0),
+    m_cycle_items_used(0),
+    m_max_cycle_items(0),
+    m_raw()
+{
+}
+
+Status ParseStatus(const std::string& text)
+{
+  Status status;
+  const std::string::size_type end = text.find_last_not_of(std::string(" \0\r\n", 4));
+  status.m_raw = end == std::string::npos ? std::string() : text.substr(0, end + 1);
+
+  std::string::size_type begin = 0;
+  while (begin < status.m_raw.size())
+  {
+    std::string::size_type next = status.m_raw.find('&', begin);
+    if (next == std::string::npos)
+      next = status.m_raw.size();
+    const std::string param = status.m_raw.substr(begin, next - begin);
+    begin = next + 1;
+
+    if (param.size() < 2 || param[1] != '=')
+      continue;
+    const std::string value = param.substr(2);
+    switch (param[0])
+    {
+      case 'd': status.m_command_id = std::strtoul(value.c_str(), nullptr, 10); break;
+      case 's': status.m_state = value; break;
+      case 'l': status.m_lid_temp = std::atoi(value.c_str()); break;
+      case 'b': status.m_block_temp = std::atof(value.c_str()); break;
+      case 't': status.m_thermal_state = value; break;
+      case 'o': status.m_contrast = std::atoi(value.c_str()); break;
+      case 'e': status.m_elapsed_s = std::strtoul(value.c_str(), nullptr, 10); break;
+      case 'r': status.m_remaining_s = std::strtoul(value.c_str(), nullptr, 10); break;
+      case 'q': status.m_remaining_margin_s = std::strtoul(value.c_str(), nullptr, 10); break;
+      case 'u': status.m_num_cycles = std::atoi(value.c_str()); break;
+      case 'c': status.m_cycle = std::atoi(value.c_str()); break;
+      case 'p': status.m_step_name = value; break;
+      case 'v': status.m_version = value; break;
+      case 'x': status.m_command_status = std::atoi(value.c_str()); break;
+      default: break;
+    }
+  }
+  return status;
+}
+
+namespace {
+
+unsigned long GetLittleEndian(const std::string& frame, const std::string::size_type offset, const int size)
+{
+  unsigned long val = 0;
+  for (int i = size - 1; i >= 0; --i)
+    val = (val << 8) | static_cast<uint8_t>(frame[offset + i]);
+  return val;
+}
+
+//Thermocycler::ProgramState and ThermalState, as SendStatus spells them
+const char* const program_states[] = { "startup", "stopped", "lidwait", "running", "complete", "error" };
+const char* const thermal_states[] = { "holding", "heating", "cooling", "idle" };
+
+} //~namespace
+
+Status DecodeStatusFrame(const std::string& frame)
+{
+  //each version appends fields to the one before
+  const std::string::size_type frame_sizes[] = { 36, 43, 47 };
+  const std::string::size_type step_name_length = 14;
+  if (frame.empty())
+    throw std::runtime_error("openpcr::DecodeStatusFrame: frame too short");
+  const unsigned version = static_cast<uint8_t>(frame[0]);
+  if (version < 1)
+    throw std::runtime_error("openpcr::DecodeStatusFrame: unknown frame version");
+  const unsigned known_version = std::min<unsigned>(version, std::size(frame_sizes));
+  if (frame.size() < frame_sizes[known_version - 1])
+    throw std::runtime_error("openpcr::DecodeStatusFrame: frame too short");
+
+  Status status;
+  status.m_command_id = GetLittleEndian(frame, 1, 2);
+  const unsigned state = static_cast<uint8_t>(frame[3]);
+  status.m_state = state < std::size(program_states) ? program_states[state] : "error";
+  const unsigned thermal_state = static_cast<uint8_t>(frame[4]);
+  status.m_thermal_state = thermal_state < std::size(thermal_states) ? thermal_states[thermal_state] : "error";
+  const int lid_deci_c = static_cast<int16_t>(GetLittleEndian(frame, 5, 2));
+  status.m_lid_temp = lid_deci_c >= 0 ? (lid_deci_c + 5) / 10 : (lid_deci_c - 5) / 10;
+  status.m_block_temp = static_cast<int16_t>(GetLittleEndian(frame, 7, 2)) / 10.0;
+  status.m_contrast = static_cast<uint8_t>(frame[9]);
+  status.m_elapsed_s = GetLittleEndian(frame, 10, 4);
+  status.m_remaining_s = GetLittleEndian(frame, 14, 4);
+  status.m_num_cycles = GetLittleEndian(frame, 18, 2);
+  status.m_cycle = GetLittleEndian(frame, 20, 2);
+  const std::string step_name = frame.substr(22, step_name_length);
+  status.m_step_name = step_name.substr(0, step_name.find('\0'));
+  if (known_version < 2)
+    return status;
+
+  status.m_command_status = static_cast<uint8_t>(frame[36]);
+  status.m_cycles_used = static_cast<uint8_t>(frame[37]);
+  status.m_max_cycles = static_cast<uint8_t>(frame[38]);
+  status.m_steps_used = static_cast<uint8_t>(frame[39]);
+  status.m_max_steps = static_cast<uint8_t>(frame[40]);
+  status.m_cycle_items_used = static_cast<uint8_t>(frame[41]);
+  status.m_max_cycle_items = static_cast<uint8_t>(frame[42]);
+  if (known_version < 3)
+    return status;
+
+  status.m_remaining_margin_s = GetLittleEndian(frame, 43, 4);
+  return status;
+}
+
+////////////////////////////////////////////////////////////////////
+// Class Transport
+Task<Status> Transport::ReadStatusFields()
+{
+  co_return ParseStatus(co_await ReadStatus());
+}
+
+////////////////////////////////////////////////////////////////////
+// Class Client
+
+///Marks the client busy for the lifetime of one operation
+class Client::Operation
+{
+public:
+  explicit Operation(Client& client) : m_client(client)
+  {
+    if (m_client.m_is_busy)
+      throw std::logic_error("openpcr::Client: operations must not overlap");
+    m_client.m_is_busy = true;
+  }
+  ~Operation() { m_client.m_is_busy = false; }
+  Operation(const Operation&) = delete;
+  Operation& operator=(const Operation&) = delete;
+
+private:
+  Client& m_client;
+};
+
+Client::Client(EventLoop& loop, std::unique_ptr<Transport> transport)
+  : m_loop(loop),
+    m_transport(std::move(transport)),
+    m_is_busy(false)
+{
+}
+
+Task<Status> Client::ReadStatus()
+{
+  const Operation operation(*this);
+  co_return co_await m_transport->ReadStatusFields();
+}
+
+Task<> Client::SendCommand(const std::string& command)
+{
+  const Operation operation(*this);
+  co_await m_transport->SendCommand(command);
+}
+
+Task<Status> Client::WaitForCommandId(
+  const unsigned long command_id,
+  const uint64_t poll_interval_ms,
+  const uint64_t timeout_ms)
+{
+  //0 is what an empty status, or one from before any command, reads as
+  if (command_id == 0)
+    throw std::invalid_argument("openpcr::Client: command id 0 is never acknowledged");
+  const uint64_t deadline_ms = EventLoop::GetTimeMs() + timeout_ms;
+  for (;;)
+  {
+    const Status status = co_await ReadStatus();
+    if (status.m_command_id == command_id)
+      co_return status;
+    if (EventLoop::GetTimeMs() + poll_interval_ms > deadline_ms)
+      throw std::runtime_error("openpcr::Client: unit did not acknowledge command " + std::to_string(command_id));
+    co_await m_loop.Sleep(poll_interval_ms);
+  }
+}
+
+StatusStream Client::Stream(const uint64_t interval_ms)
+{
+  return StatusStream(*this, interval_ms);
+}
+
+////////////////////////////////////////////////////////////////////
+// Class StatusStream
+StatusStream::StatusStream(Client& client, const uint64_t interval_ms)
+  : m_client(client),
+    m_interval_ms(interval_ms),
+    m_next_time_ms(EventLoop::GetTimeMs())
+{
+}
+
+Task<Status> StatusStream::Next()
+{
+  co_await m_client.GetLoop().SleepUntil(m_next_time_ms);
+  //before reading, so a read that throws does not make the caller retry at once
+  SkipPast(EventLoop::GetTimeMs());
+  const Status status = co_await m_client.ReadStatus();
+  SkipPast(EventLoop::GetTimeMs());
+  co_return status;
+}
+
+void StatusStream::SkipPast(const uint64_t time_ms)
+{
+  //stay on the original grid, skipping the samples we were too late for
+  if (m_next_time_ms <= time_ms)
+    m_next_time_ms += ((time_ms - m_next_time_ms) / m_interval_ms + 1) * m_interval_ms;
+}
+
+} //~namespace openpcr
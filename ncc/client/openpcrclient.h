@@ -0,0 +1,142 @@
+#ifndef OPENPCR_OPENPCRCLIENT_H
+#define OPENPCR_OPENPCRCLIENT_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "eventloop.h"
+#include "task.h"
+
+//Client library for OpenPCR units. All operations are coroutines on one
+//EventLoop, so a single thread drives any number of units:
+//
+//  openpcr::EventLoop loop;
+//  openpcr::Client pcr(loop, openpcr::MassStorageTransport::Open(loop, "/media/OPENPCR"));
+//  loop.Spawn([&]() -> openpcr::Task<> {
+//    co_await pcr.SendCommand("s=ACGTC&c=start&d=7&l=110&n=Test&p=(1[30|95|Melt|0])");
+//    co_await pcr.WaitForCommandId(7);
+//    openpcr::StatusStream samples = pcr.Stream(1000);
+//    for (;;)
+//    {
+//      const openpcr::Status status = co_await samples.Next();
+//      ...
+//    }
+//  }());
+//  loop.Run();
+
+namespace openpcr {
+
+///The fields of STATUS.TXT, as the firmware's SerialControl::SendStatus
+///writes them. Fields the firmware did not send keep their defaults.
+struct Status
+{
+  Status();
+
+  unsigned long m_command_id; //d, id of the last command the unit received
+  std::string m_state;        //s, "running", "complete", "stopped", ...
+  int m_lid_temp;             //l, degrees C
+  double m_block_temp;        //b, degrees C
+  std::string m_thermal_state;//t, "heating", "cooling", "holding" or "idle"
+  int m_contrast;             //o
+  unsigned long m_elapsed_s;  //e
+  unsigned long m_remaining_s;//r
+  unsigned long m_remaining_margin_s; //q, the remaining time is within this of m_remaining_s about 95% of the time; 0 if not reported
+  int m_num_cycles;           //u
+  int m_cycle;                //c
+  std::string m_step_name;    //p
+  std::string m_version;      //v
+  int m_command_status;       //x, why the last command was rejected, a PcrStatus; 0 if it was not
+  //program capacity, from a status frame only: the most cycles, steps and
+  //steps in one cycle used since the unit started, against its limits.
+  //All 0 if not reported.
+  int m_cycles_used;
+  int m_max_cycles;
+  int m_steps_used;
+  int m_max_steps;
+  int m_cycle_items_used;
+  int m_max_cycle_items;
+  std::string m_raw;          //the text as read, padding removed; empty for a status frame
+};
+
+///Parse 'key=value&key=value...' status text
+Status ParseStatus(const std::string& text);
+
+///Decode the binary status frame of a STATUS_FRAME_RESP packet, laid out
+///as the firmware's serialcontrol.h describes. Throws std::runtime_error
+///if the frame is too short or of an unknown version.
+Status DecodeStatusFrame(const std::string& frame);
+
+///How a Client reaches a unit. Implementations carry out one operation
+///at a time; Client makes sure they are not asked for more.
+class Transport
+{
+public:
+  virtual ~Transport() {}
+
+  ///The status text, without the padding the firmware adds
+  virtual Task<std::string> ReadStatus() = 0;
+
+  ///The status as fields, parsed from ReadStatus unless the transport
+  ///has a more direct way to get them
+  virtual Task<Status> ReadStatusFields();
+
+  ///A command as the host app writes it to CONTROL.TXT, e.g.
+  ///s=ACGTC&c=start&d=7&l=110&n=Test&p=(1[30|95|Melt|0])
+  virtual Task<> SendCommand(const std::string& command) = 0;
+};
+
+class StatusStream;
+
+///One OpenPCR unit. Operations on one Client must not overlap: await each
+///before starting the next, or use one Client per concurrent task.
+class Client
+{
+public:
+  Client(EventLoop& loop, std::unique_ptr<Transport> transport);
+
+  Task<Status> ReadStatus();
+  Task<> SendCommand(const std::string& command);
+
+  ///Poll the status until the unit reports command_id as its last
+  ///command; an empty status, or one with no id, does not count.
+  ///command_id must not be 0. Throws std::runtime_error after timeout_ms.
+  Task<Status> WaitForCommandId(
+    const unsigned long command_id,
+    const uint64_t poll_interval_ms = 1000,
+    const uint64_t timeout_ms = 60000);
+
+  ///Status samples every interval_ms
+  StatusStream Stream(const uint64_t interval_ms);
+
+  EventLoop& GetLoop() { return m_loop; }
+
+private:
+  class Operation;
+
+  EventLoop& m_loop;
+  std::unique_ptr<Transport> m_transport;
+  bool m_is_busy;
+};
+
+///Status samples at a fixed rate. Next waits for the next sample time, so
+///a slow consumer skips samples rather than falling further behind.
+class StatusStream
+{
+public:
+  StatusStream(Client& client, const uint64_t interval_ms);
+
+  Task<Status> Next();
+
+private:
+  ///Move the next sample time to the first one on the grid after time_ms
+  void SkipPast(const uint64_t time_ms);
+
+  Client& m_client;
+  const uint64_t m_interval_ms;
+  uint64_t m_next_time_ms;
+};
+
+} //~namespace openpcr
+
+#endif // OPENPCR_OPENPCRCLIENT_H
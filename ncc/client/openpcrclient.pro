@@ -0,0 +1,28 @@
+#Client library for OpenPCR units: coroutine operations on a
+#single-threaded event loop, over the USB drive (O_DIRECT), the serial
+#port or the firmware simulator (arduino/openpcr_sim -s). Linux only,
+#needs a C++20 compiler.
+
+QT -= core gui
+TEMPLATE = lib
+CONFIG += staticlib
+CONFIG -= qt
+
+TARGET = openpcrclient
+
+QMAKE_CXXFLAGS += -std=c++20 -Wall -Wextra
+
+SOURCES += \
+    emulatortransport.cpp \
+    eventloop.cpp \
+    massstoragetransport.cpp \
+    openpcrclient.cpp \
+    serialtransport.cpp
+
+HEADERS += \
+    emulatortransport.h \
+    eventloop.h \
+    massstoragetransport.h \
+    openpcrclient.h \
+    serialtransport.h \
+    task.h
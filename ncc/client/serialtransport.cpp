@@ -0,0 +1,170 @@
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "serialtransport.h"
+
+namespace openpcr {
+
+std::unique_ptr<SerialTransport> SerialTransport::Open(EventLoop& loop, const std::string& device_path)
+{
+  const int fd = open(device_path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0)
+    throw std::system_error(errno, std::generic_category(), "open " + device_path);
+
+  termios tty;
+  if (tcgetattr(fd, &tty) < 0)
+  {
+    const int error = errno;
+    close(fd);
+    throw std::system_error(error, std::generic_category(), "tcgetattr " + device_path);
+  }
+  cfmakeraw(&tty);
+  cfsetispeed(&tty, B4800);
+  cfsetospeed(&tty, B4800);
+  tty.c_cflag |= CLOCAL | CREAD;
+  if (tcsetattr(fd, TCSANOW, &tty) < 0)
+  {
+    const int error = errno;
+    close(fd);
+    throw std::system_error(error, std::generic_category(), "tcsetattr " + device_path);
+  }
+  return std::unique_ptr<SerialTransport>(new SerialTransport(loop, fd));
+}
+
+SerialTransport::SerialTransport(EventLoop& loop, const int fd)
+  : m_loop(loop),
+    m_fd(fd),
+    m_timeout_ms(2000),
+    m_use_status_frame(false),
+    m_received()
+{
+  fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_NONBLOCK);
+}
+
+SerialTransport::~SerialTransport()
+{
+  close(m_fd);
+}
+
+std::vector<uint8_t> SerialTransport::Encode(const PacketType type, const std::string& payload)
+{
+  std::vector<uint8_t> body;
+  for (const char c : payload)
+  {
+    if (static_cast<uint8_t>(c) == m_start_code)
+      body.push_back(m_escape_code);
+    body.push_back(static_cast<uint8_t>(c));
+  }
+
+  //the length counts the bytes on the wire, escape codes included
+  const std::string::size_type length = m_header_length + body.size();
+  if (length > 0xFFFF)
+    throw std::length_error("openpcr::SerialTransport: payload too long");
+  std::vector<uint8_t> packet;
+  packet.push_back(m_start_code);
+  packet.push_back(length & 0xFF);
+  packet.push_back((length >> 8) & 0xFF);
+  packet.push_back(type);
+  packet.insert(packet.end(), body.begin(), body.end());
+  return packet;
+}
+
+Task<std::string> SerialTransport::ReadStatus()
+{
+  co_await Write(Encode(EStatusRequest, std::string()));
+  const std::string payload = co_await ReadPacket(EStatusResponse);
+  const std::string::size_type end = payload.find_last_not_of(std::string(" \0", 2));
+  co_return end == std::string::npos ? std::string() : payload.substr(0, end + 1);
+}
+
+Task<Status> SerialTransport::ReadStatusFields()
+{
+  if (!m_use_status_frame)
+    co_return co_await Transport::ReadStatusFields();
+  co_await Write(Encode(EStatusFrameRequest, std::string()));
+  co_return DecodeStatusFrame(co_await ReadPacket(EStatusFrameResponse));
+}
+
+Task<> SerialTransport::SendCommand(const std::string& command)
+{
+  co_await Write(Encode(ESendCommand, command));
+}
+
+Task<> SerialTransport::Write(const std::vector<uint8_t>& bytes)
+{
+  const uint64_t deadline_ms = EventLoop::GetTimeMs() + m_timeout_ms;
+  std::vector<uint8_t>::size_type written = 0;
+  while (written != bytes.size())
+  {
+    const ssize_t n = write(m_fd, bytes.data() + written, bytes.size() - written);
+    if (n > 0)
+    {
+      written += n;
+      continue;
+    }
+    if (n < 0 && errno != EAGAIN && errno != EINTR)
+      throw std::system_error(errno, std::generic_category(), "write");
+    if (!co_await m_loop.Writable(m_fd, deadline_ms))
+      throw std::runtime_error("openpcr::SerialTransport: write timed out");
+  }
+}
+
+Task<std::string> SerialTransport::ReadPacket(const PacketType type)
+{
+  const uint64_t deadline_ms = EventLoop::GetTimeMs() + m_timeout_ms;
+  for (;;)
+  {
+    //drop anything before an unescaped start code
+    std::vector<uint8_t>::size_type start = 0;
+    while (start != m_received.size()
+      && (m_received[start] != m_start_code || (start > 0 && m_received[start - 1] == m_escape_code)))
+      ++start;
+    m_received.erase(m_received.begin(), m_received.begin() + start);
+
+    if (m_received.size() >= static_cast<std::vector<uint8_t>::size_type>(m_header_length))
+    {
+      const unsigned length = m_received[1] | (m_received[2] << 8);
+      if (length < static_cast<unsigned>(m_header_length))
+      {
+        m_received.erase(m_received.begin());
+        continue;
+      }
+      if (m_received.size() >= length)
+      {
+        std::string payload;
+        for (unsigned i = m_header_length; i != length; ++i)
+        {
+          if (m_received[i] == m_escape_code && i + 1 != length && m_received[i + 1] == m_start_code)
+            continue;
+          payload += static_cast<char>(m_received[i]);
+        }
+        const uint8_t received_type = m_received[3] & 0xF0;
+        m_received.erase(m_received.begin(), m_received.begin() + length);
+        if (received_type == type)
+          co_return payload;
+        continue;
+      }
+    }
+
+    uint8_t buffer[256];
+    const ssize_t n = read(m_fd, buffer, sizeof(buffer));
+    if (n > 0)
+    {
+      m_received.insert(m_received.end(), buffer, buffer + n);
+      continue;
+    }
+    if (n == 0)
+      throw std::runtime_error("openpcr::SerialTransport: connection closed");
+    if (errno != EAGAIN && errno != EINTR)
+      throw std::system_error(errno, std::generic_category(), "read");
+    if (!co_await m_loop.Readable(m_fd, deadline_ms))
+      throw std::runtime_error("openpcr::SerialTransport: no reply from the unit");
+  }
+}
+
+} //~namespace openpcr
@@ -0,0 +1,70 @@
+#ifndef OPENPCR_SERIALTRANSPORT_H
+#define OPENPCR_SERIALTRANSPORT_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "eventloop.h"
+#include "openpcrclient.h"
+
+namespace openpcr {
+
+///A unit whose controller is reached through its serial port, speaking
+///the packet protocol of the firmware's SerialControl directly: a start
+///code, a 16-bit length including the 4-byte header, a packet type and
+///the payload, with start codes in the payload escaped.
+class SerialTransport : public Transport
+{
+public:
+  ///Open a serial device, e.g. /dev/ttyUSB0, at the firmware's 4800 baud
+  static std::unique_ptr<SerialTransport> Open(EventLoop& loop, const std::string& device_path);
+  ///Use a descriptor that is already connected, e.g. a pipe to the emulator
+  SerialTransport(EventLoop& loop, const int fd);
+  ~SerialTransport();
+
+  Task<std::string> ReadStatus() override;
+  Task<Status> ReadStatusFields() override;
+  Task<> SendCommand(const std::string& command) override;
+
+  ///Ask for the binary status frame rather than the status text when
+  ///reading fields. Firmware before the frame was added does not answer.
+  void SetUseStatusFrame(const bool use_status_frame) { m_use_status_frame = use_status_frame; }
+
+  ///How long to wait for a reply before giving up
+  void SetTimeoutMs(const uint64_t timeout_ms) { m_timeout_ms = timeout_ms; }
+
+  enum PacketType
+  {
+    ESendCommand    = 0x10,
+    EStatusRequest  = 0x40,
+    EStatusFrameRequest  = 0x50,
+    EStatusResponse = 0x80,
+    EStatusFrameResponse = 0x90
+  };
+  static constexpr uint8_t m_start_code = 0xFF;
+  static constexpr uint8_t m_escape_code = 0xFE;
+  static constexpr int m_header_length = 4;
+
+  ///A packet as it goes on the wire
+  static std::vector<uint8_t> Encode(const PacketType type, const std::string& payload);
+
+protected:
+  int GetFd() const { return m_fd; }
+
+private:
+  Task<> Write(const std::vector<uint8_t>& bytes);
+  ///The payload of the next packet of the given type
+  Task<std::string> ReadPacket(const PacketType type);
+
+  EventLoop& m_loop;
+  const int m_fd;
+  uint64_t m_timeout_ms;
+  bool m_use_status_frame;
+  std::vector<uint8_t> m_received; //bytes read but not yet parsed
+};
+
+} //~namespace openpcr
+
+#endif // OPENPCR_SERIALTRANSPORT_H
@@ -0,0 +1,114 @@
+#ifndef OPENPCR_TASK_H
+#define OPENPCR_TASK_H
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace openpcr {
+
+namespace detail {
+
+//Resumes whoever co_awaited the finished task
+struct FinalAwaiter
+{
+  bool await_ready() const noexcept { return false; }
+  template <class Promise>
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+  {
+    const std::coroutine_handle<> continuation = handle.promise().m_continuation;
+    return continuation ? continuation : std::noop_coroutine();
+  }
+  void await_resume() const noexcept {}
+};
+
+struct PromiseBase
+{
+  std::suspend_always initial_suspend() const noexcept { return {}; }
+  FinalAwaiter final_suspend() const noexcept { return {}; }
+  void unhandled_exception() { m_error = std::current_exception(); }
+
+  std::coroutine_handle<> m_continuation;
+  std::exception_ptr m_error;
+};
+
+template <class T>
+struct Promise : PromiseBase
+{
+  template <class U>
+  void return_value(U&& value) { m_value.emplace(std::forward<U>(value)); }
+  T Result()
+  {
+    if (m_error)
+      std::rethrow_exception(m_error);
+    return std::move(*m_value);
+  }
+
+  std::optional<T> m_value;
+};
+
+template <>
+struct Promise<void> : PromiseBase
+{
+  void return_void() const noexcept {}
+  void Result()
+  {
+    if (m_error)
+      std::rethrow_exception(m_error);
+  }
+};
+
+} //~namespace detail
+
+///A lazily started coroutine producing a T. It runs when co_awaited and
+///resumes the awaiting coroutine when done; exceptions thrown inside it
+///are rethrown from the co_await.
+template <class T = void>
+class Task
+{
+public:
+  struct promise_type : detail::Promise<T>
+  {
+    Task get_return_object()
+    {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+  };
+
+  Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+  Task& operator=(Task&& other) noexcept
+  {
+    if (this != &other)
+    {
+      if (m_handle)
+        m_handle.destroy();
+      m_handle = std::exchange(other.m_handle, nullptr);
+    }
+    return *this;
+  }
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+  ~Task()
+  {
+    if (m_handle)
+      m_handle.destroy();
+  }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+  {
+    m_handle.promise().m_continuation = awaiting;
+    return m_handle;
+  }
+  T await_resume() { return m_handle.promise().Result(); }
+
+private:
+  explicit Task(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+
+  std::coroutine_handle<promise_type> m_handle;
+};
+
+} //~namespace openpcr
+
+#endif // OPENPCR_TASK_H
@@ -1,29 +1,257 @@
+#include <cstdlib>
 #include <iostream>
-#include <fcntl.h>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-char buf[4096] __attribute__((aligned (16)));
+#include "massstoragetransport.h"
+#include "openpcrclient.h"
+#include "statusformat.h"
 
-int main (int argc, char * const argv[]) {
-	if (argc != 2) {
+//Reads STATUS.TXT of an OpenPCR unit mounted as a USB drive, bypassing the
+//page cache so each read reaches the unit.
+//
+//  ncc [-f format] <path of STATUS.TXT>
+//    Print the status once, as the host app reads it
+//  ncc [-f format] -i <interval_ms> <path of STATUS.TXT>...
+//    Keep the files open and print the status as one line every
+//    interval_ms until killed, so a host polling units does not start
+//    a process for every read. With more than one unit, as on a bench,
+//    each line starts with the unit's mount path and a tab; all units are
+//    read from one event loop.
+//
+//  ncc send [-f format] [-t timeout_ms] <path of CONTROL.TXT> <key=value>...
+//    Write a command, e.g. c=start l=110 n=Test p=(1[30|95|Melt|0]), then
+//    wait up to timeout_ms for the unit to report it as its last command
+//    and print the status it reports. The signature and a random command
+//    id (d) are added unless given. Exits with 1 if the unit did not
+//    acknowledge the command in time or rejected it.
+//
+//format is text, the default, or json, csv or binary for the parsed
+//fields with a monotonic timestamp, as statusformat.h describes. A path
+//may also be the directory the unit is mounted on; a path to any other
+//file is an error.
+
+#define COMMAND_SIGNATURE      "s=ACGTC" //FILE_SIGNATURE of the USB bridge
+#define SEND_POLL_INTERVAL_MS  200
+#define SEND_TIMEOUT_MS        10000
+
+namespace {
+
+struct Options {
+	uint64_t intervalMs; //0 to read once
+	OutputFormat format;
+	bool isTagged;       //put the mount path before each text line
+};
+
+//The directory the unit is mounted on, from that directory or the path of
+//fileName on it. The name is matched regardless of case, as the unit's FAT
+//volume may be mounted with lower case names.
+std::string GetMountPath(const std::string& filePath, const char* fileName) {
+	struct stat info;
+	if (stat(filePath.c_str(), &info) == 0 && S_ISDIR(info.st_mode))
+		return filePath;
+	const std::string::size_type slash = filePath.rfind('/');
+	const std::string baseName = slash == std::string::npos ? filePath : filePath.substr(slash + 1);
+	if (strcasecmp(baseName.c_str(), fileName) != 0)
+		throw std::invalid_argument("not " + std::string(fileName) + " or a directory: " + filePath);
+	if (slash == std::string::npos)
+		return ".";
+	return slash == 0 ? "/" : filePath.substr(0, slash);
+}
+
+//false if text is not a positive number of milliseconds
+bool ParseMs(const char* text, uint64_t& ms) {
+	char* end;
+	ms = std::strtoull(text, &end, 10);
+	return *text != '\0' && *end == '\0' && ms > 0;
+}
+
+//The command text for params, with the signature first. commandId is the
+//id the params give, or a new one that is added to the command.
+std::string ComposeCommand(const std::vector<std::string>& params, unsigned long& commandId) {
+	std::string command = COMMAND_SIGNATURE;
+	bool hasId = false;
+	for (const std::string& param : params) {
+		if (param.size() < 2 || param[1] != '=')
+			throw std::invalid_argument("not a key=value parameter: " + param);
+		if (param[0] == 's')
+			continue;
+		if (param[0] == 'd') {
+			//the unit keeps the id in 16 bits and reports 0 before any command
+			const std::string id = param.substr(2);
+			if (id.empty() || id.size() > 5 || id.find_first_not_of("0123456789") != std::string::npos
+			    || (commandId = std::strtoul(id.c_str(), NULL, 10)) == 0 || commandId > 65535)
+				throw std::invalid_argument("command id must be 1 to 65535: " + param);
+			hasId = true;
+		}
+		command += "&" + param;
+	}
+	if (!hasId) {
+		//as the host app does, so a command is not taken for one sent before
+		std::random_device random;
+		commandId = std::uniform_int_distribution<unsigned long>(1, 65535)(random);
+		command += "&d=" + std::to_string(commandId);
+	}
+	return command;
+}
+
+void PrintSample(const StatusSample& sample, const Options& options) {
+	if (options.format != ETextFormat)
+		WriteSample(std::cout, options.format, sample);
+	else if (options.intervalMs == 0)
+		std::cout << sample.status.m_raw; //no newline, as the host app takes the output as the file's text
+	else if (options.isTagged)
+		std::cout << sample.unitPath << '\t' << sample.status.m_raw << '\n';
+	else
+		std::cout << sample.status.m_raw << '\n';
+	std::cout.flush();
+}
+
+openpcr::Task<> PrintSamples(openpcr::Client& pcr, StatusSample sample, const Options options) {
+	if (options.intervalMs == 0) {
+		sample.status = co_await pcr.ReadStatus();
+		sample.timeMs = openpcr::EventLoop::GetTimeMs();
+		PrintSample(sample, options);
+		co_return;
+	}
+
+	openpcr::StatusStream samples = pcr.Stream(options.intervalMs);
+	for (;;) {
+		try {
+			sample.status = co_await samples.Next();
+			sample.timeMs = openpcr::EventLoop::GetTimeMs();
+			PrintSample(sample, options);
+		} catch (const std::system_error& e) {
+			//keep polling, the unit may be back by the next sample
+			std::cerr << "ncc: " << (options.isTagged ? sample.unitPath + "\t" : std::string()) << e.what() << std::endl;
+		}
+	}
+}
+
+openpcr::Task<> SendCommand(openpcr::Client& pcr, const std::string command, const unsigned long commandId,
+                            const uint64_t timeoutMs, StatusSample sample, const Options options) {
+	co_await pcr.SendCommand(command);
+	sample.status = co_await pcr.WaitForCommandId(commandId, SEND_POLL_INTERVAL_MS, timeoutMs);
+	sample.timeMs = openpcr::EventLoop::GetTimeMs();
+	PrintSample(sample, options);
+	if (sample.status.m_command_status != 0)
+		throw std::runtime_error("unit rejected the command, status " + std::to_string(sample.status.m_command_status));
+}
+
+int PrintStatus(const std::vector<std::string>& filePaths, const Options& options) {
+	try {
+		openpcr::EventLoop loop;
+		std::vector<std::unique_ptr<openpcr::Client> > units;
+		WriteHeader(std::cout, options.format);
+		for (const std::string& filePath : filePaths) {
+			StatusSample sample;
+			sample.timeMs = 0;
+			sample.unit = units.size();
+			sample.unitPath = GetMountPath(filePath, "STATUS.TXT");
+			units.emplace_back(new openpcr::Client(loop, openpcr::MassStorageTransport::Open(loop, sample.unitPath)));
+			loop.Spawn(PrintSamples(*units.back(), sample, options));
+		}
+		loop.Run();
+	} catch (const std::exception& e) {
+		std::cerr << "ncc: " << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
+
+int Send(int argc, char * const argv[]) {
+	Options options;
+	options.intervalMs = 0;
+	options.format = ETextFormat;
+	options.isTagged = false;
+	uint64_t timeoutMs = SEND_TIMEOUT_MS;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "f:t:")) != -1) {
+		switch (opt) {
+		case 'f':
+			if (!ParseOutputFormat(optarg, options.format)) {
+				std::cerr << "ncc: unknown format " << optarg << "\n";
+				return 1;
+			}
+			break;
+		case 't':
+			if (!ParseMs(optarg, timeoutMs)) {
+				std::cerr << "ncc: invalid timeout " << optarg << "\n";
+				return 1;
+			}
+			break;
+		default:
+			return 1;
+		}
+	}
+	if (argc - optind < 2) {
 		std::cout << "Incorrect usage\n";
 		return 0;
 	}
 
-	//align buffer to 4096 boundary. Linker alignment limited this to 128 bytes, so doing it 
-	//brute-force as have tons of memory to waste
-	char buf[8192];
-	char* pBuf = (char*)(((unsigned int)&buf / 4096) * 4096 + 4096);
+	try {
+		unsigned long commandId;
+		const std::string command = ComposeCommand(std::vector<std::string>(argv + optind + 1, argv + argc), commandId);
+		StatusSample sample;
+		sample.timeMs = 0;
+		sample.unit = 0;
+		sample.unitPath = GetMountPath(argv[optind], "CONTROL.TXT");
 
-	int fHandle;
-	if (fHandle = open(argv[1], O_RDONLY | O_DIRECT)) {
-		int bytesRead = read(fHandle, pBuf, 4096);
-		pBuf[bytesRead] = '\0';
-		std::cout << pBuf;
-	} else {
-		std::cerr << "Failed to open direct access";
+		openpcr::EventLoop loop;
+		openpcr::Client pcr(loop, openpcr::MassStorageTransport::Open(loop, sample.unitPath));
+		WriteHeader(std::cout, options.format);
+		loop.Spawn(SendCommand(pcr, command, commandId, timeoutMs, sample, options));
+		loop.Run();
+	} catch (const std::exception& e) {
+		std::cerr << "ncc: " << e.what() << "\n";
+		return 1;
 	}
-	close(fHandle);
-	
 	return 0;
 }
 
+} //~namespace
+
+int main (int argc, char * const argv[]) {
+	if (argc > 1 && std::string(argv[1]) == "send")
+		return Send(argc - 1, argv + 1);
+
+	Options options;
+	options.intervalMs = 0;
+	options.format = ETextFormat;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "f:i:")) != -1) {
+		switch (opt) {
+		case 'f':
+			if (!ParseOutputFormat(optarg, options.format)) {
+				std::cerr << "ncc: unknown format " << optarg << "\n";
+				return 1;
+			}
+			break;
+		case 'i':
+			if (!ParseMs(optarg, options.intervalMs)) {
+				std::cerr << "ncc: invalid interval " << optarg << "\n";
+				return 1;
+			}
+			break;
+		default:
+			return 1;
+		}
+	}
+
+	const std::vector<std::string> filePaths(argv + optind, argv + argc);
+	if (filePaths.empty() || (options.intervalMs == 0 && filePaths.size() != 1)) {
+		std::cout << "Incorrect usage\n";
+		return 0;
+	}
+	options.isTagged = filePaths.size() > 1;
+	return PrintStatus(filePaths, options);
+}
@@ -0,0 +1,36 @@
+#ncc, which the host app runs to read STATUS.TXT of a unit mounted as a
+#USB drive, once or as a long-running poller of one or more units:
+#
+#  ./ncc [-f text|json|csv|binary] [-i interval_ms] /media/OPENPCR/STATUS.TXT...
+#
+#and to send one a command, waiting for the unit to acknowledge it:
+#
+#  ./ncc send [-t timeout_ms] /media/OPENPCR/CONTROL.TXT c=stop
+#
+#Built with the client library in ../client. Linux only, needs a C++20
+#compiler.
+
+QT -= core gui
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle qt
+
+TARGET = ncc
+
+QMAKE_CXXFLAGS += -std=c++20 -Wall -Wextra
+
+INCLUDEPATH += ../client
+
+SOURCES += \
+    main.cpp \
+    statusformat.cpp \
+    ../client/eventloop.cpp \
+    ../client/massstoragetransport.cpp \
+    ../client/openpcrclient.cpp
+
+HEADERS += \
+    statusformat.h \
+    ../client/eventloop.h \
+    ../client/massstoragetransport.h \
+    ../client/openpcrclient.h \
+    ../client/task.h
@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+#include "statusformat.h"
+
+namespace {
+
+//Thermocycler::ProgramState and ThermalState, as SendStatus spells them
+const char* const programStates[] = { "startup", "stopped", "lidwait", "running", "complete", "error" };
+const char* const thermalStates[] = { "holding", "heating", "cooling", "idle" };
+
+uint8_t GetStateIndex(const char* const states[], const int nStates, const std::string& state) {
+	for (int i = 0; i < nStates; i++) {
+		if (state == states[i])
+			return i;
+	}
+	return 255;
+}
+
+void PutLittleEndian(char* pBuf, uint64_t val, const int size) {
+	for (int i = 0; i < size; i++, val >>= 8)
+		pBuf[i] = (char)(val & 0xFF);
+}
+
+//value as a JSON string, quotes included
+std::string GetJsonString(const std::string& value) {
+	std::string json = "\"";
+	for (const char c : value) {
+		if (c == '"' || c == '\\') {
+			json += '\\';
+			json += c;
+		} else if ((unsigned char)c < 0x20) {
+			char escape[8];
+			snprintf(escape, sizeof(escape), "\\u%04x", (unsigned char)c);
+			json += escape;
+		} else {
+			json += c;
+		}
+	}
+	return json + "\"";
+}
+
+//value as a CSV field, quoted only if it has to be
+std::string GetCsvString(const std::string& value) {
+	if (value.find_first_of(",\"\r\n") == std::string::npos)
+		return value;
+	std::string csv = "\"";
+	for (const char c : value) {
+		if (c == '"')
+			csv += '"';
+		csv += c;
+	}
+	return csv + "\"";
+}
+
+void WriteRecord(std::ostream& out, const StatusSample& sample) {
+	const openpcr::Status& status = sample.status;
+	char record[STATUS_RECORD_SIZE];
+	memset(record, 0, sizeof(record));
+	record[0] = STATUS_RECORD_VERSION;
+	record[1] = (char)sample.unit;
+	record[2] = GetStateIndex(programStates, std::size(programStates), status.m_state);
+	record[3] = GetStateIndex(thermalStates, std::size(thermalStates), status.m_thermal_state);
+	PutLittleEndian(record + 4, sample.timeMs, 8);
+	PutLittleEndian(record + 12, status.m_command_id, 4);
+	PutLittleEndian(record + 16, (uint16_t)(int16_t)status.m_lid_temp, 2);
+	const double blockDeciC = status.m_block_temp * 10;
+	PutLittleEndian(record + 18, (uint16_t)(int16_t)(blockDeciC >= 0 ? blockDeciC + 0.5 : blockDeciC - 0.5), 2);
+	PutLittleEndian(record + 20, status.m_elapsed_s, 4);
+	PutLittleEndian(record + 24, status.m_remaining_s, 4);
+	PutLittleEndian(record + 28, status.m_remaining_margin_s, 4);
+	PutLittleEndian(record + 32, status.m_num_cycles, 2);
+	PutLittleEndian(record + 34, status.m_cycle, 2);
+	record[36] = (char)status.m_contrast;
+	record[37] = (char)status.m_command_status;
+	memcpy(record + 38, status.m_step_name.data(), std::min(status.m_step_name.size(), (size_t)STATUS_RECORD_STEP_NAME_LENGTH));
+	out.write(record, sizeof(record));
+}
+
+} //~namespace
+
+bool ParseOutputFormat(const std::string& name, OutputFormat& format) {
+	if (name == "text")
+		format = ETextFormat;
+	else if (name == "json")
+		format = EJsonFormat;
+	else if (name == "csv")
+		format = ECsvFormat;
+	else if (name == "binary")
+		format = EBinaryFormat;
+	else
+		return false;
+	return true;
+}
+
+void WriteHeader(std::ostream& out, const OutputFormat format) {
+	if (format == ECsvFormat)
+		out << "time_ms,unit,unit_path,command_id,state,lid_temp,block_temp,thermal_state,contrast,"
+		       "elapsed_s,remaining_s,remaining_margin_s,num_cycles,cycle,step_name,version,command_status\n";
+}
+
+void WriteSample(std::ostream& out, const OutputFormat format, const StatusSample& sample) {
+	const openpcr::Status& status = sample.status;
+	switch (format) {
+	case EJsonFormat:
+		out << "{\"time_ms\":" << sample.timeMs
+		    << ",\"unit\":" << sample.unit
+		    << ",\"unit_path\":" << GetJsonString(sample.unitPath)
+		    << ",\"command_id\":" << status.m_command_id
+		    << ",\"state\":" << GetJsonString(status.m_state)
+		    << ",\"lid_temp\":" << status.m_lid_temp
+		    << ",\"block_temp\":" << status.m_block_temp
+		    << ",\"thermal_state\":" << GetJsonString(status.m_thermal_state)
+		    << ",\"contrast\":" << status.m_contrast
+		    << ",\"elapsed_s\":" << status.m_elapsed_s
+		    << ",\"remaining_s\":" << status.m_remaining_s
+		    << ",\"remaining_margin_s\":" << status.m_remaining_margin_s
+		    << ",\"num_cycles\":" << status.m_num_cycles
+		    << ",\"cycle\":" << status.m_cycle
+		    << ",\"step_name\":" << GetJsonString(status.m_step_name)
+		    << ",\"version\":" << GetJsonString(status.m_version)
+		    << ",\"command_status\":" << status.m_command_status
+		    << "}\n";
+		break;
+	case ECsvFormat:
+		out << sample.timeMs << ',' << sample.unit << ',' << GetCsvString(sample.unitPath) << ','
+		    << status.m_command_id << ',' << GetCsvString(status.m_state) << ','
+		    << status.m_lid_temp << ',' << status.m_block_temp << ',' << GetCsvString(status.m_thermal_state) << ','
+		    << status.m_contrast << ',' << status.m_elapsed_s << ',' << status.m_remaining_s << ','
+		    << status.m_remaining_margin_s << ',' << status.m_num_cycles << ',' << status.m_cycle << ','
+		    << GetCsvString(status.m_step_name) << ',' << GetCsvString(status.m_version) << ','
+		    << status.m_command_status << '\n';
+		break;
+	case EBinaryFormat:
+		WriteRecord(out, sample);
+		break;
+	case ETextFormat:
+		out << status.m_raw << '\n';
+		break;
+	}
+}
@@ -0,0 +1,63 @@
+#ifndef STATUSFORMAT_H
+#define STATUSFORMAT_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "openpcrclient.h"
+
+//The structured forms ncc -f prints status samples in. Each sample is one
+//unit's status, with the time it was read on the monotonic clock, so
+//samples of one run compare even if the wall clock is changed.
+//
+//  json    one object per line, fields named as in StatusSample and Status
+//  csv     the same fields, after a header line
+//  binary  one STATUS_RECORD_SIZE byte record per sample, little-endian:
+//
+//    offset size
+//    0      1    STATUS_RECORD_VERSION
+//    1      1    unit
+//    2      1    state: startup, stopped, lidwait, running, complete, error
+//    3      1    thermal state: holding, heating, cooling, idle
+//                (255 for a state this version does not know)
+//    4      8    time, ms
+//    12     4    command id
+//    16     2    lid temperature, signed, C
+//    18     2    block temperature, signed, 0.1 C
+//    20     4    elapsed, s
+//    24     4    remaining, s
+//    28     4    remaining margin, s
+//    32     2    cycles
+//    34     2    cycle
+//    36     1    contrast
+//    37     1    command status
+//    38     14   step name, NUL padded
+
+#define STATUS_RECORD_VERSION  1
+#define STATUS_RECORD_SIZE     52
+#define STATUS_RECORD_STEP_NAME_LENGTH 14
+
+enum OutputFormat {
+	ETextFormat, //the status text as read
+	EJsonFormat,
+	ECsvFormat,
+	EBinaryFormat
+};
+
+struct StatusSample {
+	uint64_t timeMs;      //when it was read, on the monotonic clock
+	int unit;             //index of the unit on the command line
+	std::string unitPath; //the directory the unit is mounted on
+	openpcr::Status status;
+};
+
+//false if name is none of text, json, csv and binary
+bool ParseOutputFormat(const std::string& name, OutputFormat& format);
+
+//Written once, before the first sample; nothing for most formats
+void WriteHeader(std::ostream& out, const OutputFormat format);
+//One sample in a structured format
+void WriteSample(std::ostream& out, const OutputFormat format, const StatusSample& sample);
+
+#endif // STATUSFORMAT_H
@@ -1,3 +1,5 @@
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
 #include <LUFA/Drivers/Peripheral/Serial.h>
 #include "SCSI.h"
 
@@ -26,7 +28,23 @@ typedef PROGMEM struct _FAT_BOOT_RECORD
 		//uint8_t		exeEndMarker[2];		//55 aa
 } FAT_BOOT_RECORD; //total 512 bytes
 
-//Boot Record: 1 sector; FAT1: 1 sector; FAT2: 1 sector; Root Directory: 1 sector
+/*Volume layout, in 512 byte sectors:
+    0       boot record
+    1-17    FAT 1
+    18-34   FAT 2
+    35-66   root directory, 512 entries of 32 bytes
+    67-     data, one sector per cluster, starting at cluster 2
+  4352 sectors leave 4285 clusters, enough for hosts to take the volume as FAT16 */
+#define FAT_SECTORS				17
+#define FAT1_START				1
+#define FAT2_START				(FAT1_START+FAT_SECTORS)
+#define ROOT_DIR_START			(FAT2_START+FAT_SECTORS)
+#define ROOT_DIR_ENTRIES		512
+#define ROOT_DIR_SECTORS		(ROOT_DIR_ENTRIES*32/VIRTUAL_MEMORY_BLOCK_SIZE)
+#define DATA_START				(ROOT_DIR_START+ROOT_DIR_SECTORS)
+#define CLUSTER_SECTOR(cluster)	(DATA_START+(cluster)-2)
+#define FILE_CLUSTERS(size)		(((size)+VIRTUAL_MEMORY_BLOCK_SIZE-1)/VIRTUAL_MEMORY_BLOCK_SIZE)
+
 FAT_BOOT_RECORD PROGMEM fatBootData = 
 {
 		.bootstrap          = {0xeb, 0x3c, 0x90},
@@ -35,10 +53,10 @@ FAT_BOOT_RECORD PROGMEM fatBootData =
 		.iSectorsPerCluster = 1,
 		.iReservedSectors	= 1,
 		.iFATs				= 2,
-		.iRootEntries		= 512,
-		.iTotalSectors		= 4352,
+		.iRootEntries		= ROOT_DIR_ENTRIES,
+		.iTotalSectors		= VIRTUAL_MEMORY_BLOCKS,
 		.iMediaDescr		= 0xf0,
-		.iSectorsPerFAT		= 17,
+		.iSectorsPerFAT		= FAT_SECTORS,
 		.iSectorsPerTrack	= 0,
 		.iHeads				= 0,
 		.iHiddenSectors		= 0,
@@ -52,7 +70,7 @@ FAT_BOOT_RECORD PROGMEM fatBootData =
 	//	.exeEndMarker		= {0x55, 0xaa}
 };
 
- typedef PROGMEM struct
+typedef struct
 {
 		uint8_t		filename[8];
 		uint8_t		ext[3];
@@ -67,7 +85,7 @@ FAT_BOOT_RECORD PROGMEM fatBootData =
 		uint16_t	modified_date;
 		uint16_t	first_cluster_loworder;
 		uint32_t	size;
-} FAT_ROOT_DIRECTORY; //total 512 bytes
+} FAT_ROOT_DIRECTORY; //total 32 bytes
 
 /*date format: bits 0-4: day of month 1-31; bits 5-8: month of year 1-12; bits 9-15: years since 1980 0-127
   time format: bits 0-4: 2 second count 0-29; bits 5-10: minutes 0-59; bits 11-15: hours 0-23  */
@@ -88,62 +106,39 @@ FAT_ROOT_DIRECTORY PROGMEM volumeLabel =
 		.size						= 0
 };
 
-FAT_ROOT_DIRECTORY PROGMEM fileName = 
-{
-		.filename          			= "STATUS  ",
-		.ext						= "TXT",
-		.attribute 					= 0,
-		.reserved 					= 0,
-		.create_time_ms				= 0,
-		.create_time				= 0x8800,
-		.create_date				= 0x3ea1,
-		.access_date				= 0x3ea1,
-		.first_cluster_highorder	= 0,
-		.modified_time				= 0x8800,
-		.modified_date				= 0x3ea1,
-		.first_cluster_loworder		= 2,
-		.size						= 300
-};
-
-FAT_ROOT_DIRECTORY PROGMEM autorun = 
-{
-		.filename          			= "AUTORUN ",
-		.ext						= "INF",
-		.attribute 					= 0,
-		.reserved 					= 0,
-		.create_time_ms				= 0,
-		.create_time				= 0x8800,
-		.create_date				= 0x3ea1,
-		.access_date				= 0x3ea1,
-		.first_cluster_highorder	= 0,
-		.modified_time				= 0x8800,
-		.modified_date				= 0x3ea1,
-		.first_cluster_loworder		= 3,
-		.size						= 32
-};
+const uint8_t PROGMEM bootSignature[] = {0x55, 0xaa};
 
 char PROGMEM autorun_content[] = "[autorun]\r\n";
 uint8_t autorun_content_length = 11;
 
 #define START_CODE				0xFF
+#define ESCAPE_CODE				0xFE
 #define PACKET_HEADER_LENGTH	4
 
 typedef enum{
 	SEND_CMD		= 0x10,
+	LOG_REQ			= 0x20,
+	LOG_RESP		= 0x30,
 	STATUS_REQ		= 0x40,
 	STATUS_RESP		= 0x80	
 }PACKET_TYPE;
 
 #define FILE_SIGNATURE		"s=ACGTC"
 #define FILE_SIGNATURE_LEN	7
-#define FILE_MAX_LENGTH		252
+#define MAX_COMMAND_SIZE	256		//largest packet the firmware takes, header included
+#define MAX_COMMAND_LENGTH	(MAX_COMMAND_SIZE-PACKET_HEADER_LENGTH)
+
+//The last command written, signature included, is kept in the 8U2's EEPROM
+//behind its length and shown as PROGRAM.TXT.
+#define PROGRAM_EEPROM_LENGTH	((uint16_t*)0)
+#define PROGRAM_EEPROM_TEXT		((uint8_t*)2)
 
-bool DoReadFlowControl() {
+bool DoWriteFlowControl() {
 	/* Check if the endpoint is currently full */
 	if (!(Endpoint_IsReadWriteAllowed()))
 	{
 		/* Clear the endpoint bank to send its contents to the host */
-		Endpoint_ClearIN();
+		Endpoint_ClearOUT();
 
 		/* Wait until the endpoint is ready for more data */
 		if (Endpoint_WaitUntilReady())
@@ -153,172 +148,643 @@ bool DoReadFlowControl() {
 	return true;
 }
 
-bool DoWriteFlowControl() {
-	/* Check if the endpoint is currently full */
-	if (!(Endpoint_IsReadWriteAllowed()))
-	{
-		/* Clear the endpoint bank to send its contents to the host */
-		Endpoint_ClearOUT();
+//STATUS.TXT is served from RAM. The main loop keeps asking the unit for its
+//status and receives the response into the back buffer; a complete response
+//becomes the front buffer that ReadBlocks copies, so a SCSI read never waits
+//on the serial line.
+#define STATUS_CACHE_SIZE		100		//STATUS_FILE_LEN in the firmware; the 8U2 has 512 bytes of RAM
+#define RX_BUFFER_SIZE			32		//power of 2
+//timer 1 runs at clk/1 and overflows every 65536/16M = 4.1 ms
+#define STATUS_REFRESH_TICKS	61		//ask again 0.25 secs after a response
+#define STATUS_TIMEOUT_TICKS	244		//or after 1 sec without one
+
+//LOG.CSV is served from RAM the same way, from a cache of the unit's
+//newest log records that the main loop keeps up to date
+#define LOG_RECORD_SIZE			9		//LOG_RECORD_SIZE in the firmware
+#define LOG_MAX_RECORDS			48		//LOG_BLOCKS*LOG_RECORDS_PER_BLOCK in the firmware
+#define LOG_CACHE_RECORDS		15		//LOG.CSV's first sector after the header; all 48 would not fit
+#define LOG_REFRESH_TICKS		244		//ask for new records 1 sec after the last ones
+#define LOG_TIMEOUT_TICKS		122		//or 0.5 secs after a request without a reply
 
-		/* Wait until the endpoint is ready for more data */
-		if (Endpoint_WaitUntilReady())
-		  return false;
-	}
+typedef enum{
+	RX_START,
+	RX_LENGTH_LOW,
+	RX_LENGTH_HIGH,
+	RX_TYPE,
+	RX_PAYLOAD
+}RX_STATE;
+
+//A command the host writes is copied to RAM and left for the main loop to
+//send to the unit and save to EEPROM, so the SCSI write does not wait on
+//either. With 512 bytes of RAM there is no room for it beside the status
+//and log caches, so it takes their place until it is committed; STATUS.TXT
+//reads as empty meanwhile, as before the first status arrives, which the
+//host app skips, and LOG.CSV as just its header.
+static union
+{
+		struct
+		{
+				uint8_t		status[2][STATUS_CACHE_SIZE];
+				uint8_t		log[LOG_CACHE_RECORDS][LOG_RECORD_SIZE];	//a ring, oldest at logHead
+		};
+		uint8_t		command[MAX_COMMAND_LENGTH];
+} transferBuffer;
+static uint8_t statusLength[2] = {0, 0};
+static uint8_t statusFront = 0;
+
+static volatile uint8_t rxBuffer[RX_BUFFER_SIZE];
+static volatile uint8_t rxHead = 0;
+static uint8_t rxTail = 0;
+
+static RX_STATE rxState = RX_START;
+static uint16_t rxRemaining;
+static uint8_t rxType;
+static uint8_t rxLength;
+static bool rxEscape = false;
+
+static bool statusRequested = false;
+static uint8_t statusTicks = STATUS_REFRESH_TICKS;
+
+//The unit numbers its log records and starts each reply with the number
+//of the first one asked for, so the cache asks by number for the record
+//after its newest. Asking by index from the unit's oldest record, the
+//reply also shows where that is now.
+static uint8_t logHead = 0;
+static uint8_t logCount = 0;				//records in the cache
+static uint16_t logNextSequence = 0;		//of the record after the newest cached
+static uint16_t logOldestSequence = 0;		//of the unit's oldest record, as last seen
+static uint16_t logRequestIndex;
+static bool logRequested = false;
+static bool logAccepted;					//the reply carries on from the cache
+static bool logReceived;					//a record of it
+static uint8_t logSequenceLength;			//bytes of the reply's number received
+static uint16_t logSequence;
+static uint8_t logTicks = LOG_REFRESH_TICKS;
+
+//packet being sent to the unit, a byte whenever the UART has room
+static PACKET_TYPE txType;
+static uint16_t txLength;		//on the wire, header and escape codes included
+static uint16_t txIndex = 0;
+static uint16_t txPayloadIndex;
+static bool txEscaped;			//the escape code of the start code at txPayloadIndex is out
+static bool txBusy = false;
+static uint8_t txRequest[3];	//payload of a LOG_REQ
+
+static bool commandPending = false;	//in transferBuffer until sent and saved
+static bool commandQueued;			//SEND_CMD started
+static uint8_t commandLength;
+static uint16_t commandSaved;		//bytes written to EEPROM, the length word last
+
+//bytes arrive every 2 ms at 4800 baud, faster than the main loop comes
+//round during a long SCSI transfer, so collect them in the interrupt
+ISR(USART1_RX_vect)
+{
+	rxBuffer[rxHead] = UDR1;
+	rxHead = (rxHead + 1) & (RX_BUFFER_SIZE - 1);
+}
+
+void DataManager_Init(void)
+{
+	UCSR1B |= (1 << RXCIE1);
+}
 
+static bool TimerTick(void)
+{
+	if (!(TIFR1 & (1 << TOV1)))
+		return false;
+	TIFR1 = (1 << TOV1);
+	if (statusTicks < 0xff)
+		statusTicks++;
+	if (logTicks < 0xff)
+		logTicks++;
 	return true;
 }
 
-bool SerialWaitUntilReady(){
-	//timeout in 50000*60/16M (clock frequency) = 0.1875 secs
-	uint16_t timeout = 60;
-	
-	TCNT1 = 0;
-	while(timeout){
-		if (Serial_IsCharReceived())
-			return true;
-		if (TCNT1 >= 50000){ 
-			TCNT1 = 0;
-			timeout--;
+static void StorePayloadByte(uint8_t data);
+static void EndPacket(void);
+
+static void ReceivePacketByte(uint8_t data)
+{
+	bool escaped = rxEscape;
+	rxEscape = false;
+	if (data == START_CODE && !escaped){
+		rxState = RX_LENGTH_LOW;
+		return;
+	}
+
+	switch (rxState){
+	case RX_START:
+		break;
+	case RX_LENGTH_LOW:
+		rxRemaining = data;
+		rxState = RX_LENGTH_HIGH;
+		break;
+	case RX_LENGTH_HIGH:
+		rxRemaining |= (data << 8);
+		rxState = rxRemaining >= PACKET_HEADER_LENGTH ? RX_TYPE : RX_START;
+		rxRemaining -= PACKET_HEADER_LENGTH;
+		break;
+	case RX_TYPE:
+		rxType = data & 0xf0;
+		rxLength = 0;
+		rxState = RX_PAYLOAD;
+		if (rxRemaining == 0)
+			EndPacket();
+		break;
+	case RX_PAYLOAD:
+		//the length counts escape codes; one is held until the next byte
+		//shows whether it escapes a start code or is data itself
+		if (escaped && data != START_CODE)
+			StorePayloadByte(ESCAPE_CODE);
+		if (data == ESCAPE_CODE)
+			rxEscape = true;
+		else
+			StorePayloadByte(data);
+		if (--rxRemaining == 0){
+			if (rxEscape)
+				StorePayloadByte(ESCAPE_CODE);
+			rxEscape = false;
+			EndPacket();
 		}
+		break;
 	}
+}
 
-	return false;
+static bool ReceiveNextByte(void)
+{
+	if (rxTail == rxHead)
+		return false;
+	ReceivePacketByte(rxBuffer[rxTail]);
+	rxTail = (rxTail + 1) & (RX_BUFFER_SIZE - 1);
+	return true;
 }
 
-/*
-void Endpoint_Write_Zeros(uint16_t size){
-	uint16_t block_index = 0;
+static uint8_t GetPayloadByte(uint16_t index)
+{
+	return txType == SEND_CMD ? transferBuffer.command[index] : txRequest[index];
+}
 
-	while(block_index < size){
-		DoReadFlowControl();
-		for(uint16_t blockdiv16_index = 0; blockdiv16_index < 1; blockdiv16_index++) {
-			Endpoint_Write_Byte(0x00);
-			block_index++;
-			if (block_index >= size)
-				return;
-		}
+static void StartPacket(PACKET_TYPE type, uint16_t payloadLength)
+{
+	txType = type;
+	txLength = PACKET_HEADER_LENGTH + payloadLength;
+	//a start code in the payload goes out behind an escape code, which the
+	//length counts, as the unit escapes its own packets
+	for (uint16_t i = 0; i < payloadLength; i++){
+		if (GetPayloadByte(i) == START_CODE)
+			txLength++;
 	}
+	txIndex = 0;
+	txPayloadIndex = 0;
+	txEscaped = false;
+	txBusy = true;
 }
-*/
 
-void FlushBlock(uint16_t size)
+static void SendPacketByte(void)
 {
-	uint16_t block_index;
-	for (block_index=0; block_index<size; block_index++){
-		DoWriteFlowControl();
-		Endpoint_Read_Byte();
+	uint8_t data;
+	switch (txIndex){
+	case 0:  data = START_CODE; break;
+	case 1:  data = txLength & 0xff; break;
+	case 2:  data = (txLength & 0xff00) >> 8; break;
+	case 3:  data = txType; break;
+	default:
+		data = GetPayloadByte(txPayloadIndex);
+		txEscaped = data == START_CODE && !txEscaped;
+		if (txEscaped)
+			data = ESCAPE_CODE;
+		else
+			txPayloadIndex++;
+		break;
 	}
+	UDR1 = data;
+	txBusy = ++txIndex < txLength;
 }
 
-bool DataManager_ReadBlocks(uint32_t BlockAddress, uint16_t TotalBlocks)
+//ask for the records after the newest cached, or from the unit's oldest
+//when those are gone or the numbering is not the cache's
+static void RequestLog(void)
 {
-	uint16_t block_index = 0;
+	logRequestIndex = logNextSequence - logOldestSequence;
+	if (logRequestIndex > LOG_MAX_RECORDS)
+		logRequestIndex = 0;
+	txRequest[0] = logRequestIndex & 0xff;
+	txRequest[1] = logRequestIndex >> 8;
+	txRequest[2] = LOG_CACHE_RECORDS;
+	logSequence = 0;
+	logSequenceLength = 0;
+	logReceived = false;
+	logRequested = true;
+	logTicks = 0;
+	StartPacket(LOG_REQ, sizeof(txRequest));
+}
 
-	while (TotalBlocks){
-		if (BlockAddress == 0){ //BOOT Record
-			for (block_index=0;block_index<62; block_index++){
-				DoReadFlowControl();
-				Endpoint_Write_Byte(pgm_read_byte(((char*)&fatBootData)+block_index));
-			}
-			for (block_index=0; block_index<448; block_index++){
-				DoReadFlowControl();
-				Endpoint_Write_Byte(0x00);
-			}
-			DoReadFlowControl();
-			Endpoint_Write_Byte(0x55);
-			Endpoint_Write_Byte(0xaa);				
+//one byte of the pending command into EEPROM if the last write is done;
+//a write takes 3.4 ms, so this keeps pace with the UART rather than wait
+static void SaveCommandByte(void)
+{
+	uint16_t textLength = FILE_SIGNATURE_LEN + commandLength;
+	if (commandSaved == textLength + sizeof(uint16_t) || !eeprom_is_ready())
+		return;
+
+	uint8_t* address;
+	uint8_t data;
+	if (commandSaved < textLength){
+		address = PROGRAM_EEPROM_TEXT + commandSaved;
+		if (commandSaved < FILE_SIGNATURE_LEN)
+			data = FILE_SIGNATURE[commandSaved];
+		else
+			data = transferBuffer.command[commandSaved-FILE_SIGNATURE_LEN];
+	}
+	else{
+		//then the length, low byte first
+		address = (uint8_t*)PROGRAM_EEPROM_LENGTH + commandSaved - textLength;
+		data = commandSaved == textLength ? textLength & 0xff : textLength >> 8;
+	}
+	eeprom_update_byte(address, data);
+	commandSaved++;
+}
+
+void DataManager_Task(void)
+{
+	TimerTick();
+	while (ReceiveNextByte());
+
+	if (commandPending){
+		SaveCommandByte();
+		if (!commandQueued && !txBusy){
+			StartPacket(SEND_CMD, commandLength);
+			commandQueued = true;
 		}
-		else if (BlockAddress == 1 || BlockAddress == 18){ //FAT TABLE 1 and 2 (15 blocks)
-			//first two sectors are not used
-			DoReadFlowControl();
-			Endpoint_Write_Byte(0xf0);
-			Endpoint_Write_Byte(0xff);
-			Endpoint_Write_Byte(0xff);
-			Endpoint_Write_Byte(0xff);
-			//sector 2 where data start
-			Endpoint_Write_Byte(0xff);
-			Endpoint_Write_Byte(0xff);
-			//sector 3
-			Endpoint_Write_Byte(0xff);
-			Endpoint_Write_Byte(0xff);
-			
-			for (block_index=8; block_index<VIRTUAL_MEMORY_BLOCK_SIZE; block_index++){
-				DoReadFlowControl();
-				Endpoint_Write_Byte(0x00);
-			}
+		else if (commandQueued && !txBusy && commandSaved == FILE_SIGNATURE_LEN+commandLength+sizeof(uint16_t)){
+			//the caches are free again; ask for a status and the whole log
+			//straight away
+			commandPending = false;
+			statusRequested = false;
+			statusTicks = STATUS_REFRESH_TICKS;
+			logCount = 0;
+			logNextSequence = logOldestSequence;
+			logRequested = false;
+			logTicks = LOG_REFRESH_TICKS;
 		}
-		else if (BlockAddress == 35){	//Root Directory
-			for (block_index=0;block_index<32; block_index++){
-				DoReadFlowControl();
-				Endpoint_Write_Byte(pgm_read_byte(((char*)&volumeLabel)+block_index));
+	}
+
+	if (txBusy){
+		if (UCSR1A & (1 << UDRE1))
+			SendPacketByte();
+	}
+	else if (!commandPending && statusTicks >= (statusRequested ? STATUS_TIMEOUT_TICKS : STATUS_REFRESH_TICKS)){
+		StartPacket(STATUS_REQ, 0);
+		statusRequested = true;
+		statusTicks = 0;
+	}
+	else if (!commandPending && logTicks >= (logRequested ? LOG_TIMEOUT_TICKS : LOG_REFRESH_TICKS))
+		RequestLog();
+}
+
+//the volume is mostly zeros; send them from flash a bank at a time
+static const uint8_t zeroBank[MASS_STORAGE_IO_EPSIZE] PROGMEM = {0};
+
+static uint8_t Endpoint_Write_Zeros(uint16_t size)
+{
+	uint8_t error = ENDPOINT_RWSTREAM_NoError;
+	while (size && error == ENDPOINT_RWSTREAM_NoError){
+		uint16_t chunk = size < sizeof(zeroBank) ? size : sizeof(zeroBank);
+		error = Endpoint_Write_PStream_LE(zeroBank, chunk, NO_STREAM_CALLBACK);
+		size -= chunk;
+	}
+	return error;
+}
+
+//LOG.CSV is the unit's temperature log, as far as the cache holds it: the
+//header, then the newest records, oldest first. Lines have a fixed width
+//and lines past the last record are blank. Each record arrives as 9 bytes
+//(time, plate, lid and target temperature in little endian 16 bits, the
+//last three in 0.1 C, then the drive in percent) and is written out as a
+//line when the host reads the file, which never waits on the unit.
+#define LOG_LINE_LENGTH			32
+#define LOG_LINES_PER_SECTOR	(VIRTUAL_MEMORY_BLOCK_SIZE/LOG_LINE_LENGTH)
+#define LOG_FILE_SIZE			((1+LOG_CACHE_RECORDS)*LOG_LINE_LENGTH)
+
+static const char PROGMEM logHeader[LOG_LINE_LENGTH] = "time_s,plate,lid,target,drive%\r\n";
+//blank lines, which CSV readers skip, rather than NULs
+static const char PROGMEM logPadding[LOG_LINE_LENGTH] = "\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n";
+
+static void StorePayloadByte(uint8_t data)
+{
+	if (rxType == STATUS_RESP){
+		if (rxLength < STATUS_CACHE_SIZE && !commandPending)
+			transferBuffer.status[statusFront ^ 1][rxLength++] = data;
+	}
+	else if (rxType == LOG_RESP && logRequested && !commandPending){
+		if (logSequenceLength < sizeof(logSequence)){
+			logSequence |= (uint16_t)data << (8 * logSequenceLength++);
+			if (logSequenceLength < sizeof(logSequence))
+				return;
+			logOldestSequence = logSequence - logRequestIndex;
+			//asked from the oldest, the unit has moved on from the cache:
+			//a new run, or a reset; otherwise ask again by the new numbering
+			logAccepted = logSequence == logNextSequence || logRequestIndex == 0;
+			if (logAccepted && logSequence != logNextSequence){
+				logCount = 0;
+				logNextSequence = logSequence;
 			}
-			for (block_index=0;block_index<32; block_index++){
-				DoReadFlowControl();
-				Endpoint_Write_Byte(pgm_read_byte(((char*)&fileName)+block_index));
+			//and keep none of the records the unit has dropped
+			int16_t dropped = logOldestSequence - (uint16_t)(logNextSequence - logCount);
+			if (logAccepted && dropped > 0){
+				if (dropped > logCount)
+					dropped = logCount;
+				logHead = (logHead + dropped) % LOG_CACHE_RECORDS;
+				logCount -= dropped;
 			}
-			for (block_index=0;block_index<32; block_index++){
-				DoReadFlowControl();
-				Endpoint_Write_Byte(pgm_read_byte(((char*)&autorun)+block_index));
+		}
+		else if (logAccepted){
+			//a record is only counted once complete; the oldest makes room
+			if (rxLength == 0 && logCount == LOG_CACHE_RECORDS){
+				logHead = (logHead + 1) % LOG_CACHE_RECORDS;
+				logCount--;
 			}
-			for (block_index=96; block_index<VIRTUAL_MEMORY_BLOCK_SIZE; block_index++){
-				DoReadFlowControl();
-				Endpoint_Write_Byte(0x00);
+			transferBuffer.log[(logHead + logCount) % LOG_CACHE_RECORDS][rxLength++] = data;
+			if (rxLength == LOG_RECORD_SIZE){
+				rxLength = 0;
+				logCount++;
+				logNextSequence++;
+				logReceived = true;
 			}
 		}
-		else if (BlockAddress == 67){	//STATUS.TXT
-			Serial_TxByte(START_CODE);
-			Serial_TxByte(PACKET_HEADER_LENGTH);
-			Serial_TxByte(0);
-			Serial_TxByte(STATUS_REQ);
-
-			uint16_t length = 0;
-			uint8_t  packet_type;
-			bool success = true;
-			while(true){
-				while ((success = SerialWaitUntilReady()) && Serial_RxByte() != START_CODE);
-				if (!success) break;
-				if (!(success = SerialWaitUntilReady())) break;
-				length = Serial_RxByte();
-				if (!(success = SerialWaitUntilReady())) break;
-				length |= (Serial_RxByte() << 8);
-				if (length > PACKET_HEADER_LENGTH){
-					length -= PACKET_HEADER_LENGTH;
-					if (!(success = SerialWaitUntilReady())) break;
-					packet_type = Serial_RxByte();
-					if (packet_type == STATUS_RESP)
-						break;
-				}
-			}
+	}
+}
 
-			block_index = 0;
-			if (success){
-				for (; block_index<length; block_index++){
-					if (!SerialWaitUntilReady()) break;
-					DoReadFlowControl();
-					Endpoint_Write_Byte(Serial_RxByte());
-				}
-			}
+static void EndPacket(void)
+{
+	if (rxType == STATUS_RESP){
+		if (!commandPending){
+			statusLength[statusFront ^ 1] = rxLength;
+			statusFront ^= 1;
+		}
+		statusRequested = false;
+		statusTicks = 0;
+	}
+	else if (rxType == LOG_RESP && logRequested){
+		//more may be waiting if this brought any, or if it was out of step
+		logRequested = false;
+		logTicks = logReceived || !logAccepted ? LOG_REFRESH_TICKS : 0;
+	}
+	rxState = RX_START;
+}
 
-			for (; block_index<VIRTUAL_MEMORY_BLOCK_SIZE; block_index++){
-				DoReadFlowControl();
-				Endpoint_Write_Byte(0x00);
-			}
+//value right aligned in the width characters before end, with one decimal if tenths
+static void FormatField(char* end, int32_t value, uint8_t width, bool tenths)
+{
+	char* begin = end - width;
+	bool negative = value < 0;
+	uint32_t digits = negative ? -value : value;
+	uint8_t count = 0;
+
+	do{
+		*--end = '0' + digits % 10;
+		digits /= 10;
+		if (tenths && ++count == 1)
+			*--end = '.';
+	}while ((digits || (tenths && count < 2)) && end > begin);
+	if (negative && end > begin)
+		*--end = '-';
+	while (end > begin)
+		*--end = ' ';
+}
+
+static uint8_t WriteLogLine(const uint8_t* logRecord)
+{
+	char line[LOG_LINE_LENGTH];
+	FormatField(line+6, (uint16_t)(logRecord[0] | (logRecord[1] << 8)), 6, false);
+	line[6] = ',';
+	FormatField(line+12, (int16_t)(logRecord[2] | (logRecord[3] << 8)), 5, true);
+	line[12] = ',';
+	FormatField(line+18, (int16_t)(logRecord[4] | (logRecord[5] << 8)), 5, true);
+	line[18] = ',';
+	FormatField(line+24, (int16_t)(logRecord[6] | (logRecord[7] << 8)), 5, true);
+	line[24] = ',';
+	FormatField(line+30, (int8_t)logRecord[8], 5, false);
+	line[30] = '\r';
+	line[31] = '\n';
+	return Endpoint_Write_Stream_LE(line, sizeof(line), NO_STREAM_CALLBACK);
+}
+
+//A generator writes one whole 512 byte sector of a region of the volume.
+//sector counts from the start of the region.
+typedef uint8_t (*SECTOR_GENERATOR)(uint16_t sector);
+
+static uint8_t WriteBootSector(uint16_t sector);
+static uint8_t WriteFatSector(uint16_t sector);
+static uint8_t WriteRootDirectorySector(uint16_t sector);
+static uint8_t WriteStatusSector(uint16_t sector);
+static uint8_t WriteAutorunSector(uint16_t sector);
+static uint8_t WriteProgramSector(uint16_t sector);
+static uint8_t WriteLogSector(uint16_t sector);
+
+typedef struct
+{
+		uint8_t				name[11];		//8.3, space padded, no dot
+		uint16_t			firstCluster;
+		uint16_t			size;
+		SECTOR_GENERATOR	generator;
+} VIRTUAL_FILE;
+
+#define STATUS_CLUSTER			2
+#define STATUS_FILE_SIZE		300
+#define AUTORUN_CLUSTER			3
+#define AUTORUN_FILE_SIZE		32
+#define PROGRAM_CLUSTER			4
+#define PROGRAM_FILE_SIZE		(FILE_SIGNATURE_LEN+MAX_COMMAND_LENGTH)
+#define LOG_CLUSTER				(PROGRAM_CLUSTER+FILE_CLUSTERS(PROGRAM_FILE_SIZE))
+#define FIRST_FREE_CLUSTER		(LOG_CLUSTER+FILE_CLUSTERS(LOG_FILE_SIZE))
+
+static const VIRTUAL_FILE PROGMEM virtualFiles[] =
+{
+		{"STATUS  TXT",	STATUS_CLUSTER,		STATUS_FILE_SIZE,	WriteStatusSector},
+		{"AUTORUN INF",	AUTORUN_CLUSTER,	AUTORUN_FILE_SIZE,	WriteAutorunSector},
+		{"PROGRAM TXT",	PROGRAM_CLUSTER,	PROGRAM_FILE_SIZE,	WriteProgramSector},
+		{"LOG     CSV",	LOG_CLUSTER,		LOG_FILE_SIZE,		WriteLogSector},
+};
+#define VIRTUAL_FILE_COUNT		(sizeof(virtualFiles)/sizeof(VIRTUAL_FILE))
+
+typedef struct
+{
+		uint16_t			firstSector;
+		uint16_t			sectors;
+		SECTOR_GENERATOR	generator;
+} SECTOR_RANGE;
+
+//sorted by sector; sectors in no range read as zeros
+static const SECTOR_RANGE PROGMEM sectorMap[] =
+{
+		{0,									1,									WriteBootSector},
+		{FAT1_START,						FAT_SECTORS,						WriteFatSector},
+		{FAT2_START,						FAT_SECTORS,						WriteFatSector},
+		{ROOT_DIR_START,					ROOT_DIR_SECTORS,					WriteRootDirectorySector},
+		{CLUSTER_SECTOR(STATUS_CLUSTER),	FILE_CLUSTERS(STATUS_FILE_SIZE),	WriteStatusSector},
+		{CLUSTER_SECTOR(AUTORUN_CLUSTER),	FILE_CLUSTERS(AUTORUN_FILE_SIZE),	WriteAutorunSector},
+		{CLUSTER_SECTOR(PROGRAM_CLUSTER),	FILE_CLUSTERS(PROGRAM_FILE_SIZE),	WriteProgramSector},
+		{CLUSTER_SECTOR(LOG_CLUSTER),		FILE_CLUSTERS(LOG_FILE_SIZE),		WriteLogSector},
+};
+#define SECTOR_MAP_SIZE			(sizeof(sectorMap)/sizeof(SECTOR_RANGE))
+
+static uint8_t WriteBootSector(uint16_t sector)
+{
+	uint8_t error;
+	if (!(error = Endpoint_Write_PStream_LE(&fatBootData, 62, NO_STREAM_CALLBACK))
+	 && !(error = Endpoint_Write_Zeros(448)))
+		error = Endpoint_Write_PStream_LE(bootSignature, sizeof(bootSignature), NO_STREAM_CALLBACK);
+	return error;
+}
+
+//the next cluster of a file's chain, 0xffff at its end, 0 if free
+static uint16_t GetFatEntry(uint16_t cluster)
+{
+	if (cluster < 2)
+		return cluster == 0 ? 0xfff0 : 0xffff; //media descriptor and end of chain marker
+
+	for (uint8_t i = 0; i < VIRTUAL_FILE_COUNT; i++){
+		uint16_t first = pgm_read_word(&virtualFiles[i].firstCluster);
+		uint16_t last = first + FILE_CLUSTERS(pgm_read_word(&virtualFiles[i].size)) - 1;
+		if (cluster >= first && cluster <= last)
+			return cluster == last ? 0xffff : cluster + 1;
+	}
+	return 0;
+}
+
+static uint8_t WriteFatSector(uint16_t sector)
+{
+	uint16_t cluster = sector * (VIRTUAL_MEMORY_BLOCK_SIZE / 2);
+	if (cluster >= FIRST_FREE_CLUSTER)
+		return Endpoint_Write_Zeros(VIRTUAL_MEMORY_BLOCK_SIZE);
+
+	uint16_t entries[16];
+	uint8_t error = ENDPOINT_RWSTREAM_NoError;
+	for (uint8_t chunk = 0; chunk < VIRTUAL_MEMORY_BLOCK_SIZE / sizeof(entries) && !error; chunk++){
+		for (uint8_t i = 0; i < 16; i++)
+			entries[i] = GetFatEntry(cluster++);
+		error = Endpoint_Write_Stream_LE(entries, sizeof(entries), NO_STREAM_CALLBACK);
+	}
+	return error;
+}
+
+static uint8_t WriteRootDirectorySector(uint16_t sector)
+{
+	if (sector != 0)
+		return Endpoint_Write_Zeros(VIRTUAL_MEMORY_BLOCK_SIZE);
+
+	uint8_t error = Endpoint_Write_PStream_LE(&volumeLabel, sizeof(FAT_ROOT_DIRECTORY), NO_STREAM_CALLBACK);
+	for (uint8_t i = 0; i < VIRTUAL_FILE_COUNT && !error; i++){
+		FAT_ROOT_DIRECTORY entry =
+		{
+				.attribute 					= 0,
+				.reserved 					= 0,
+				.create_time_ms				= 0,
+				.create_time				= 0x8800,
+				.create_date				= 0x3ea1,
+				.access_date				= 0x3ea1,
+				.first_cluster_highorder	= 0,
+				.modified_time				= 0x8800,
+				.modified_date				= 0x3ea1,
+				.first_cluster_loworder		= pgm_read_word(&virtualFiles[i].firstCluster),
+				.size						= pgm_read_word(&virtualFiles[i].size)
+		};
+		memcpy_P(entry.filename, virtualFiles[i].name, sizeof(virtualFiles[i].name));
+		error = Endpoint_Write_Stream_LE(&entry, sizeof(entry), NO_STREAM_CALLBACK);
+	}
+	if (!error)
+		error = Endpoint_Write_Zeros(VIRTUAL_MEMORY_BLOCK_SIZE-(VIRTUAL_FILE_COUNT+1)*sizeof(FAT_ROOT_DIRECTORY));
+	return error;
+}
+
+static uint8_t WriteStatusSector(uint16_t sector)
+{
+	uint8_t length = statusLength[statusFront];
+	uint8_t error;
+	if (!(error = Endpoint_Write_Stream_LE(transferBuffer.status[statusFront], length, NO_STREAM_CALLBACK)))
+		error = Endpoint_Write_Zeros(VIRTUAL_MEMORY_BLOCK_SIZE-length);
+	return error;
+}
+
+static uint8_t WriteAutorunSector(uint16_t sector)
+{
+	uint8_t error;
+	if (!(error = Endpoint_Write_PStream_LE(autorun_content, autorun_content_length, NO_STREAM_CALLBACK)))
+		error = Endpoint_Write_Zeros(VIRTUAL_MEMORY_BLOCK_SIZE-autorun_content_length);
+	return error;
+}
+
+static uint8_t WriteProgramSector(uint16_t sector)
+{
+	uint8_t error;
+	uint16_t length;
+	if (commandPending){
+		//EEPROM may hold part of it yet
+		length = FILE_SIGNATURE_LEN + commandLength;
+		if (!(error = Endpoint_Write_Stream_LE(FILE_SIGNATURE, FILE_SIGNATURE_LEN, NO_STREAM_CALLBACK)))
+			error = Endpoint_Write_Stream_LE(transferBuffer.command, commandLength, NO_STREAM_CALLBACK);
+	}
+	else{
+		//erased EEPROM reads 0xffff; show an empty file until a command is sent
+		length = eeprom_read_word(PROGRAM_EEPROM_LENGTH);
+		if (length > PROGRAM_FILE_SIZE)
+			length = 0;
+		error = Endpoint_Write_EStream_LE(PROGRAM_EEPROM_TEXT, length, NO_STREAM_CALLBACK);
+	}
+
+	if (!error)
+		error = Endpoint_Write_Zeros(VIRTUAL_MEMORY_BLOCK_SIZE-length);
+	return error;
+}
+
+static uint8_t WriteLogPadding(uint8_t lines)
+{
+	uint8_t error = ENDPOINT_RWSTREAM_NoError;
+	while (lines-- && !error)
+		error = Endpoint_Write_PStream_LE(logPadding, LOG_LINE_LENGTH, NO_STREAM_CALLBACK);
+	return error;
+}
+
+static uint8_t WriteLogSector(uint16_t sector)
+{
+	uint8_t error = ENDPOINT_RWSTREAM_NoError;
+	uint8_t line = 0;
+	if (sector == 0){
+		error = Endpoint_Write_PStream_LE(logHeader, LOG_LINE_LENGTH, NO_STREAM_CALLBACK);
+		line = 1;
+	}
+	if (!commandPending){
+		for (uint16_t record = sector*LOG_LINES_PER_SECTOR + line - 1; record < logCount && line < LOG_LINES_PER_SECTOR && !error; record++, line++)
+			error = WriteLogLine(transferBuffer.log[(logHead + record) % LOG_CACHE_RECORDS]);
+	}
+
+	if (!error)
+		error = WriteLogPadding(LOG_LINES_PER_SECTOR - line);
+	return error;
+}
+
+bool DataManager_ReadBlocks(uint32_t BlockAddress, uint16_t TotalBlocks)
+{
+	uint8_t error = ENDPOINT_RWSTREAM_NoError;
+	uint8_t range = 0;
+
+	//blocks come in ascending order, so one pass over the map serves the whole read
+	while (TotalBlocks && error == ENDPOINT_RWSTREAM_NoError){
+		uint16_t firstSector = 0;
+		while (range < SECTOR_MAP_SIZE){
+			firstSector = pgm_read_word(&sectorMap[range].firstSector);
+			if (BlockAddress < firstSector + pgm_read_word(&sectorMap[range].sectors))
+				break;
+			range++;
 		}
-		else if (BlockAddress == 68){	//AUTORUN.INF
-			for (block_index=0; block_index<autorun_content_length; block_index++){
-				DoReadFlowControl();
-				Endpoint_Write_Byte(pgm_read_byte(autorun_content+block_index));
-			}
-			for (; block_index<VIRTUAL_MEMORY_BLOCK_SIZE; block_index++){
-				DoReadFlowControl();
-				Endpoint_Write_Byte(0x00);
-			}
+
+		if (range < SECTOR_MAP_SIZE && BlockAddress >= firstSector){
+			SECTOR_GENERATOR generator = (SECTOR_GENERATOR)pgm_read_word(&sectorMap[range].generator);
+			error = generator(BlockAddress - firstSector);
 		}
 		else{
-			for (block_index=0; block_index<VIRTUAL_MEMORY_BLOCK_SIZE; block_index++){
-				DoReadFlowControl();
-				Endpoint_Write_Byte(0x00);
-			}
+			error = Endpoint_Write_Zeros(VIRTUAL_MEMORY_BLOCK_SIZE);
 		}
 	
 		BlockAddress++;
@@ -328,40 +794,56 @@ bool DataManager_ReadBlocks(uint32_t BlockAddress, uint16_t TotalBlocks)
 	if (!(Endpoint_IsReadWriteAllowed()))
 		Endpoint_ClearIN();
 
-	return true;
+	return error == ENDPOINT_RWSTREAM_NoError;
+}
+
+//Matches the signature at the start of a sector, wherever the host put
+//CONTROL.TXT. A match is copied to RAM up to its end (a NUL, CR or LF) for
+//the main loop to commit; one written while the last is still being
+//committed is dropped, as the host app waits for the status to show a
+//command before it sends another. Returns the bytes read from the
+//endpoint, so the caller discards the rest of the sector in bulk.
+static uint16_t ReceiveCommand(void)
+{
+	uint16_t consumed = 0;
+	while (consumed < FILE_SIGNATURE_LEN){
+		DoWriteFlowControl();
+		consumed++;
+		if (Endpoint_Read_Byte() != FILE_SIGNATURE[consumed-1])
+			return consumed;
+	}
+	if (commandPending)
+		return consumed;
+
+	//the status cache is overwritten from here
+	commandPending = true;
+	statusLength[0] = statusLength[1] = 0;
+
+	uint8_t length = 0;
+	while (length < MAX_COMMAND_LENGTH){
+		DoWriteFlowControl();
+		uint8_t data = Endpoint_Read_Byte();
+		consumed++;
+		if (data == '\0' || data == '\r' || data == '\n')
+			break;
+		transferBuffer.command[length++] = data;
+	}
+	commandLength = length;
+	commandQueued = false;
+	commandSaved = 0;
+	return consumed;
 }
 
 bool DataManager_WriteBlocks(uint32_t BlockAddress, uint16_t TotalBlocks)
 {
-	uint16_t block_index;
-	bool bSignatureFound = false;
-	while(TotalBlocks){
-		if (BlockAddress > 67 && bSignatureFound == false){ //in data sector
-			bSignatureFound = true;
-			for (block_index=0; block_index<FILE_SIGNATURE_LEN; block_index++){
-				DoWriteFlowControl();
-				if (Endpoint_Read_Byte() != FILE_SIGNATURE[block_index]){
-					FlushBlock(VIRTUAL_MEMORY_BLOCK_SIZE-block_index-1);
-					bSignatureFound = false;
-					break;
-				}
-			}
-			if (bSignatureFound){
-				uint16_t length = PACKET_HEADER_LENGTH+FILE_MAX_LENGTH;
-				Serial_TxByte(START_CODE);
-				Serial_TxByte(length & 0xff);
-				Serial_TxByte((length & 0xff00) >> 8);
-				Serial_TxByte(SEND_CMD);
-				for (block_index=0; block_index<FILE_MAX_LENGTH; block_index++){
-					DoWriteFlowControl();
-					Serial_TxByte(Endpoint_Read_Byte());
-				}
-				FlushBlock(VIRTUAL_MEMORY_BLOCK_SIZE-FILE_MAX_LENGTH-FILE_SIGNATURE_LEN);
-			}
-		}
-		else{
-			FlushBlock(VIRTUAL_MEMORY_BLOCK_SIZE);
-		}
+	uint8_t error = ENDPOINT_RWSTREAM_NoError;
+
+	while (TotalBlocks && error == ENDPOINT_RWSTREAM_NoError){
+		uint16_t consumed = 0;
+		if (BlockAddress >= DATA_START) //FAT and directory updates never hold a command
+			consumed = ReceiveCommand();
+		error = Endpoint_Discard_Stream(VIRTUAL_MEMORY_BLOCK_SIZE-consumed, NO_STREAM_CALLBACK);
+
 		BlockAddress++;
 		TotalBlocks--;
 	}
@@ -369,6 +851,5 @@ bool DataManager_WriteBlocks(uint32_t BlockAddress, uint16_t TotalBlocks)
 	if (!(Endpoint_IsReadWriteAllowed()))
 		Endpoint_ClearOUT();
 
-	return true;
+	return error == ENDPOINT_RWSTREAM_NoError;
 }
-
@@ -1,2 +1,4 @@
+void DataManager_Init(void);
+void DataManager_Task(void);
 bool DataManager_ReadBlocks(uint32_t BlockAddress, uint16_t TotalBlocks);
 bool DataManager_WriteBlocks(uint32_t BlockAddress, uint16_t TotalBlocks);
@@ -36,6 +36,7 @@
 
 #include <LUFA/Drivers/Peripheral/Serial.h>
 #include "OpenPCRMassStorage.h"
+#include "DataManager.h"
 
 /** LUFA Mass Storage Class driver interface configuration and state information. This structure is
  *  passed to all Mass Storage Class driver functions, so that multiple instances of the same class
@@ -72,6 +73,7 @@ int main(void)
 	{
 		MS_Device_USBTask(&Disk_MS_Interface);		
 		USB_USBTask();		
+		DataManager_Task();
 	}
 }
 
@@ -89,9 +91,10 @@ void SetupHardware(void)
 //	LEDs_Init();
 //	SPI_Init(SPI_SPEED_FCPU_DIV_2 | SPI_ORDER_MSB_FIRST | SPI_SCK_LEAD_FALLING | SPI_SAMPLE_TRAILING | SPI_MODE_MASTER);
 	Serial_Init(4800, false);
+	DataManager_Init();
 	USB_Init();
 
-	TCCR1B |= (1 << CS10); // set up timer for serial 
+	TCCR1B |= (1 << CS10); // set up timer for the status refresh
 }
 
 /** Event handler for the library USB Connection event. */
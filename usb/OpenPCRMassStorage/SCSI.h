@@ -34,7 +34,7 @@
  */
 
 /** Total number of bytes of the storage medium, comprised of one or more Dataflash ICs. */
-#define VIRTUAL_MEMORY_BYTES                ((uint32_t)512 * (uint32_t)4500) //((uint32_t)DATAFLASH_PAGES * DATAFLASH_PAGE_SIZE * DATAFLASH_TOTALCHIPS)
+#define VIRTUAL_MEMORY_BYTES                ((uint32_t)512 * (uint32_t)4352) //((uint32_t)DATAFLASH_PAGES * DATAFLASH_PAGE_SIZE * DATAFLASH_TOTALCHIPS)
 
 /** Block size of the device. This is kept at 512 to remain compatible with the OS despite the underlying
  *  storage media (Dataflash) using a different native block size. Do not change this value.
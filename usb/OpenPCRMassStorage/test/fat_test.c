@@ -0,0 +1,475 @@
+/* Host test of the virtual FAT16 volume. DataManager.c is built against the
+   stubs in stub/ and talks to a simulated unit over the UART registers. The
+   test writes a command the way a host writes CONTROL.TXT, reads the whole
+   volume and checks it the way a FAT16 driver mounts it: boot record,
+   both FATs, the root directory, every file's cluster chain and what the
+   files hold.
+
+     make check */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "SCSI.h"
+
+bool DataManager_ReadBlocks(uint32_t BlockAddress, uint16_t TotalBlocks);
+bool DataManager_WriteBlocks(uint32_t BlockAddress, uint16_t TotalBlocks);
+void DataManager_Init(void);
+void DataManager_Task(void);
+void USART1_RX_vect(void);
+
+#define START_CODE			0xFF
+#define ESCAPE_CODE			0xFE
+#define STATUS_FILE_LEN		100		//the firmware pads STATUS_RESP to this
+#define LOG_RECORD_SIZE		9
+#define LOG_LINE_LENGTH		32
+#define LOG_CACHE_RECORDS	15		//what LOG.CSV holds
+#define UNIT_TX_RECORDS		5		//what fits the firmware's transmit buffer
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do{ \
+		if (!(condition)){ \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			failures++; \
+		} \
+	}while (0)
+
+uint8_t Test_Eeprom[512];
+
+//a write takes longer than a pass of the main loop
+bool Test_EepromIsReady(void)
+{
+	static bool ready = false;
+	ready = !ready;
+	return ready;
+}
+
+////////////////////////////////////////////////////////////////////
+// Endpoint: reads come from hostData, writes go to the volume image
+static uint8_t volume[VIRTUAL_MEMORY_BYTES];
+static uint32_t volumeIndex;
+static const uint8_t* hostData;
+static uint32_t hostIndex;
+
+bool Endpoint_IsReadWriteAllowed(void) { return true; }
+void Endpoint_ClearIN(void) {}
+void Endpoint_ClearOUT(void) {}
+uint8_t Endpoint_WaitUntilReady(void) { return 0; }
+
+uint8_t Endpoint_Read_Byte(void)
+{
+	return hostData[hostIndex++];
+}
+
+uint8_t Endpoint_Write_Stream_LE(const void* buffer, uint16_t length, void* callback)
+{
+	memcpy(volume + volumeIndex, buffer, length);
+	volumeIndex += length;
+	return ENDPOINT_RWSTREAM_NoError;
+}
+
+uint8_t Endpoint_Write_PStream_LE(const void* buffer, uint16_t length, void* callback)
+{
+	return Endpoint_Write_Stream_LE(buffer, length, callback);
+}
+
+uint8_t Endpoint_Write_EStream_LE(const void* buffer, uint16_t length, void* callback)
+{
+	return Endpoint_Write_Stream_LE(Test_Eeprom + (uintptr_t)buffer, length, callback);
+}
+
+uint8_t Endpoint_Discard_Stream(uint16_t length, void* callback)
+{
+	hostIndex += length;
+	return ENDPOINT_RWSTREAM_NoError;
+}
+
+////////////////////////////////////////////////////////////////////
+// Simulated unit: answers STATUS_REQ and LOG_REQ as the firmware does and
+// keeps the last SEND_CMD
+static const char unitStatus[] = "d=7&s=running&l=100&b=94.5&t=holding&o=120&e=10&r=50&u=1&c=1&p=Melt";
+static char unitCommand[256];
+static uint16_t unitCommandLength;
+static bool unitEscape;
+static uint16_t unitLogFirst = 1000;	//sequence number of the oldest record
+static uint16_t unitLogRecords = 23;
+
+static uint8_t fromBridge[8];		//packet being received, header and the payload we look at
+static uint16_t fromBridgeLength;
+static uint16_t fromBridgeIndex;
+static uint8_t toBridge[1024];		//bytes on the wire to the bridge
+static uint16_t toBridgeLength;
+static uint16_t toBridgeIndex;
+
+static void QueueToBridge(uint8_t data)
+{
+	toBridge[toBridgeLength++] = data;
+}
+
+static void SendToBridge(uint8_t type, const uint8_t* payload, uint16_t length)
+{
+	uint16_t escapes = 0;
+	for (uint16_t i = 0; i < length; i++)
+		escapes += payload[i] == START_CODE;
+	uint16_t packetLength = 4 + length + escapes;
+	QueueToBridge(START_CODE);
+	QueueToBridge(packetLength & 0xff);
+	QueueToBridge(packetLength >> 8);
+	QueueToBridge(type);
+	for (uint16_t i = 0; i < length; i++){
+		if (payload[i] == START_CODE)
+			QueueToBridge(ESCAPE_CODE);
+		QueueToBridge(payload[i]);
+	}
+}
+
+//the record numbered sequence
+static void GetLogRecord(uint16_t sequence, uint8_t* record)
+{
+	int16_t values[4] = {sequence * 10, 950 - sequence, 1000, sequence % 8 == 4 ? -123 : 720};
+	for (int i = 0; i < 4; i++){
+		record[2*i] = values[i] & 0xff;
+		record[2*i+1] = (values[i] >> 8) & 0xff;
+	}
+	record[8] = (uint8_t)(int8_t)(sequence % 8 == 5 ? -100 : sequence % 100);
+}
+
+static void UnitPacketReceived(void)
+{
+	uint8_t type = fromBridge[3];
+	if (type == 0x40){ //STATUS_REQ
+		uint8_t status[STATUS_FILE_LEN];
+		memset(status, ' ', sizeof(status));
+		memcpy(status, unitStatus, sizeof(unitStatus));
+		SendToBridge(0x80, status, sizeof(status));
+	}
+	else if (type == 0x20){ //LOG_REQ
+		int first = fromBridge[4] | (fromBridge[5] << 8);
+		int count = fromBridge[6] < UNIT_TX_RECORDS ? fromBridge[6] : UNIT_TX_RECORDS;
+		uint16_t sequence = unitLogFirst + first;
+		uint8_t payload[2 + UNIT_TX_RECORDS * LOG_RECORD_SIZE] = {sequence & 0xff, sequence >> 8};
+		int sent = 0;
+		for (; sent < count && first + sent < unitLogRecords; sent++)
+			GetLogRecord(sequence + sent, payload + 2 + sent * LOG_RECORD_SIZE);
+		SendToBridge(0x30, payload, 2 + sent * LOG_RECORD_SIZE);
+	}
+}
+
+static void UnitReceive(uint8_t data)
+{
+	if (fromBridgeIndex == 0 && data != START_CODE)
+		return;
+	if (fromBridgeIndex < sizeof(fromBridge))
+		fromBridge[fromBridgeIndex] = data;
+	if (fromBridgeIndex == 2)
+		fromBridgeLength = fromBridge[1] | (fromBridge[2] << 8);
+	if (fromBridgeIndex == 3){
+		unitCommandLength = 0;
+		unitEscape = false;
+	}
+	if (fromBridgeIndex >= 4 && fromBridge[3] == 0x10){ //SEND_CMD
+		//an escape code in front of a start code is dropped
+		if (unitEscape && data == START_CODE){
+			unitCommandLength--;
+			unitEscape = false;
+		}
+		else
+			unitEscape = data == ESCAPE_CODE;
+		unitCommand[unitCommandLength++] = data;
+	}
+	if (++fromBridgeIndex > 2 && fromBridgeIndex == fromBridgeLength){
+		if (fromBridge[3] == 0x10)
+			unitCommand[unitCommandLength] = '\0';
+		UnitPacketReceived();
+		fromBridgeIndex = 0;
+	}
+}
+
+////////////////////////////////////////////////////////////////////
+// Registers: every read of TIFR1 is a timer tick, about two bytes on
+// the wire at 4800 baud. UDR1 holds NO_BYTE until the bridge sends one.
+#define NO_BYTE				0x100
+
+static uint16_t ucsr1a = 1 << UDRE1;
+static uint16_t ucsr1b;
+static uint16_t udr1 = NO_BYTE;
+static uint16_t tifr1;
+static uint32_t ticks = 0;
+static bool inReceiveInterrupt = false;
+
+uint16_t* Test_Register(int reg)
+{
+	switch (reg){
+	case TEST_UCSR1A:
+		return &ucsr1a;
+	case TEST_UCSR1B:
+		return &ucsr1b;
+	case TEST_UDR1:
+		if (!inReceiveInterrupt && udr1 != NO_BYTE){
+			UnitReceive(udr1);
+			udr1 = NO_BYTE;
+		}
+		return &udr1;
+	default:
+		if (udr1 != NO_BYTE){
+			UnitReceive(udr1);
+			udr1 = NO_BYTE;
+		}
+		for (int i = 0; i < 2 && toBridgeIndex < toBridgeLength; i++){
+			uint16_t sent = udr1;
+			udr1 = toBridge[toBridgeIndex++];
+			inReceiveInterrupt = true;
+			USART1_RX_vect();
+			inReceiveInterrupt = false;
+			udr1 = sent;
+		}
+		if (toBridgeIndex == toBridgeLength)
+			toBridgeIndex = toBridgeLength = 0;
+		tifr1 = 1 << TOV1;
+		ticks++;
+		return &tifr1;
+	}
+}
+
+//a pass of the main loop, then the next tick
+static void RunTask(int times)
+{
+	while (times--){
+		DataManager_Task();
+		Test_Register(TEST_TIFR1);
+	}
+}
+
+////////////////////////////////////////////////////////////////////
+// FAT16, as a host reads it
+static uint16_t GetWord(const uint8_t* data) { return data[0] | (data[1] << 8); }
+static uint32_t GetLong(const uint8_t* data) { return GetWord(data) | ((uint32_t)GetWord(data + 2) << 16); }
+
+typedef struct
+{
+	uint16_t reservedSectors;
+	uint16_t sectorsPerFat;
+	uint16_t rootEntries;
+	uint32_t rootStart;
+	uint32_t dataStart;
+	uint32_t clusters;
+	const uint8_t* fat;
+} VOLUME;
+
+static uint16_t GetFatEntry(const VOLUME* fat, uint32_t cluster)
+{
+	return GetWord(fat->fat + 2 * cluster);
+}
+
+static void CheckBootRecord(VOLUME* fat)
+{
+	const uint8_t* boot = volume;
+	CHECK(boot[0] == 0xeb && boot[2] == 0x90);
+	CHECK(GetWord(boot + 11) == VIRTUAL_MEMORY_BLOCK_SIZE);
+	CHECK(boot[13] == 1);	//sectors per cluster
+	CHECK(boot[16] == 2);	//FATs
+	CHECK(GetWord(boot + 19) == VIRTUAL_MEMORY_BLOCKS);
+	CHECK(boot[21] == 0xf0);
+	CHECK(boot[38] == 0x29);
+	CHECK(memcmp(boot + 54, "FAT16   ", 8) == 0);
+	CHECK(boot[510] == 0x55 && boot[511] == 0xaa);
+
+	fat->reservedSectors = GetWord(boot + 14);
+	fat->sectorsPerFat = GetWord(boot + 22);
+	fat->rootEntries = GetWord(boot + 17);
+	fat->rootStart = fat->reservedSectors + 2 * fat->sectorsPerFat;
+	fat->dataStart = fat->rootStart + fat->rootEntries * 32 / VIRTUAL_MEMORY_BLOCK_SIZE;
+	fat->clusters = VIRTUAL_MEMORY_BLOCKS - fat->dataStart;
+	fat->fat = volume + fat->reservedSectors * VIRTUAL_MEMORY_BLOCK_SIZE;
+
+	//hosts decide FAT12, 16 or 32 by the cluster count alone
+	CHECK(fat->clusters >= 4085 && fat->clusters < 65525);
+	CHECK(fat->sectorsPerFat * VIRTUAL_MEMORY_BLOCK_SIZE / 2 >= fat->clusters + 2);
+	CHECK(memcmp(fat->fat, fat->fat + fat->sectorsPerFat * VIRTUAL_MEMORY_BLOCK_SIZE,
+	             fat->sectorsPerFat * VIRTUAL_MEMORY_BLOCK_SIZE) == 0);
+	CHECK(GetFatEntry(fat, 0) == 0xfff0 && GetFatEntry(fat, 1) == 0xffff);
+}
+
+//the contents of the file named name (8.3, space padded, no dot) in the
+//root directory, after checking its cluster chain; NULL if there is none
+static const uint8_t* ReadFile(const VOLUME* fat, const char* name, uint32_t* size, uint8_t* usedClusters)
+{
+	static uint8_t contents[4096];
+	for (uint16_t i = 0; i < fat->rootEntries; i++){
+		const uint8_t* entry = volume + fat->rootStart * VIRTUAL_MEMORY_BLOCK_SIZE + 32 * i;
+		if (entry[0] == 0)
+			break;
+		if (memcmp(entry, name, 11) != 0)
+			continue;
+
+		*size = GetLong(entry + 28);
+		uint32_t length = 0;
+		for (uint32_t cluster = GetWord(entry + 26); cluster < 0xfff8; cluster = GetFatEntry(fat, cluster)){
+			if (cluster < 2 || cluster >= fat->clusters + 2 || usedClusters[cluster] || length >= sizeof(contents)){
+				fprintf(stderr, "%.11s: bad cluster chain at cluster %u\n", name, (unsigned)cluster);
+				failures++;
+				return NULL;
+			}
+			usedClusters[cluster] = 1;
+			memcpy(contents + length, volume + (fat->dataStart + cluster - 2) * VIRTUAL_MEMORY_BLOCK_SIZE, VIRTUAL_MEMORY_BLOCK_SIZE);
+			length += VIRTUAL_MEMORY_BLOCK_SIZE;
+		}
+		CHECK(length == (*size + VIRTUAL_MEMORY_BLOCK_SIZE - 1) / VIRTUAL_MEMORY_BLOCK_SIZE * VIRTUAL_MEMORY_BLOCK_SIZE);
+		return contents;
+	}
+	fprintf(stderr, "%.11s: not in the root directory\n", name);
+	failures++;
+	return NULL;
+}
+
+//lines from to end of LOG.CSV: line n holds the record numbered
+//first + n - 1 if the unit had it, from oldest to end, when the line was
+//read, and is blank otherwise
+static void CheckLogLines(const uint8_t* log, uint32_t from, uint32_t to, uint16_t first, uint16_t oldest, uint16_t end)
+{
+	for (uint32_t line = from; line < to; line++){
+		uint16_t sequence = first + line - 1;
+		char expected[40] = "\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n";
+		if (sequence >= oldest && sequence < end){
+			uint8_t record[LOG_RECORD_SIZE];
+			GetLogRecord(sequence, record);
+			snprintf(expected, sizeof(expected), "%6u,%5.1f,%5.1f,%5.1f,%5d\r\n",
+			         GetWord(record), (int16_t)GetWord(record + 2) / 10.0, (int16_t)GetWord(record + 4) / 10.0,
+			         (int16_t)GetWord(record + 6) / 10.0, (int8_t)record[8]);
+		}
+		if (memcmp(log + LOG_LINE_LENGTH * line, expected, LOG_LINE_LENGTH) != 0){
+			fprintf(stderr, "LOG.CSV line %u: '%.32s', expected '%s'\n", (unsigned)line, log + LOG_LINE_LENGTH * line, expected);
+			failures++;
+		}
+	}
+}
+
+static void CheckLog(const uint8_t* log, uint32_t size, uint16_t first, uint16_t end)
+{
+	CHECK(memcmp(log, "time_s,plate,lid,target,drive%\r\n", LOG_LINE_LENGTH) == 0);
+	CheckLogLines(log, 1, size / LOG_LINE_LENGTH, first, first, end);
+}
+
+//LOG.CSV as the bridge serves it now; reading it never waits on the unit
+static const uint8_t* ReadLog(const VOLUME* fat, uint32_t* size)
+{
+	static uint8_t usedClusters[65536];
+	memset(usedClusters, 0, sizeof(usedClusters));
+	if (ReadFile(fat, "LOG     CSV", size, usedClusters) == NULL)
+		return NULL;
+	uint32_t ticksBefore = ticks;
+	for (uint32_t cluster = 2; cluster < fat->clusters + 2; cluster++){
+		if (!usedClusters[cluster])
+			continue;
+		volumeIndex = (fat->dataStart + cluster - 2) * VIRTUAL_MEMORY_BLOCK_SIZE;
+		CHECK(DataManager_ReadBlocks(fat->dataStart + cluster - 2, 1));
+	}
+	CHECK(ticks == ticksBefore);
+	memset(usedClusters, 0, sizeof(usedClusters));
+	return ReadFile(fat, "LOG     CSV", size, usedClusters);
+}
+
+//LOG.CSV a while after the unit's log changes holds its newest records
+static void CheckLogRefresh(const VOLUME* fat)
+{
+	static const struct
+	{
+		uint16_t first;
+		uint16_t records;
+	} logs[] = {
+		{1000, 40},		//new records
+		{1020, 48},		//more, and the oldest dropped
+		{1068, 3},		//a new run
+		{0, 2},			//the unit was reset
+	};
+	uint32_t size;
+	const uint8_t* contents;
+	for (size_t i = 0; i < sizeof(logs) / sizeof(logs[0]); i++){
+		unitLogFirst = logs[i].first;
+		unitLogRecords = logs[i].records;
+		RunTask(1000);
+		uint16_t end = unitLogFirst + unitLogRecords;
+		if ((contents = ReadLog(fat, &size)) != NULL)
+			CheckLog(contents, size, unitLogRecords < LOG_CACHE_RECORDS ? unitLogFirst : end - LOG_CACHE_RECORDS, end);
+	}
+
+	//a command takes the cache's place until it is committed
+	static uint8_t sector[VIRTUAL_MEMORY_BLOCK_SIZE];
+	strcpy((char*)sector, "s=ACGTC&c=stop\r\n");
+	hostData = sector;
+	hostIndex = 0;
+	CHECK(DataManager_WriteBlocks(100, 1));
+	if ((contents = ReadLog(fat, &size)) != NULL)
+		CheckLog(contents, size, 0, 0);
+	RunTask(1000);
+	if ((contents = ReadLog(fat, &size)) != NULL)
+		CheckLog(contents, size, 0, 2);
+}
+
+////////////////////////////////////////////////////////////////////
+int main(void)
+{
+	memset(Test_Eeprom, 0xff, sizeof(Test_Eeprom));
+	DataManager_Init();
+	RunTask(300);
+
+	//a host writes metadata first; CONTROL.TXT may land in any data sector
+	//start codes in the name, one behind what looks like an escape code
+	const char command[] = "c=start&d=7&l=110&n=T\xff\xfe\xffst&p=(1[30|95|Melt|0])";
+	static uint8_t sectors[4 * VIRTUAL_MEMORY_BLOCK_SIZE];
+	memcpy(sectors, "\xf0\xff\xff\xff", 4);
+	sprintf((char*)sectors + 2 * VIRTUAL_MEMORY_BLOCK_SIZE, "s=ACGTC&%s\r\n", command);
+	memcpy(sectors + 3 * VIRTUAL_MEMORY_BLOCK_SIZE, "s=ACGTX&c=stop", 14);
+	hostData = sectors;
+	hostIndex = 0;
+	CHECK(DataManager_WriteBlocks(100, 4));
+	CHECK(hostIndex == sizeof(sectors));
+	//the SCSI write only copies it; the main loop sends and saves it
+	CHECK(unitCommand[0] == '\0' && Test_Eeprom[0] == 0xff);
+	RunTask(300);
+	CHECK(unitCommand[0] == '&' && strcmp(unitCommand + 1, command) == 0);
+	//and fetches the log again
+	RunTask(1000);
+
+	//read in runs, as hosts do
+	volumeIndex = 0;
+	for (uint32_t block = 0; block < VIRTUAL_MEMORY_BLOCKS; block += 8){
+		uint16_t count = VIRTUAL_MEMORY_BLOCKS - block < 8 ? VIRTUAL_MEMORY_BLOCKS - block : 8;
+		CHECK(DataManager_ReadBlocks(block, count));
+	}
+	CHECK(volumeIndex == VIRTUAL_MEMORY_BYTES);
+
+	VOLUME fat;
+	CheckBootRecord(&fat);
+	const uint8_t* rootDir = volume + fat.rootStart * VIRTUAL_MEMORY_BLOCK_SIZE;
+	CHECK(memcmp(rootDir, "OPENPCR    ", 11) == 0 && rootDir[11] == 0x08);
+
+	static uint8_t usedClusters[65536];
+	uint32_t size;
+	const uint8_t* contents;
+	if ((contents = ReadFile(&fat, "STATUS  TXT", &size, usedClusters)) != NULL)
+		CHECK(size >= STATUS_FILE_LEN && memcmp(contents, unitStatus, sizeof(unitStatus) - 1) == 0);
+	if ((contents = ReadFile(&fat, "AUTORUN INF", &size, usedClusters)) != NULL)
+		CHECK(memcmp(contents, "[autorun]\r\n", 11) == 0);
+	if ((contents = ReadFile(&fat, "PROGRAM TXT", &size, usedClusters)) != NULL)
+		CHECK(memcmp(contents, "s=ACGTC&", 8) == 0 && memcmp(contents + 8, command, sizeof(command)) == 0);
+	if ((contents = ReadFile(&fat, "LOG     CSV", &size, usedClusters)) != NULL)
+		CheckLog(contents, size, unitLogFirst + unitLogRecords - LOG_CACHE_RECORDS, unitLogFirst + unitLogRecords);
+
+	//clusters no file holds must read as free, or hosts think the volume is full
+	for (uint32_t cluster = 2; cluster < fat.clusters + 2; cluster++){
+		if (!usedClusters[cluster] && GetFatEntry(&fat, cluster) != 0){
+			fprintf(stderr, "cluster %u is in no file but not free\n", (unsigned)cluster);
+			failures++;
+			break;
+		}
+	}
+	CheckLogRefresh(&fat);
+
+	if (failures)
+		printf("fat_test: %d checks failed\n", failures);
+	else
+		printf("fat_test: volume mounts\n");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1 @@
+/* DataManager.c drives the UART registers itself */
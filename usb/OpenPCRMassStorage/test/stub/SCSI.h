@@ -0,0 +1,47 @@
+/* Host stand-in for SCSI.h and the parts of LUFA and the AVR headers that
+   DataManager.c uses. The endpoint, UART and timer are implemented by the
+   test. */
+
+#ifndef _SCSI_H_
+#define _SCSI_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#define VIRTUAL_MEMORY_BYTES				((uint32_t)512 * (uint32_t)4352)
+#define VIRTUAL_MEMORY_BLOCK_SIZE			512
+#define VIRTUAL_MEMORY_BLOCKS				(VIRTUAL_MEMORY_BYTES / VIRTUAL_MEMORY_BLOCK_SIZE)
+
+#define MASS_STORAGE_IO_EPSIZE				64
+#define USE_INTERNAL_SERIAL					0xdc
+#define NO_STREAM_CALLBACK					NULL
+#define ENDPOINT_RWSTREAM_NoError			0
+
+#define PROGMEM
+#define pgm_read_byte(address)				(*(const uint8_t*)(address))
+#define pgm_read_word(address)				(*(address))
+#define memcpy_P							memcpy
+
+uint16_t* Test_Register(int reg);
+enum{ TEST_UCSR1A, TEST_UCSR1B, TEST_UDR1, TEST_TIFR1 };
+#define UCSR1A								(*Test_Register(TEST_UCSR1A))
+#define UCSR1B								(*Test_Register(TEST_UCSR1B))
+#define UDR1								(*Test_Register(TEST_UDR1))
+#define TIFR1								(*Test_Register(TEST_TIFR1))
+#define UDRE1								5
+#define RXCIE1								7
+#define TOV1								0
+
+bool Endpoint_IsReadWriteAllowed(void);
+void Endpoint_ClearIN(void);
+void Endpoint_ClearOUT(void);
+uint8_t Endpoint_WaitUntilReady(void);
+uint8_t Endpoint_Read_Byte(void);
+uint8_t Endpoint_Write_Stream_LE(const void* buffer, uint16_t length, void* callback);
+uint8_t Endpoint_Write_PStream_LE(const void* buffer, uint16_t length, void* callback);
+uint8_t Endpoint_Write_EStream_LE(const void* buffer, uint16_t length, void* callback);
+uint8_t Endpoint_Discard_Stream(uint16_t length, void* callback);
+
+#endif
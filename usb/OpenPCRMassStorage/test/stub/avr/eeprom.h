@@ -0,0 +1,11 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+extern uint8_t Test_Eeprom[512];
+bool Test_EepromIsReady(void);
+
+#define eeprom_read_byte(address)			(Test_Eeprom[(uintptr_t)(address)])
+#define eeprom_read_word(address)			((uint16_t)(Test_Eeprom[(uintptr_t)(address)] | (Test_Eeprom[(uintptr_t)(address)+1] << 8)))
+#define eeprom_update_byte(address, value)	(Test_Eeprom[(uintptr_t)(address)] = (value))
+#define eeprom_is_ready()					Test_EepromIsReady()
@@ -0,0 +1 @@
+#define ISR(vector)		void vector(void)